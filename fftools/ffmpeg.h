@@ -178,6 +178,8 @@ typedef struct OptionsContext {
     int        nb_max_frames;
     SpecifierOpt *bitstream_filters;
     int        nb_bitstream_filters;
+    SpecifierOpt *bsf_async;
+    int        nb_bsf_async;
     SpecifierOpt *codec_tags;
     int        nb_codec_tags;
     SpecifierOpt *sample_fmts;
@@ -51,6 +51,7 @@ static const char *const opt_name_apad[]                      = {"apad", NULL};
 static const char *const opt_name_autoscale[]                 = {"autoscale", NULL};
 static const char *const opt_name_bits_per_raw_sample[]       = {"bits_per_raw_sample", NULL};
 static const char *const opt_name_bitstream_filters[]         = {"bsf", "absf", "vbsf", NULL};
+static const char *const opt_name_bsf_async[]                 = {"bsf_async", NULL};
 static const char *const opt_name_copy_initial_nonkeyframes[] = {"copyinkf", NULL};
 static const char *const opt_name_copy_prior_start[]          = {"copypriorss", NULL};
 static const char *const opt_name_disposition[]               = {"disposition", NULL};
@@ -182,6 +183,7 @@ static OutputStream *new_output_stream(Muxer *mux, const OptionsContext *o,
     const char *bsfs = NULL, *time_base = NULL;
     char *next, *codec_tag = NULL;
     double qscale = -1;
+    int bsf_async = 0;
     int i;
 
     if (!st)
@@ -315,6 +317,21 @@ static OutputStream *new_output_stream(Muxer *mux, const OptionsContext *o,
             av_log(NULL, AV_LOG_ERROR, "Error parsing bitstream filter sequence '%s': %s\n", bsfs, av_err2str(ret));
             exit_program(1);
         }
+
+        MATCH_PER_STREAM_OPT(bsf_async, i, bsf_async, oc, st);
+        /* only filter chains are run asynchronously, a single filter is not
+         * wrapped in a list */
+        if (bsf_async && strcmp(ms->bsf_ctx->filter->name, "bsf_list")) {
+            av_log(NULL, AV_LOG_WARNING, "-bsf_async has no effect with the single "
+                   "bitstream filter '%s'\n", bsfs);
+        } else if (bsf_async) {
+            ret = av_opt_set_int(ms->bsf_ctx->priv_data, "async", 1, 0);
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Error enabling asynchronous bitstream filtering: %s\n",
+                       av_err2str(ret));
+                exit_program(1);
+            }
+        }
     }
 
     MATCH_PER_STREAM_OPT(codec_tags, str, codec_tag, oc, st);
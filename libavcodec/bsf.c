@@ -18,6 +18,7 @@
 
 #include <string.h>
 
+#include "config.h"
 #include "config_components.h"
 
 #include "libavutil/avassert.h"
@@ -26,6 +27,8 @@
 #include "libavutil/opt.h"
 #include "libavutil/avstring.h"
 #include "libavutil/bprint.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadmessage.h"
 
 #include "bsf.h"
 #include "bsf_internal.h"
@@ -269,6 +272,16 @@ int ff_bsf_get_packet_ref(AVBSFContext *ctx, AVPacket *pkt)
     return 0;
 }
 
+typedef struct BSFListWorker {
+    struct BSFListContext *lst;
+    AVBSFContext         *bsf;
+    AVThreadMessageQueue *in;   // packets to be filtered by bsf
+    AVThreadMessageQueue *out;  // packets output by bsf
+#if HAVE_THREADS
+    pthread_t             thread;
+#endif
+} BSFListWorker;
+
 typedef struct BSFListContext {
     const AVClass *class;
 
@@ -278,8 +291,258 @@ typedef struct BSFListContext {
     unsigned idx;           // index of currently processed BSF
 
     char * item_name;
+
+    int async;
+    int queue_size;
+
+    /* async mode only */
+    BSFListWorker         *workers;
+    AVThreadMessageQueue **queues;      // nb_bsfs + 1 queues linking the workers
+    int                    nb_threads;  // number of running worker threads
+    int                    worker_err;
+    AVPacket              *pending;     // input not yet accepted by queues[0]
+    int                    eof_sent;
+#if HAVE_THREADS
+    /* bumped whenever queues[0] is drained or queues[nb_bsfs] is filled */
+    pthread_mutex_t        progress_lock;
+    pthread_cond_t         progress_cond;
+    unsigned               progress;
+#endif
 } BSFListContext;
 
+#if HAVE_THREADS
+static void bsf_list_free_msg(void *msg)
+{
+    av_packet_free(msg);
+}
+
+static void bsf_list_signal_progress(BSFListContext *lst)
+{
+    pthread_mutex_lock(&lst->progress_lock);
+    lst->progress++;
+    pthread_cond_signal(&lst->progress_cond);
+    pthread_mutex_unlock(&lst->progress_lock);
+}
+
+static void *bsf_list_worker(void *arg)
+{
+    BSFListWorker *w = arg;
+    BSFListContext *lst = w->lst;
+    int first = w == &lst->workers[0];
+    int last  = w == &lst->workers[lst->nb_bsfs - 1];
+    AVPacket *pkt;
+    int ret;
+
+    while (1) {
+        ret = av_thread_message_queue_recv(w->in, &pkt, 0);
+        if (first)
+            bsf_list_signal_progress(lst);
+        if (ret == AVERROR_EOF)
+            pkt = NULL;
+        else if (ret < 0)
+            break;
+
+        ret = av_bsf_send_packet(w->bsf, pkt);
+        av_packet_free(&pkt);
+        if (ret < 0)
+            break;
+
+        while (1) {
+            pkt = av_packet_alloc();
+            if (!pkt) {
+                ret = AVERROR(ENOMEM);
+                goto finish;
+            }
+            ret = av_bsf_receive_packet(w->bsf, pkt);
+            if (ret >= 0) {
+                ret = av_thread_message_queue_send(w->out, &pkt, 0);
+                if (last)
+                    bsf_list_signal_progress(lst);
+            }
+            if (ret < 0) {
+                av_packet_free(&pkt);
+                if (ret == AVERROR(EAGAIN))
+                    break;
+                goto finish;
+            }
+        }
+    }
+
+finish:
+    /* wake up both neighbours; EOF is only propagated downstream */
+    av_thread_message_queue_set_err_send(w->in, ret == AVERROR_EOF ? AVERROR_EXIT : ret);
+    av_thread_message_queue_set_err_recv(w->out, ret);
+    bsf_list_signal_progress(lst);
+    return NULL;
+}
+
+static void bsf_list_stop_workers(BSFListContext *lst)
+{
+    for (int i = 0; i <= lst->nb_bsfs; i++) {
+        av_thread_message_queue_set_err_send(lst->queues[i], AVERROR_EXIT);
+        av_thread_message_queue_set_err_recv(lst->queues[i], AVERROR_EXIT);
+    }
+    for (int i = 0; i < lst->nb_threads; i++)
+        pthread_join(lst->workers[i].thread, NULL);
+    lst->nb_threads = 0;
+
+    for (int i = 0; i <= lst->nb_bsfs; i++)
+        av_thread_message_flush(lst->queues[i]);
+    av_packet_free(&lst->pending);
+    lst->eof_sent = 0;
+}
+
+static int bsf_list_start_workers(BSFListContext *lst)
+{
+    int ret;
+
+    for (int i = 0; i <= lst->nb_bsfs; i++) {
+        av_thread_message_queue_set_err_send(lst->queues[i], 0);
+        av_thread_message_queue_set_err_recv(lst->queues[i], 0);
+    }
+
+    for (int i = 0; i < lst->nb_bsfs; i++) {
+        ret = pthread_create(&lst->workers[i].thread, NULL,
+                             bsf_list_worker, &lst->workers[i]);
+        if (ret) {
+            bsf_list_stop_workers(lst);
+            return AVERROR(ret);
+        }
+        lst->nb_threads++;
+    }
+
+    return 0;
+}
+
+static void bsf_list_uninit_async(BSFListContext *lst)
+{
+    if (!lst->queues)
+        return;
+
+    bsf_list_stop_workers(lst);
+    for (int i = 0; i <= lst->nb_bsfs; i++)
+        av_thread_message_queue_free(&lst->queues[i]);
+    av_freep(&lst->queues);
+    av_freep(&lst->workers);
+    pthread_cond_destroy(&lst->progress_cond);
+    pthread_mutex_destroy(&lst->progress_lock);
+}
+
+static int bsf_list_init_async(BSFListContext *lst)
+{
+    AVThreadMessageQueue **queues;
+    int ret;
+
+    ret = pthread_mutex_init(&lst->progress_lock, NULL);
+    if (ret)
+        return AVERROR(ret);
+    ret = pthread_cond_init(&lst->progress_cond, NULL);
+    if (ret) {
+        pthread_mutex_destroy(&lst->progress_lock);
+        return AVERROR(ret);
+    }
+
+    lst->workers = av_calloc(lst->nb_bsfs, sizeof(*lst->workers));
+    queues       = av_calloc(lst->nb_bsfs + 1, sizeof(*queues));
+    if (!lst->workers || !queues) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    for (int i = 0; i <= lst->nb_bsfs; i++) {
+        ret = av_thread_message_queue_alloc(&queues[i], lst->queue_size,
+                                            sizeof(AVPacket*));
+        if (ret < 0)
+            goto fail;
+        av_thread_message_queue_set_free_func(queues[i], bsf_list_free_msg);
+    }
+
+    for (int i = 0; i < lst->nb_bsfs; i++) {
+        lst->workers[i].lst = lst;
+        lst->workers[i].bsf = lst->bsfs[i];
+        lst->workers[i].in  = queues[i];
+        lst->workers[i].out = queues[i + 1];
+    }
+
+    lst->queues = queues;
+    ret = bsf_list_start_workers(lst);
+    if (ret < 0)
+        bsf_list_uninit_async(lst);
+    return ret;
+
+fail:
+    if (queues) {
+        for (int i = 0; i <= lst->nb_bsfs; i++)
+            av_thread_message_queue_free(&queues[i]);
+        av_free(queues);
+    }
+    av_freep(&lst->workers);
+    pthread_cond_destroy(&lst->progress_cond);
+    pthread_mutex_destroy(&lst->progress_lock);
+    return ret;
+}
+
+static int bsf_list_filter_async(AVBSFContext *bsf, AVPacket *out)
+{
+    BSFListContext *lst = bsf->priv_data;
+    AVThreadMessageQueue *first = lst->queues[0];
+    AVThreadMessageQueue *last  = lst->queues[lst->nb_bsfs];
+    AVPacket *pkt;
+    int ret;
+
+    if (lst->worker_err < 0)
+        return lst->worker_err;
+
+    while (1) {
+        unsigned progress;
+
+        if (!lst->pending && !lst->eof_sent) {
+            ret = ff_bsf_get_packet(bsf, &lst->pending);
+            if (ret == AVERROR_EOF) {
+                av_thread_message_queue_set_err_recv(first, AVERROR_EOF);
+                lst->eof_sent = 1;
+            } else if (ret < 0 && ret != AVERROR(EAGAIN))
+                return ret;
+        }
+
+        pthread_mutex_lock(&lst->progress_lock);
+        progress = lst->progress;
+        pthread_mutex_unlock(&lst->progress_lock);
+
+        if (lst->pending) {
+            ret = av_thread_message_queue_send(first, &lst->pending,
+                                               AV_THREAD_MESSAGE_NONBLOCK);
+            if (ret >= 0)
+                lst->pending = NULL;
+            else if (ret != AVERROR(EAGAIN))
+                return ret;
+        }
+
+        ret = av_thread_message_queue_recv(last, &pkt, AV_THREAD_MESSAGE_NONBLOCK);
+        if (ret >= 0) {
+            av_packet_move_ref(out, pkt);
+            av_packet_free(&pkt);
+            return 0;
+        }
+        if (ret != AVERROR(EAGAIN))
+            return ret;
+
+        /* Let the caller keep the pipeline busy while input is accepted. */
+        if (!lst->pending && !lst->eof_sent)
+            return AVERROR(EAGAIN);
+
+        /* Neither end can move: sleep until a worker drains the first queue
+         * or fills the last one. Blocking on either queue alone could
+         * deadlock, as a filter may need the pending packet to produce
+         * output, and the workers stall while the output is not read. */
+        pthread_mutex_lock(&lst->progress_lock);
+        while (lst->progress == progress)
+            pthread_cond_wait(&lst->progress_cond, &lst->progress_lock);
+        pthread_mutex_unlock(&lst->progress_lock);
+    }
+}
+#endif
+
 
 static int bsf_list_init(AVBSFContext *bsf)
 {
@@ -305,6 +568,17 @@ static int bsf_list_init(AVBSFContext *bsf)
 
     bsf->time_base_out = tb;
     ret = avcodec_parameters_copy(bsf->par_out, cod_par);
+    if (ret < 0)
+        goto fail;
+
+    if (lst->async && lst->nb_bsfs) {
+#if HAVE_THREADS
+        ret = bsf_list_init_async(lst);
+#else
+        av_log(bsf, AV_LOG_ERROR, "Asynchronous filtering requires threading support\n");
+        ret = AVERROR(ENOSYS);
+#endif
+    }
 
 fail:
     return ret;
@@ -318,6 +592,11 @@ static int bsf_list_filter(AVBSFContext *bsf, AVPacket *out)
     if (!lst->nb_bsfs)
         return ff_bsf_get_packet_ref(bsf, out);
 
+#if HAVE_THREADS
+    if (lst->queues)
+        return bsf_list_filter_async(bsf, out);
+#endif
+
     while (1) {
         /* get a packet from the previous filter up the chain */
         if (lst->idx)
@@ -356,9 +635,19 @@ static void bsf_list_flush(AVBSFContext *bsf)
 {
     BSFListContext *lst = bsf->priv_data;
 
+#if HAVE_THREADS
+    if (lst->queues)
+        bsf_list_stop_workers(lst);
+#endif
+
     for (int i = 0; i < lst->nb_bsfs; i++)
         av_bsf_flush(lst->bsfs[i]);
     lst->idx = 0;
+
+#if HAVE_THREADS
+    if (lst->queues)
+        lst->worker_err = bsf_list_start_workers(lst);
+#endif
 }
 
 static void bsf_list_close(AVBSFContext *bsf)
@@ -366,6 +655,10 @@ static void bsf_list_close(AVBSFContext *bsf)
     BSFListContext *lst = bsf->priv_data;
     int i;
 
+#if HAVE_THREADS
+    bsf_list_uninit_async(lst);
+#endif
+
     for (i = 0; i < lst->nb_bsfs; ++i)
         av_bsf_free(&lst->bsfs[i]);
     av_freep(&lst->bsfs);
@@ -397,9 +690,20 @@ static const char *bsf_list_item_name(void *ctx)
     return lst->item_name;
 }
 
+#define OFFSET(x) offsetof(BSFListContext, x)
+#define FLAGS (AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_AUDIO_PARAM|AV_OPT_FLAG_SUBTITLE_PARAM|AV_OPT_FLAG_BSF_PARAM)
+static const AVOption bsf_list_options[] = {
+    { "async",      "run every filter of the list in its own thread",
+        OFFSET(async),      AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1,       FLAGS },
+    { "queue_size", "maximum number of packets queued between two filters in async mode",
+        OFFSET(queue_size), AV_OPT_TYPE_INT,  { .i64 = 8 }, 1, INT_MAX, FLAGS },
+    { NULL },
+};
+
 static const AVClass bsf_list_class = {
         .class_name = "bsf_list",
         .item_name  = bsf_list_item_name,
+        .option     = bsf_list_options,
         .version    = LIBAVUTIL_VERSION_INT,
 };
 
@@ -152,6 +152,7 @@ static void cbs_unit_uninit(CodedBitstreamUnit *unit)
     unit->data             = NULL;
     unit->data_size        = 0;
     unit->data_bit_padding = 0;
+    unit->data_escaped     = 0;
 }
 
 void ff_cbs_fragment_reset(CodedBitstreamFragment *frag)
@@ -176,11 +177,44 @@ av_cold void ff_cbs_fragment_free(CodedBitstreamFragment *frag)
     frag->nb_units_allocated = 0;
 }
 
+static int cbs_read_unit_content(CodedBitstreamContext *ctx,
+                                 CodedBitstreamUnit *unit, int i)
+{
+    int err;
+
+    av_buffer_unref(&unit->content_ref);
+    unit->content = NULL;
+
+    av_assert0(unit->data && unit->data_ref);
+
+    err = ctx->codec->read_unit(ctx, unit);
+    if (err == AVERROR(ENOSYS)) {
+        av_log(ctx->log_ctx, AV_LOG_VERBOSE,
+               "Decomposition unimplemented for unit %d "
+               "(type %"PRIu32").\n", i, unit->type);
+    } else if (err == AVERROR(EAGAIN)) {
+        av_log(ctx->log_ctx, AV_LOG_VERBOSE,
+               "Skipping decomposition of unit %d "
+               "(type %"PRIu32").\n", i, unit->type);
+        av_buffer_unref(&unit->content_ref);
+        unit->content = NULL;
+    } else if (err < 0) {
+        av_log(ctx->log_ctx, AV_LOG_ERROR, "Failed to read unit %d "
+               "(type %"PRIu32").\n", i, unit->type);
+        return err;
+    }
+
+    return 0;
+}
+
 static int cbs_read_fragment_content(CodedBitstreamContext *ctx,
                                      CodedBitstreamFragment *frag)
 {
     int err, i, j;
 
+    if (ctx->lazy_decompose && !ctx->decompose_unit_types)
+        return 0;
+
     for (i = 0; i < frag->nb_units; i++) {
         CodedBitstreamUnit *unit = &frag->units[i];
 
@@ -193,32 +227,26 @@ static int cbs_read_fragment_content(CodedBitstreamContext *ctx,
                 continue;
         }
 
-        av_buffer_unref(&unit->content_ref);
-        unit->content = NULL;
-
-        av_assert0(unit->data && unit->data_ref);
-
-        err = ctx->codec->read_unit(ctx, unit);
-        if (err == AVERROR(ENOSYS)) {
-            av_log(ctx->log_ctx, AV_LOG_VERBOSE,
-                   "Decomposition unimplemented for unit %d "
-                   "(type %"PRIu32").\n", i, unit->type);
-        } else if (err == AVERROR(EAGAIN)) {
-            av_log(ctx->log_ctx, AV_LOG_VERBOSE,
-                   "Skipping decomposition of unit %d "
-                   "(type %"PRIu32").\n", i, unit->type);
-            av_buffer_unref(&unit->content_ref);
-            unit->content = NULL;
-        } else if (err < 0) {
-            av_log(ctx->log_ctx, AV_LOG_ERROR, "Failed to read unit %d "
-                   "(type %"PRIu32").\n", i, unit->type);
+        err = cbs_read_unit_content(ctx, unit, i);
+        if (err < 0)
             return err;
-        }
     }
 
     return 0;
 }
 
+int ff_cbs_decompose_unit(CodedBitstreamContext *ctx,
+                          CodedBitstreamFragment *frag,
+                          int position)
+{
+    av_assert0(0 <= position && position < frag->nb_units);
+
+    if (frag->units[position].content)
+        return 0;
+
+    return cbs_read_unit_content(ctx, &frag->units[position], position);
+}
+
 static int cbs_fill_fragment_data(CodedBitstreamFragment *frag,
                                   const uint8_t *data, size_t size)
 {
@@ -404,6 +432,7 @@ int ff_cbs_write_fragment_data(CodedBitstreamContext *ctx,
 
         av_buffer_unref(&unit->data_ref);
         unit->data = NULL;
+        unit->data_escaped = 0;
 
         err = cbs_write_unit_data(ctx, unit);
         if (err < 0) {
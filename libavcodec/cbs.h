@@ -95,6 +95,16 @@ typedef struct CodedBitstreamUnit {
      * Must be set if data is not NULL.
      */
     AVBufferRef *data_ref;
+    /**
+     * Set if data is not the directly-parsable form of this unit but
+     * still contains the escaping of the original bitstream (e.g.
+     * H.264/H.265 emulation prevention bytes).
+     *
+     * Only used for units read by a context in lazy decomposition mode
+     * which have not been decomposed yet.  Such units are copied to
+     * the output as they are when the fragment is assembled.
+     */
+    int data_escaped;
 
     /**
      * Pointer to the decomposed form of this unit.
@@ -205,6 +215,17 @@ typedef struct CodedBitstreamContext {
      */
     int nb_decompose_unit_types;
 
+    /**
+     * Lazy decomposition mode.
+     *
+     * If set, reading only splits fragments into units and decomposes
+     * the types in decompose_unit_types (none if that is NULL).  Other
+     * units are kept in the form found in the bitstream, without copying
+     * or unescaping them, and are passed through unchanged on writing.
+     * They can be decomposed on demand with ff_cbs_decompose_unit().
+     */
+    int lazy_decompose;
+
     /**
      * Enable trace output during read/write operations.
      */
@@ -310,6 +331,18 @@ int ff_cbs_read(CodedBitstreamContext *ctx,
                 CodedBitstreamFragment *frag,
                 const uint8_t *data, size_t size);
 
+/**
+ * Decompose the unit at the given position of a fragment read before.
+ *
+ * Does nothing if the unit is already decomposed or if decomposition
+ * is not supported for its type.  Units must be decomposed in bitstream
+ * order relative to the units they depend on (e.g. parameter sets must
+ * be decomposed before the slices referring to them).
+ */
+int ff_cbs_decompose_unit(CodedBitstreamContext *ctx,
+                          CodedBitstreamFragment *frag,
+                          int position);
+
 
 /**
  * Write the content of the fragment to its own internal buffer.
@@ -25,6 +25,7 @@
 #include "cbs_h264.h"
 #include "cbs_h265.h"
 #include "h264.h"
+#include "h2645dsp.h"
 #include "h2645_parse.h"
 #include "hevc.h"
 
@@ -466,6 +467,63 @@ static int cbs_h2645_read_more_rbsp_data(GetBitContext *gbc)
 #undef allocate
 
 
+// In lazy mode, NAL units which are not decomposed right away are left
+// escaped, so that they can be passed through without being unescaped
+// and escaped again if they are never decomposed.
+static uint64_t cbs_h2645_escaped_nal_types(CodedBitstreamContext *ctx)
+{
+    uint64_t types = ~UINT64_C(0);
+
+    if (!ctx->lazy_decompose)
+        return 0;
+
+    for (int i = 0; ctx->decompose_unit_types &&
+                    i < ctx->nb_decompose_unit_types; i++) {
+        if (ctx->decompose_unit_types[i] < 64)
+            types &= ~(UINT64_C(1) << ctx->decompose_unit_types[i]);
+    }
+    return types;
+}
+
+static int cbs_h2645_unescape_unit(CodedBitstreamUnit *unit)
+{
+    const H2645DSPContext *dsp = ff_h2645dsp_get();
+    AVBufferRef *ref;
+    uint8_t *dst;
+    size_t sp, dp;
+
+    ref = av_buffer_alloc(unit->data_size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!ref)
+        return AVERROR(ENOMEM);
+    dst = ref->data;
+
+    sp = dp = 0;
+    while (sp < unit->data_size) {
+        size_t run = dsp->find_escape(unit->data + sp, unit->data_size - sp);
+        int escape = sp + run < unit->data_size &&
+                     unit->data[sp + run + 2] == 3;
+
+        // Copy up to the emulation_prevention_three_byte, or up to the
+        // second zero of any other 0x0000XX sequence.
+        run = FFMIN(run + (escape ? 2 : 1), unit->data_size - sp);
+        memcpy(dst + dp, unit->data + sp, run);
+        dp += run;
+        sp += run + escape;
+    }
+    // Remove trailing zeroes (cabac_zero_words).
+    while (dp > 0 && dst[dp - 1] == 0)
+        --dp;
+    memset(dst + dp, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    av_buffer_unref(&unit->data_ref);
+    unit->data_ref     = ref;
+    unit->data         = dst;
+    unit->data_size    = dp;
+    unit->data_escaped = 0;
+
+    return 0;
+}
+
 static int cbs_h2645_fragment_add_nals(CodedBitstreamContext *ctx,
                                        CodedBitstreamFragment *frag,
                                        const H2645Packet *packet)
@@ -495,6 +553,8 @@ static int cbs_h2645_fragment_add_nals(CodedBitstreamContext *ctx,
                             (uint8_t*)nal->data, size, ref);
         if (err < 0)
             return err;
+        if (packet->escaped_nal_types >> nal->type & 1)
+            frag->units[frag->nb_units - 1].data_escaped = 1;
     }
 
     return 0;
@@ -513,6 +573,8 @@ static int cbs_h2645_split_fragment(CodedBitstreamContext *ctx,
     if (frag->data_size == 0)
         return 0;
 
+    priv->read_packet.escaped_nal_types = cbs_h2645_escaped_nal_types(ctx);
+
     if (header && frag->data[0] && codec_id == AV_CODEC_ID_H264) {
         // AVCC header.
         size_t size, start, end;
@@ -692,6 +754,12 @@ static int cbs_h264_read_nal_unit(CodedBitstreamContext *ctx,
     GetBitContext gbc;
     int err;
 
+    if (unit->data_escaped) {
+        err = cbs_h2645_unescape_unit(unit);
+        if (err < 0)
+            return err;
+    }
+
     err = init_get_bits(&gbc, unit->data, 8 * unit->data_size);
     if (err < 0)
         return err;
@@ -811,6 +879,12 @@ static int cbs_h265_read_nal_unit(CodedBitstreamContext *ctx,
     GetBitContext gbc;
     int err;
 
+    if (unit->data_escaped) {
+        err = cbs_h2645_unescape_unit(unit);
+        if (err < 0)
+            return err;
+    }
+
     err = init_get_bits(&gbc, unit->data, 8 * unit->data_size);
     if (err < 0)
         return err;
@@ -1232,9 +1306,10 @@ static int cbs_h2645_unit_requires_zero_byte(enum AVCodecID codec_id,
 static int cbs_h2645_assemble_fragment(CodedBitstreamContext *ctx,
                                        CodedBitstreamFragment *frag)
 {
+    const H2645DSPContext *dsp = ff_h2645dsp_get();
     uint8_t *data;
     size_t max_size, dp, sp;
-    int err, i, zero_run;
+    int err, i;
 
     for (i = 0; i < frag->nb_units; i++) {
         // Data should already all have been written when we get here.
@@ -1272,21 +1347,25 @@ static int cbs_h2645_assemble_fragment(CodedBitstreamContext *ctx,
         data[dp++] = 0;
         data[dp++] = 1;
 
-        zero_run = 0;
-        for (sp = 0; sp < unit->data_size; sp++) {
-            if (zero_run < 2) {
-                if (unit->data[sp] == 0)
-                    ++zero_run;
-                else
-                    zero_run = 0;
-            } else {
-                if ((unit->data[sp] & ~3) == 0) {
-                    // emulation_prevention_three_byte
-                    data[dp++] = 3;
-                }
-                zero_run = unit->data[sp] == 0;
+        if (unit->data_escaped) {
+            memcpy(data + dp, unit->data, unit->data_size);
+            dp += unit->data_size;
+            continue;
+        }
+
+        sp = 0;
+        while (sp < unit->data_size) {
+            size_t run = dsp->find_escape(unit->data + sp,
+                                         unit->data_size - sp);
+            if (sp + run < unit->data_size)
+                run += 2;
+            memcpy(data + dp, unit->data + sp, run);
+            dp += run;
+            sp += run;
+            if (sp < unit->data_size) {
+                // emulation_prevention_three_byte
+                data[dp++] = 3;
             }
-            data[dp++] = unit->data[sp];
         }
     }
 
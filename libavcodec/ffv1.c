@@ -46,6 +46,8 @@ av_cold int ff_ffv1_common_init(AVCodecContext *avctx)
     s->width  = avctx->width;
     s->height = avctx->height;
 
+    ff_ffv1dsp_init(&s->dsp);
+
     // defaults
     s->num_h_slices = 1;
     s->num_v_slices = 1;
@@ -134,7 +136,8 @@ av_cold int ff_ffv1_init_slice_contexts(FFV1Context *f)
                                       sizeof(*fs->sample_buffer));
         fs->sample_buffer32 = av_malloc_array((fs->width + 6), 3 * MAX_PLANES *
                                         sizeof(*fs->sample_buffer32));
-        if (!fs->sample_buffer || !fs->sample_buffer32)
+        fs->context_buffer = av_malloc_array(fs->width, sizeof(*fs->context_buffer));
+        if (!fs->sample_buffer || !fs->sample_buffer32 || !fs->context_buffer)
             goto memfail;
     }
     f->max_slice_count = max_slice_count;
@@ -203,6 +206,7 @@ av_cold int ff_ffv1_close(AVCodecContext *avctx)
         }
         av_freep(&fs->sample_buffer);
         av_freep(&fs->sample_buffer32);
+        av_freep(&fs->context_buffer);
     }
 
     av_freep(&avctx->stats_out);
@@ -30,6 +30,7 @@
 
 #include "libavutil/imgutils.h"
 #include "avcodec.h"
+#include "ffv1dsp.h"
 #include "get_bits.h"
 #include "mathops.h"
 #include "put_bits.h"
@@ -105,6 +106,8 @@ typedef struct FFV1Context {
     int colorspace;
     int16_t *sample_buffer;
     int32_t *sample_buffer32;
+    int16_t *context_buffer;             ///< contexts of the current line, from the lines above
+    FFV1DSPContext dsp;
 
     int use32bit;
 
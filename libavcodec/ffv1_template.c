@@ -51,3 +51,25 @@ static inline int RENAME(get_context)(PlaneContext *p, TYPE *src,
                p->quant_table[2][(T - RT) & 0xFF];
 }
 
+static inline int RENAME(large_context)(const PlaneContext *p)
+{
+    return p->quant_table[3][127] || p->quant_table[4][127];
+}
+
+/**
+ * Complete the context computed by FFV1DSPContext.top_context with the
+ * parts that depend on the samples left of src.
+ */
+static inline int RENAME(get_context_left)(const PlaneContext *p, int top,
+                                           const TYPE *src, const TYPE *last,
+                                           int large)
+{
+    const int LT = last[-1];
+    const int L  = src[-1];
+    int context  = top + p->quant_table[0][(L - LT) & 0xFF];
+
+    if (large)
+        context += p->quant_table[3][(src[-2] - L) & 0xFF];
+    return context;
+}
+
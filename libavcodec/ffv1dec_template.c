@@ -28,6 +28,8 @@ static av_always_inline int RENAME(decode_line)(FFV1Context *s, int w,
 {
     PlaneContext *const p = &s->plane[plane_index];
     RangeCoder *const c   = &s->c;
+    int16_t *const top    = s->dsp.top_context_fast ? s->context_buffer : NULL;
+    const int large       = RENAME(large_context)(p);
     int x;
     int run_count = 0;
     int run_mode  = 0;
@@ -49,6 +51,11 @@ static av_always_inline int RENAME(decode_line)(FFV1Context *s, int w,
         return 0;
     }
 
+    /* sample[1] still holds the line two above */
+    if (top)
+        s->dsp.RENAME(top_context)(top, sample[0], large ? sample[1] : NULL,
+                                   p->quant_table, w);
+
     for (x = 0; x < w; x++) {
         int diff, context, sign;
 
@@ -57,7 +64,10 @@ static av_always_inline int RENAME(decode_line)(FFV1Context *s, int w,
                 return AVERROR_INVALIDDATA;
         }
 
-        context = RENAME(get_context)(p, sample[1] + x, sample[0] + x, sample[1] + x);
+        if (top)
+            context = RENAME(get_context_left)(p, top[x], sample[1] + x, sample[0] + x, large);
+        else
+            context = RENAME(get_context)(p, sample[1] + x, sample[0] + x, sample[1] + x);
         if (context < 0) {
             context = -context;
             sign    = 1;
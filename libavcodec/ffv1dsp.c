@@ -0,0 +1,58 @@
+/*
+ * FFV1 DSP functions
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+
+#include "libavutil/attributes.h"
+#include "ffv1dsp.h"
+
+/* The difference of T and RT at x is the one of LT and T at x + 1 */
+#define TOP_CONTEXT(name, type)                                             \
+static void name(int16_t *dst, const type *t, const type *tt,               \
+                 const int16_t (*quant_table)[256], int w)                  \
+{                                                                           \
+    const int16_t *q1 = quant_table[1], *q2 = quant_table[2];               \
+    int left = q1[(t[-1] - t[0]) & 0xFF];                                   \
+                                                                            \
+    if (tt) {                                                               \
+        const int16_t *q4 = quant_table[4];                                 \
+        for (int x = 0; x < w; x++) {                                       \
+            int d  = (t[x] - t[x + 1]) & 0xFF;                              \
+            dst[x] = left + q2[d] + q4[(tt[x] - t[x]) & 0xFF];              \
+            left   = q1[d];                                                 \
+        }                                                                   \
+    } else {                                                                \
+        for (int x = 0; x < w; x++) {                                       \
+            int d  = (t[x] - t[x + 1]) & 0xFF;                              \
+            dst[x] = left + q2[d];                                          \
+            left   = q1[d];                                                 \
+        }                                                                   \
+    }                                                                       \
+}
+
+TOP_CONTEXT(top_context_c,   int16_t)
+TOP_CONTEXT(top_context32_c, int32_t)
+
+av_cold void ff_ffv1dsp_init(FFV1DSPContext *c)
+{
+    c->top_context      = top_context_c;
+    c->top_context32    = top_context32_c;
+    c->top_context_fast = 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * FFV1 DSP functions
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_FFV1DSP_H
+#define AVCODEC_FFV1DSP_H
+
+#include <stdint.h>
+
+typedef struct FFV1DSPContext {
+    /**
+     * Compute the part of the context of each sample of a line that only
+     * depends on the lines above it, so that it is known before the line is
+     * coded:
+     * dst[x] = quant_table[1][(t[x - 1] - t[x]) & 0xFF] +
+     *          quant_table[2][(t[x] - t[x + 1]) & 0xFF]
+     * plus quant_table[4][(tt[x] - t[x]) & 0xFF] if tt is not NULL.
+     *
+     * @param t  line above, t[-1] and t[w] must be readable
+     * @param tt line two above, or NULL for the 3 input context model
+     */
+    void (*top_context)(int16_t *dst, const int16_t *t, const int16_t *tt,
+                        const int16_t (*quant_table)[256], int w);
+    void (*top_context32)(int16_t *dst, const int32_t *t, const int32_t *tt,
+                          const int16_t (*quant_table)[256], int w);
+
+    /**
+     * Set if top_context() is faster than computing the whole context of
+     * each sample in the coding loop. The table lookups of the latter mostly
+     * overlap with the entropy coder, so only optimized versions set it.
+     */
+    int top_context_fast;
+} FFV1DSPContext;
+
+void ff_ffv1dsp_init(FFV1DSPContext *c);
+
+#endif /* AVCODEC_FFV1DSP_H */
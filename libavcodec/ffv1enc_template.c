@@ -28,6 +28,8 @@ static av_always_inline int RENAME(encode_line)(FFV1Context *s, int w,
 {
     PlaneContext *const p = &s->plane[plane_index];
     RangeCoder *const c   = &s->c;
+    int16_t *const top    = s->dsp.top_context_fast ? s->context_buffer : NULL;
+    const int large       = RENAME(large_context)(p);
     int x;
     int run_index = s->run_index;
     int run_count = 0;
@@ -57,10 +59,17 @@ static av_always_inline int RENAME(encode_line)(FFV1Context *s, int w,
         return 0;
     }
 
+    if (top)
+        s->dsp.RENAME(top_context)(top, sample[1], large ? sample[2] : NULL,
+                                   p->quant_table, w);
+
     for (x = 0; x < w; x++) {
         int diff, context;
 
-        context = RENAME(get_context)(p, sample[0] + x, sample[1] + x, sample[2] + x);
+        if (top)
+            context = RENAME(get_context_left)(p, top[x], sample[0] + x, sample[1] + x, large);
+        else
+            context = RENAME(get_context)(p, sample[0] + x, sample[1] + x, sample[2] + x);
         diff    = sample[0][x] - RENAME(predict)(sample[0] + x, sample[1] + x);
 
         if (context < 0) {
@@ -184,8 +184,7 @@ static int filter_units_init(AVBSFContext *bsf)
         return err;
 
     // Don't actually decompose anything, we only want the unit data.
-    ctx->cbc->decompose_unit_types    = ctx->type_list;
-    ctx->cbc->nb_decompose_unit_types = 0;
+    ctx->cbc->lazy_decompose = 1;
 
     if (bsf->par_in->extradata) {
         CodedBitstreamFragment *frag = &ctx->fragment;
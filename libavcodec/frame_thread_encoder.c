@@ -41,6 +41,7 @@
 typedef struct{
     AVFrame  *indata;
     AVPacket *outdata;
+    int       frame_number;
     int       return_code;
     int       finished;
     int       got_packet;
@@ -64,6 +65,7 @@ typedef struct{
     unsigned next_task_index;
     unsigned task_index;
     unsigned finished_task_index;
+    int      frame_number;      ///< number of frames submitted so far
 
     pthread_t worker[MAX_THREADS];
     atomic_int exit;
@@ -110,6 +112,9 @@ static void * attribute_align_arg worker(void *v){
         task  = &c->tasks[task_index];
         frame = task->indata;
         pkt   = task->outdata;
+        /* Expose the position of the frame in the stream, which the
+         * thread's own context cannot count. */
+        avctx->frame_number = task->frame_number;
 
         ret = ff_encode_encode_cb(avctx, pkt, frame, &task->got_packet);
 #if FF_API_THREAD_SAFE_CALLBACKS
@@ -181,6 +186,19 @@ av_cold int ff_frame_thread_encoder_init(AVCodecContext *avctx)
         }
     }
 
+    if (avctx->codec_id == AV_CODEC_ID_WAVPACK) {
+        int64_t frame_threads = 0;
+
+        // frames only become independent at the cost of some compression
+        av_opt_get_int(avctx->priv_data, "frame_threads", 0, &frame_threads);
+        if (!frame_threads) {
+            av_log(avctx, AV_LOG_DEBUG,
+                   "Forcing thread count to 1 for WavPack encoding, use "
+                   "-frame_threads 1 for frame multi-threading\n");
+            avctx->thread_count = 1;
+        }
+    }
+
     if(!avctx->thread_count) {
         avctx->thread_count = av_cpu_count();
         avctx->thread_count = FFMIN(avctx->thread_count, MAX_THREADS);
@@ -294,6 +312,7 @@ int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt,
 
     if(frame){
         av_frame_move_ref(c->tasks[c->task_index].indata, frame);
+        c->tasks[c->task_index].frame_number = c->frame_number++;
 
         pthread_mutex_lock(&c->task_fifo_mutex);
         c->task_index = (c->task_index + 1) % c->max_tasks;
@@ -30,22 +30,71 @@
  * @see http://www.w3.org/Graphics/GIF/spec-gif89a.txt
  */
 
+#include "config.h"
+
+#include "libavutil/cpu.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "avcodec.h"
 #include "bytestream.h"
 #include "codec_internal.h"
 #include "encode.h"
 #include "lzw.h"
 #include "gif.h"
+#include "pthread_internal.h"
 
 #define DEFAULT_TRANSPARENCY_INDEX 0x1f
 
-typedef struct GIFContext {
-    const AVClass *class;
+/* LZW coder state, one per thread */
+typedef struct GIFCoder {
     LZWState *lzw;
     uint8_t *buf;
-    uint8_t *shrunk_buf;
     int buf_size;
+    uint8_t *shrunk_buf;                ///< coded area remapped to the shrunk palette
+    unsigned int shrunk_buf_size;
+    uint8_t *tmpl;                      ///< temporary line buffer
+} GIFCoder;
+
+/* How the image data of a frame is coded, as decided by gif_image_write_header() */
+typedef struct GIFImage {
+    int x_start, y_start;
+    int width, height;
+    int honor_transparency;             ///< code pixels unchanged from the last frame as trans
+    int trans;
+    int remap;
+    uint8_t map[AVPALETTE_COUNT];
+} GIFImage;
+
+#if HAVE_THREADS
+enum GIFJobState {
+    GIF_JOB_FREE,
+    GIF_JOB_QUEUED,
+    GIF_JOB_RUNNING,
+    GIF_JOB_DONE,
+};
+
+/* A frame whose image data is coded by one of the threads */
+typedef struct GIFJob {
+    GIFImage img;
+    AVFrame *frame;
+    AVFrame *last_frame;                ///< set if img.honor_transparency
+    AVPacket *pkt;                      ///< headers already written up to pos
+    int pos;
+    int64_t seq;
+    enum GIFJobState state;
+    int ret;
+} GIFJob;
+
+typedef struct GIFWorker {
+    struct GIFContext *s;
+    GIFCoder coder;
+    pthread_t thread;
+} GIFWorker;
+#endif
+
+typedef struct GIFContext {
+    const AVClass *class;
+    GIFCoder coder;                     ///< used without threads
     AVFrame *last_frame;
     int flags;
     int image;
@@ -53,9 +102,28 @@ typedef struct GIFContext {
     uint32_t palette[AVPALETTE_COUNT];  ///< local reference palette for !pal8
     int palette_loaded;
     int transparent_index;
-    uint8_t *tmpl;                      ///< temporary line buffer
+    int64_t nb_frames;
+
+#if HAVE_THREADS
+    GIFWorker *workers;
+    int nb_workers;
+    GIFJob *jobs;
+    int nb_jobs;
+    int64_t nb_returned;
+    unsigned pthread_init_cnt;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_cond_t done_cond;
+    int quit;
+#endif
 } GIFContext;
 
+#if HAVE_THREADS
+DEFINE_OFFSET_ARRAY(GIFContext, gif_context, pthread_init_cnt,
+                    (offsetof(GIFContext, mutex)),
+                    (offsetof(GIFContext, cond), offsetof(GIFContext, done_cond)));
+#endif
+
 enum {
     GF_OFFSETTING = 1<<0,
     GF_TRANSDIFF  = 1<<1,
@@ -86,7 +154,7 @@ static void shrink_palette(const uint32_t *src, uint8_t *map,
 
 static void remap_frame_to_palette(const uint8_t *src, int src_linesize,
                                    uint8_t *dst, int dst_linesize,
-                                   int w, int h, uint8_t *map)
+                                   int w, int h, const uint8_t *map)
 {
     for (int i = 0; i < h; i++)
         for (int j = 0; j < w; j++)
@@ -286,21 +354,26 @@ static void gif_crop_opaque(AVCodecContext *avctx,
     }
 }
 
-static int gif_image_write_image(AVCodecContext *avctx,
-                                 uint8_t **bytestream, uint8_t *end,
-                                 const uint32_t *palette,
-                                 const uint8_t *buf, const int linesize,
-                                 AVPacket *pkt)
+/**
+ * Crop the frame against the last one and write everything up to the
+ * LZW coded image data, which is described by img.
+ */
+static void gif_image_write_header(AVCodecContext *avctx,
+                                   uint8_t **bytestream,
+                                   const uint32_t *palette,
+                                   const uint8_t *buf, const int linesize,
+                                   GIFImage *img)
 {
     GIFContext *s = avctx->priv_data;
-    int disposal, len = 0, height = avctx->height, width = avctx->width, x, y;
+    int disposal, height = avctx->height, width = avctx->width;
     int x_start = 0, y_start = 0, trans = s->transparent_index;
     int bcid = -1, honor_transparency = (s->flags & GF_TRANSDIFF) && s->last_frame && !palette;
-    const uint8_t *ptr;
     uint32_t shrunk_palette[AVPALETTE_COUNT];
-    uint8_t map[AVPALETTE_COUNT] = { 0 };
+    uint8_t *map = img->map;
     size_t shrunk_palette_count = 0;
 
+    memset(map, 0, AVPALETTE_COUNT);
+
     /*
      * We memset to 0xff instead of 0x00 so that the transparency detection
      * doesn't pick anything after the palette entries as the transparency
@@ -318,7 +391,7 @@ static int gif_image_write_image(AVCodecContext *avctx,
         disposal = GCE_DISPOSAL_INPLACE;
     }
 
-    if (s->image || !avctx->frame_number) { /* GIF header */
+    if (s->image || !s->nb_frames) { /* GIF header */
         const uint32_t *global_palette = palette ? palette : s->palette;
         const AVRational sar = avctx->sample_aspect_ratio;
         int64_t aspect = 0;
@@ -394,49 +467,68 @@ static int gif_image_write_image(AVCodecContext *avctx,
 
     bytestream_put_byte(bytestream, 0x08);
 
-    ff_lzw_encode_init(s->lzw, s->buf, s->buf_size,
+    img->x_start            = x_start;
+    img->y_start            = y_start;
+    img->width              = width;
+    img->height             = height;
+    img->honor_transparency = honor_transparency;
+    img->trans              = trans;
+    img->remap              = shrunk_palette_count > 0;
+}
+
+/**
+ * Write the LZW coded image data described by img.
+ *
+ * @param ref last frame, only used if img->honor_transparency
+ */
+static int gif_image_write_data(GIFCoder *c, uint8_t **bytestream, uint8_t *end,
+                                const GIFImage *img,
+                                const uint8_t *buf, int linesize,
+                                const uint8_t *ref, int ref_linesize)
+{
+    const int width = img->width, height = img->height;
+    const uint8_t *ptr = buf + img->y_start * linesize + img->x_start;
+    int len = 0, x, y;
+
+    ff_lzw_encode_init(c->lzw, c->buf, c->buf_size,
                        12, FF_LZW_GIF, 1);
 
-    if (shrunk_palette_count) {
-        if (!s->shrunk_buf) {
-            s->shrunk_buf = av_malloc(avctx->height * linesize);
-            if (!s->shrunk_buf) {
-                av_log(avctx, AV_LOG_ERROR, "Could not allocated remapped frame buffer.\n");
-                return AVERROR(ENOMEM);
-            }
-        }
-        remap_frame_to_palette(buf, linesize, s->shrunk_buf, linesize, avctx->width, avctx->height, map);
-        ptr = s->shrunk_buf + y_start*linesize + x_start;
-    } else {
-        ptr = buf + y_start*linesize + x_start;
+    if (img->remap) {
+        /* only the cropped area is coded */
+        av_fast_malloc(&c->shrunk_buf, &c->shrunk_buf_size, width * height);
+        if (!c->shrunk_buf)
+            return AVERROR(ENOMEM);
+        remap_frame_to_palette(ptr, linesize, c->shrunk_buf, width,
+                               width, height, img->map);
+        ptr      = c->shrunk_buf;
+        linesize = width;
     }
-    if (honor_transparency) {
-        const int ref_linesize = s->last_frame->linesize[0];
-        const uint8_t *ref = s->last_frame->data[0] + y_start*ref_linesize + x_start;
+    if (img->honor_transparency) {
+        ref += img->y_start * ref_linesize + img->x_start;
 
         for (y = 0; y < height; y++) {
-            memcpy(s->tmpl, ptr, width);
+            memcpy(c->tmpl, ptr, width);
             for (x = 0; x < width; x++)
                 if (ref[x] == ptr[x])
-                    s->tmpl[x] = trans;
-            len += ff_lzw_encode(s->lzw, s->tmpl, width);
+                    c->tmpl[x] = img->trans;
+            len += ff_lzw_encode(c->lzw, c->tmpl, width);
             ptr += linesize;
             ref += ref_linesize;
         }
     } else {
         for (y = 0; y < height; y++) {
-            len += ff_lzw_encode(s->lzw, ptr, width);
+            len += ff_lzw_encode(c->lzw, ptr, width);
             ptr += linesize;
         }
     }
-    len += ff_lzw_encode_flush(s->lzw);
+    len += ff_lzw_encode_flush(c->lzw);
 
-    ptr = s->buf;
+    ptr = c->buf;
     while (len > 0) {
         int size = FFMIN(255, len);
         bytestream_put_byte(bytestream, size);
         if (end - *bytestream < size)
-            return -1;
+            return AVERROR_BUFFER_TOO_SMALL;
         bytestream_put_buffer(bytestream, ptr, size);
         ptr += size;
         len -= size;
@@ -445,42 +537,31 @@ static int gif_image_write_image(AVCodecContext *avctx,
     return 0;
 }
 
-static av_cold int gif_encode_init(AVCodecContext *avctx)
+static int gif_coder_init(GIFCoder *c, AVCodecContext *avctx)
 {
-    GIFContext *s = avctx->priv_data;
-
-    if (avctx->width > 65535 || avctx->height > 65535) {
-        av_log(avctx, AV_LOG_ERROR, "GIF does not support resolutions above 65535x65535\n");
-        return AVERROR(EINVAL);
-    }
-
-    s->transparent_index = -1;
-
-    s->lzw = av_mallocz(ff_lzw_encode_state_size);
-    s->buf_size = avctx->width*avctx->height*2 + 1000;
-    s->buf = av_malloc(s->buf_size);
-    s->tmpl = av_malloc(avctx->width);
-    if (!s->tmpl || !s->buf || !s->lzw)
+    c->lzw = av_mallocz(ff_lzw_encode_state_size);
+    c->buf_size = avctx->width*avctx->height*2 + 1000;
+    c->buf = av_malloc(c->buf_size);
+    c->tmpl = av_malloc(avctx->width);
+    if (!c->tmpl || !c->buf || !c->lzw)
         return AVERROR(ENOMEM);
-
-    if (avpriv_set_systematic_pal2(s->palette, avctx->pix_fmt) < 0)
-        av_assert0(avctx->pix_fmt == AV_PIX_FMT_PAL8);
-
     return 0;
 }
 
-static int gif_encode_frame(AVCodecContext *avctx, AVPacket *pkt,
-                            const AVFrame *pict, int *got_packet)
+static void gif_coder_uninit(GIFCoder *c)
+{
+    av_freep(&c->lzw);
+    av_freep(&c->buf);
+    av_freep(&c->shrunk_buf);
+    av_freep(&c->tmpl);
+    c->buf_size = c->shrunk_buf_size = 0;
+}
+
+/* Pick up the palette of the frame, NULL if the reference palette is used */
+static const uint32_t *gif_frame_palette(AVCodecContext *avctx, const AVFrame *pict)
 {
     GIFContext *s = avctx->priv_data;
-    uint8_t *outbuf_ptr, *end;
     const uint32_t *palette = NULL;
-    int ret;
-
-    if ((ret = ff_alloc_packet(avctx, pkt, avctx->width*avctx->height*7/5 + AV_INPUT_BUFFER_MIN_SIZE)) < 0)
-        return ret;
-    outbuf_ptr = pkt->data;
-    end        = pkt->data + pkt->size;
 
     if (avctx->pix_fmt == AV_PIX_FMT_PAL8) {
         palette = (uint32_t*)pict->data[1];
@@ -493,25 +574,269 @@ static int gif_encode_frame(AVCodecContext *avctx, AVPacket *pkt,
             palette = NULL;
         }
     }
+    return palette;
+}
 
-    gif_image_write_image(avctx, &outbuf_ptr, end, palette,
-                          pict->data[0], pict->linesize[0], pkt);
-    if (!s->last_frame && !s->image) {
+static int gif_update_last_frame(GIFContext *s, const AVFrame *pict)
+{
+    if (s->image)
+        return 0;
+
+    if (!s->last_frame) {
         s->last_frame = av_frame_alloc();
         if (!s->last_frame)
             return AVERROR(ENOMEM);
     }
 
-    if (!s->image) {
-        av_frame_unref(s->last_frame);
-        ret = av_frame_ref(s->last_frame, pict);
+    av_frame_unref(s->last_frame);
+    return av_frame_ref(s->last_frame, pict);
+}
+
+static int gif_packet_size(AVCodecContext *avctx)
+{
+    return avctx->width*avctx->height*7/5 + AV_INPUT_BUFFER_MIN_SIZE;
+}
+
+#if HAVE_THREADS
+static void *gif_worker(void *arg)
+{
+    GIFWorker *w  = arg;
+    GIFContext *s = w->s;
+
+    pthread_mutex_lock(&s->mutex);
+    while (!s->quit) {
+        GIFJob *job = NULL;
+        uint8_t *ptr;
+
+        /* code the frames in order */
+        for (int i = 0; i < s->nb_jobs; i++)
+            if (s->jobs[i].state == GIF_JOB_QUEUED &&
+                (!job || s->jobs[i].seq < job->seq))
+                job = &s->jobs[i];
+        if (!job) {
+            pthread_cond_wait(&s->cond, &s->mutex);
+            continue;
+        }
+        job->state = GIF_JOB_RUNNING;
+        pthread_mutex_unlock(&s->mutex);
+
+        ptr = job->pkt->data + job->pos;
+        job->ret = gif_image_write_data(&w->coder, &ptr, job->pkt->data + job->pkt->size,
+                                        &job->img, job->frame->data[0], job->frame->linesize[0],
+                                        job->last_frame ? job->last_frame->data[0]     : NULL,
+                                        job->last_frame ? job->last_frame->linesize[0] : 0);
+        if (job->ret >= 0)
+            av_shrink_packet(job->pkt, ptr - job->pkt->data);
+
+        pthread_mutex_lock(&s->mutex);
+        job->state = GIF_JOB_DONE;
+        pthread_cond_broadcast(&s->done_cond);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return NULL;
+}
+
+static av_cold int gif_threads_init(AVCodecContext *avctx, int nb_threads)
+{
+    GIFContext *s = avctx->priv_data;
+    int ret;
+
+    if ((ret = ff_pthread_init(s, gif_context_offsets)) < 0)
+        return ret;
+
+    s->jobs    = av_calloc(nb_threads, sizeof(*s->jobs));
+    s->workers = av_calloc(nb_threads, sizeof(*s->workers));
+    if (!s->jobs || !s->workers)
+        return AVERROR(ENOMEM);
+    s->nb_jobs = nb_threads;
+    for (int i = 0; i < nb_threads; i++) {
+        GIFJob *job = &s->jobs[i];
+        job->frame      = av_frame_alloc();
+        job->last_frame = av_frame_alloc();
+        job->pkt        = av_packet_alloc();
+        if (!job->frame || !job->last_frame || !job->pkt)
+            return AVERROR(ENOMEM);
+        if ((ret = gif_coder_init(&s->workers[i].coder, avctx)) < 0)
+            return ret;
+        s->workers[i].s = s;
+    }
+
+    for (; s->nb_workers < nb_threads; s->nb_workers++) {
+        ret = pthread_create(&s->workers[s->nb_workers].thread, NULL,
+                             gif_worker, &s->workers[s->nb_workers]);
+        if (ret)
+            return AVERROR(ret);
+    }
+    return 0;
+}
+
+static av_cold void gif_threads_uninit(GIFContext *s)
+{
+    if (s->nb_workers) {
+        pthread_mutex_lock(&s->mutex);
+        s->quit = 1;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->mutex);
+        for (int i = 0; i < s->nb_workers; i++)
+            pthread_join(s->workers[i].thread, NULL);
+        s->nb_workers = 0;
+    }
+    ff_pthread_free(s, gif_context_offsets);
+
+    for (int i = 0; i < s->nb_jobs; i++) {
+        av_frame_free(&s->jobs[i].frame);
+        av_frame_free(&s->jobs[i].last_frame);
+        av_packet_free(&s->jobs[i].pkt);
+        gif_coder_uninit(&s->workers[i].coder);
+    }
+    av_freep(&s->jobs);
+    av_freep(&s->workers);
+    s->nb_jobs = 0;
+}
+
+/*
+ * The headers are written in frame order, as they depend on the last frame,
+ * and the threads code the image data. The packets are returned once up to
+ * nb_jobs frames are being coded, or when flushing.
+ */
+static int gif_encode_frame_threaded(AVCodecContext *avctx, AVPacket *pkt,
+                                     const AVFrame *pict, int *got_packet)
+{
+    GIFContext *s = avctx->priv_data;
+    const uint32_t *palette;
+    GIFJob *job;
+    uint8_t *ptr;
+    int ret;
+
+    *got_packet = 0;
+    if (s->nb_frames - s->nb_returned == s->nb_jobs ||
+        (!pict && s->nb_returned < s->nb_frames)) {
+        job = &s->jobs[s->nb_returned % s->nb_jobs];
+
+        pthread_mutex_lock(&s->mutex);
+        while (job->state != GIF_JOB_DONE)
+            pthread_cond_wait(&s->done_cond, &s->mutex);
+        job->state = GIF_JOB_FREE;
+        pthread_mutex_unlock(&s->mutex);
+
+        ret = job->ret;
+        if (ret >= 0) {
+            av_packet_move_ref(pkt, job->pkt);
+            *got_packet = 1;
+        }
+        av_packet_unref(job->pkt);
+        av_frame_unref(job->frame);
+        av_frame_unref(job->last_frame);
+        s->nb_returned++;
         if (ret < 0)
             return ret;
     }
+    if (!pict)
+        return 0;
+
+    job = &s->jobs[s->nb_frames % s->nb_jobs];
+    av_assert1(job->state == GIF_JOB_FREE);
+
+    if ((ret = av_new_packet(job->pkt, gif_packet_size(avctx))) < 0)
+        return ret;
+    ptr = job->pkt->data;
+
+    palette = gif_frame_palette(avctx, pict);
+    gif_image_write_header(avctx, &ptr, palette, pict->data[0], pict->linesize[0], &job->img);
+    job->pos = ptr - job->pkt->data;
+
+    if ((ret = av_frame_ref(job->frame, pict)) < 0)
+        return ret;
+    if (job->img.honor_transparency &&
+        (ret = av_frame_ref(job->last_frame, s->last_frame)) < 0)
+        return ret;
+    if ((ret = gif_update_last_frame(s, pict)) < 0)
+        return ret;
+
+    job->pkt->pts = job->pkt->dts = pict->pts;
+    if (s->image || !s->nb_frames)
+        job->pkt->flags |= AV_PKT_FLAG_KEY;
+
+    pthread_mutex_lock(&s->mutex);
+    job->seq   = s->nb_frames++;
+    job->state = GIF_JOB_QUEUED;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+
+    return 0;
+}
+#endif /* HAVE_THREADS */
+
+static av_cold int gif_encode_init(AVCodecContext *avctx)
+{
+    GIFContext *s = avctx->priv_data;
+#if HAVE_THREADS
+    int nb_threads;
+#endif
+
+    if (avctx->width > 65535 || avctx->height > 65535) {
+        av_log(avctx, AV_LOG_ERROR, "GIF does not support resolutions above 65535x65535\n");
+        return AVERROR(EINVAL);
+    }
+
+    s->transparent_index = -1;
+
+    if (avpriv_set_systematic_pal2(s->palette, avctx->pix_fmt) < 0)
+        av_assert0(avctx->pix_fmt == AV_PIX_FMT_PAL8);
+
+#if HAVE_THREADS
+    nb_threads = avctx->thread_count ? avctx->thread_count : av_cpu_count();
+    nb_threads = FFMIN(nb_threads, MAX_AUTO_THREADS);
+    if (nb_threads > 1)
+        return gif_threads_init(avctx, nb_threads);
+#endif
+
+    return gif_coder_init(&s->coder, avctx);
+}
+
+static int gif_encode_frame(AVCodecContext *avctx, AVPacket *pkt,
+                            const AVFrame *pict, int *got_packet)
+{
+    GIFContext *s = avctx->priv_data;
+    uint8_t *outbuf_ptr, *end;
+    const uint32_t *palette;
+    GIFImage img;
+    int ret;
+
+#if HAVE_THREADS
+    if (s->nb_workers)
+        return gif_encode_frame_threaded(avctx, pkt, pict, got_packet);
+#endif
+
+    if (!pict) {
+        *got_packet = 0;
+        return 0;
+    }
+
+    if ((ret = ff_alloc_packet(avctx, pkt, gif_packet_size(avctx))) < 0)
+        return ret;
+    outbuf_ptr = pkt->data;
+    end        = pkt->data + pkt->size;
+
+    palette = gif_frame_palette(avctx, pict);
+
+    gif_image_write_header(avctx, &outbuf_ptr, palette,
+                           pict->data[0], pict->linesize[0], &img);
+    ret = gif_image_write_data(&s->coder, &outbuf_ptr, end, &img,
+                               pict->data[0], pict->linesize[0],
+                               s->last_frame ? s->last_frame->data[0]     : NULL,
+                               s->last_frame ? s->last_frame->linesize[0] : 0);
+    if (ret < 0)
+        return ret;
+
+    if ((ret = gif_update_last_frame(s, pict)) < 0)
+        return ret;
 
     pkt->size   = outbuf_ptr - pkt->data;
-    if (s->image || !avctx->frame_number)
+    pkt->pts    = pict->pts;
+    if (s->image || !s->nb_frames)
         pkt->flags |= AV_PKT_FLAG_KEY;
+    s->nb_frames++;
     *got_packet = 1;
 
     return 0;
@@ -521,12 +846,11 @@ static int gif_encode_close(AVCodecContext *avctx)
 {
     GIFContext *s = avctx->priv_data;
 
-    av_freep(&s->lzw);
-    av_freep(&s->buf);
-    av_freep(&s->shrunk_buf);
-    s->buf_size = 0;
+#if HAVE_THREADS
+    gif_threads_uninit(s);
+#endif
+    gif_coder_uninit(&s->coder);
     av_frame_free(&s->last_frame);
-    av_freep(&s->tmpl);
     return 0;
 }
 
@@ -553,7 +877,8 @@ const FFCodec ff_gif_encoder = {
     CODEC_LONG_NAME("GIF (Graphics Interchange Format)"),
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_GIF,
-    .p.capabilities = AV_CODEC_CAP_DR1,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
+                      AV_CODEC_CAP_OTHER_THREADS,
     .priv_data_size = sizeof(GIFContext),
     .init           = gif_encode_init,
     FF_CODEC_ENCODE_CB(gif_encode_frame),
@@ -563,5 +888,5 @@ const FFCodec ff_gif_encoder = {
         AV_PIX_FMT_GRAY8, AV_PIX_FMT_PAL8, AV_PIX_FMT_NONE
     },
     .p.priv_class   = &gif_class,
-    .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP,
+    .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP | FF_CODEC_CAP_AUTO_THREADS,
 };
@@ -29,111 +29,74 @@
 #include "bytestream.h"
 #include "hevc.h"
 #include "h264.h"
+#include "h2645dsp.h"
 #include "h2645_parse.h"
 
-int ff_h2645_extract_rbsp(const uint8_t *src, int length,
-                          H2645RBSP *rbsp, H2645NAL *nal, int small_padding)
+static int h2645_extract_rbsp(const H2645DSPContext *dsp,
+                              const uint8_t *src, int length,
+                              H2645RBSP *rbsp, H2645NAL *nal, int small_padding,
+                              int keep_escaped)
 {
     int i, si, di;
-    uint8_t *dst;
+    uint8_t *dst = &rbsp->rbsp_buffer[rbsp->rbsp_buffer_size];
 
     nal->skipped_bytes = 0;
-#define STARTCODE_TEST                                                  \
-        if (i + 2 < length && src[i + 1] == 0 && src[i + 2] <= 3) {     \
-            if (src[i + 2] != 3 && src[i + 2] != 0) {                   \
-                /* startcode, so we must be past the end */             \
-                length = i;                                             \
-            }                                                           \
-            break;                                                      \
-        }
-#if HAVE_FAST_UNALIGNED
-#define FIND_FIRST_ZERO                                                 \
-        if (i > 0 && !src[i])                                           \
-            i--;                                                        \
-        while (src[i])                                                  \
-            i++
-#if HAVE_FAST_64BIT
-    for (i = 0; i + 1 < length; i += 9) {
-        if (!((~AV_RN64(src + i) &
-               (AV_RN64(src + i) - 0x0100010001000101ULL)) &
-              0x8000800080008080ULL))
-            continue;
-        FIND_FIRST_ZERO;
-        STARTCODE_TEST;
-        i -= 7;
-    }
-#else
-    for (i = 0; i + 1 < length; i += 5) {
-        if (!((~AV_RN32(src + i) &
-               (AV_RN32(src + i) - 0x01000101U)) &
-              0x80008080U))
+
+    i = si = di = 0;
+    while (i < length) {
+        i += dsp->find_escape(src + i, length - i);
+        if (i >= length)
+            break;
+
+        if (src[i + 2] == 0) {
+            i++;
             continue;
-        FIND_FIRST_ZERO;
-        STARTCODE_TEST;
-        i -= 3;
-    }
-#endif /* HAVE_FAST_64BIT */
-#else
-    for (i = 0; i + 1 < length; i += 2) {
-        if (src[i])
+        } else if (src[i + 2] != 3) {
+            /* startcode, so we must be past the end */
+            length = i;
+            break;
+        }
+
+        if (keep_escaped) {
+            i += 3;
             continue;
-        if (i > 0 && src[i - 1] == 0)
-            i--;
-        STARTCODE_TEST;
+        }
+
+        /* remove escape */
+        memcpy(dst + di, src + si, i + 2 - si);
+        di += i + 2 - si;
+        si  = i += 3;
+
+        if (nal->skipped_bytes_pos) {
+            nal->skipped_bytes++;
+            if (nal->skipped_bytes_pos_size < nal->skipped_bytes) {
+                nal->skipped_bytes_pos_size *= 2;
+                av_assert0(nal->skipped_bytes_pos_size >= nal->skipped_bytes);
+                av_reallocp_array(&nal->skipped_bytes_pos,
+                        nal->skipped_bytes_pos_size,
+                        sizeof(*nal->skipped_bytes_pos));
+                if (!nal->skipped_bytes_pos) {
+                    nal->skipped_bytes_pos_size = 0;
+                    return AVERROR(ENOMEM);
+                }
+            }
+            if (nal->skipped_bytes_pos)
+                nal->skipped_bytes_pos[nal->skipped_bytes-1] = di - 1;
+        }
     }
-#endif /* HAVE_FAST_UNALIGNED */
 
-    if (i >= length - 1 && small_padding) { // no escaped 0
+    if (keep_escaped || (!si && small_padding)) { // no escaped 0
         nal->data     =
         nal->raw_data = src;
         nal->size     =
         nal->raw_size = length;
         return length;
-    } else if (i > length)
-        i = length;
-
-    dst = &rbsp->rbsp_buffer[rbsp->rbsp_buffer_size];
-
-    memcpy(dst, src, i);
-    si = di = i;
-    while (si + 2 < length) {
-        // remove escapes (very rare 1:2^22)
-        if (src[si + 2] > 3) {
-            dst[di++] = src[si++];
-            dst[di++] = src[si++];
-        } else if (src[si] == 0 && src[si + 1] == 0 && src[si + 2] != 0) {
-            if (src[si + 2] == 3) { // escape
-                dst[di++] = 0;
-                dst[di++] = 0;
-                si       += 3;
-
-                if (nal->skipped_bytes_pos) {
-                    nal->skipped_bytes++;
-                    if (nal->skipped_bytes_pos_size < nal->skipped_bytes) {
-                        nal->skipped_bytes_pos_size *= 2;
-                        av_assert0(nal->skipped_bytes_pos_size >= nal->skipped_bytes);
-                        av_reallocp_array(&nal->skipped_bytes_pos,
-                                nal->skipped_bytes_pos_size,
-                                sizeof(*nal->skipped_bytes_pos));
-                        if (!nal->skipped_bytes_pos) {
-                            nal->skipped_bytes_pos_size = 0;
-                            return AVERROR(ENOMEM);
-                        }
-                    }
-                    if (nal->skipped_bytes_pos)
-                        nal->skipped_bytes_pos[nal->skipped_bytes-1] = di - 1;
-                }
-                continue;
-            } else // next start code
-                goto nsc;
-        }
-
-        dst[di++] = src[si++];
     }
-    while (si < length)
-        dst[di++] = src[si++];
 
-nsc:
+    memcpy(dst + di, src + si, length - si);
+    di += length - si;
+    si  = length;
+
     memset(dst + di, 0, AV_INPUT_BUFFER_PADDING_SIZE);
 
     nal->data = dst;
@@ -145,6 +108,13 @@ nsc:
     return si;
 }
 
+int ff_h2645_extract_rbsp(const uint8_t *src, int length,
+                          H2645RBSP *rbsp, H2645NAL *nal, int small_padding)
+{
+    return h2645_extract_rbsp(ff_h2645dsp_get(), src, length,
+                              rbsp, nal, small_padding, 0);
+}
+
 static const char *const hevc_nal_type_name[64] = {
     "TRAIL_N", // HEVC_NAL_TRAIL_N
     "TRAIL_R", // HEVC_NAL_TRAIL_R
@@ -397,6 +367,7 @@ int ff_h2645_packet_split(H2645Packet *pkt, const uint8_t *buf, int length,
                           void *logctx, int is_nalff, int nal_length_size,
                           enum AVCodecID codec_id, int small_padding, int use_ref)
 {
+    const H2645DSPContext *dsp = ff_h2645dsp_get();
     GetByteContext bc;
     int consumed, ret = 0;
     int next_avc = is_nalff ? 0 : length;
@@ -414,6 +385,7 @@ int ff_h2645_packet_split(H2645Packet *pkt, const uint8_t *buf, int length,
         H2645NAL *nal;
         int extract_length = 0;
         int skip_trailing_zeros = 1;
+        int keep_escaped = 0;
 
         if (bytestream2_tell(&bc) == next_avc) {
             int i = 0;
@@ -480,7 +452,14 @@ int ff_h2645_packet_split(H2645Packet *pkt, const uint8_t *buf, int length,
         }
         nal = &pkt->nals[pkt->nb_nals];
 
-        consumed = ff_h2645_extract_rbsp(bc.buffer, extract_length, &pkt->rbsp, nal, small_padding);
+        if (pkt->escaped_nal_types && extract_length > 0) {
+            int type = codec_id == AV_CODEC_ID_HEVC ? (bc.buffer[0] >> 1) & 0x3f
+                                                    :  bc.buffer[0]       & 0x1f;
+            keep_escaped = pkt->escaped_nal_types >> type & 1;
+        }
+
+        consumed = h2645_extract_rbsp(dsp, bc.buffer, extract_length, &pkt->rbsp, nal,
+                                      small_padding, keep_escaped);
         if (consumed < 0)
             return consumed;
 
@@ -85,6 +85,12 @@ typedef struct H2645Packet {
     int nb_nals;
     int nals_allocated;
     unsigned nal_buffer_size;
+
+    /**
+     * Mask of NAL unit types (1 << nal_unit_type) which are not unescaped
+     * by ff_h2645_packet_split(), for callers which do not parse them.
+     */
+    uint64_t escaped_nal_types;
 } H2645Packet;
 
 /**
@@ -101,6 +107,8 @@ int ff_h2645_extract_rbsp(const uint8_t *src, int length, H2645RBSP *rbsp,
  * the data is contained in the input buffer pointed to by buf.
  * Otherwise, the unescaped data is part of the rbsp_buffer described by the
  * packet's H2645RBSP.
+ * NAL units of the types in the packet's escaped_nal_types always have
+ * data == raw_data, even if they contain emulation_prevention_three_bytes.
  *
  * If the packet's rbsp_buffer_ref is not NULL, the underlying AVBuffer must
  * own rbsp_buffer. If not and rbsp_buffer is not NULL, use_ref must be 0.
@@ -0,0 +1,81 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#include "libavutil/attributes.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/thread.h"
+#include "h2645dsp.h"
+
+static int find_escape_c(const uint8_t *buf, int size)
+{
+    int i = 0;
+
+    while (i + 2 < size) {
+        /* a sequence can only start at a zero byte, so skip whole words
+         * without any */
+#if HAVE_FAST_UNALIGNED
+#if HAVE_FAST_64BIT
+        if (i + 8 <= size &&
+            !((~AV_RN64(buf + i) & (AV_RN64(buf + i) - 0x0101010101010101ULL)) &
+              0x8080808080808080ULL)) {
+            i += 8;
+            continue;
+        }
+#else
+        if (i + 4 <= size &&
+            !((~AV_RN32(buf + i) & (AV_RN32(buf + i) - 0x01010101U)) &
+              0x80808080U)) {
+            i += 4;
+            continue;
+        }
+#endif
+#endif
+        if (!buf[i] && !buf[i + 1] && buf[i + 2] <= 3)
+            return i;
+        i++;
+    }
+
+    return size;
+}
+
+av_cold void ff_h2645dsp_init(H2645DSPContext *c)
+{
+    c->find_escape = find_escape_c;
+
+#if ARCH_AARCH64
+    ff_h2645dsp_init_aarch64(c);
+#elif ARCH_X86
+    ff_h2645dsp_init_x86(c);
+#endif
+}
+
+static H2645DSPContext h2645dsp;
+
+static av_cold void h2645dsp_init_static(void)
+{
+    ff_h2645dsp_init(&h2645dsp);
+}
+
+const H2645DSPContext *ff_h2645dsp_get(void)
+{
+    static AVOnce init_static_once = AV_ONCE_INIT;
+
+    ff_thread_once(&init_static_once, h2645dsp_init_static);
+    return &h2645dsp;
+}
@@ -0,0 +1,47 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_H2645DSP_H
+#define AVCODEC_H2645DSP_H
+
+#include <stdint.h>
+
+typedef struct H2645DSPContext {
+    /**
+     * Find the first 0x00 0x00 0xXX sequence with XX <= 3, i.e. the first
+     * place where emulation prevention has to be removed or inserted, or
+     * a start code.
+     *
+     * No bytes outside of buf[0..size-1] are read.
+     *
+     * @return offset of the first byte of the sequence, or size if there
+     *         is none
+     */
+    int (*find_escape)(const uint8_t *buf, int size);
+} H2645DSPContext;
+
+void ff_h2645dsp_init(H2645DSPContext *c);
+
+/**
+ * Get a context shared by all callers, initialized on first use.
+ */
+const H2645DSPContext *ff_h2645dsp_get(void);
+void ff_h2645dsp_init_aarch64(H2645DSPContext *c);
+void ff_h2645dsp_init_x86(H2645DSPContext *c);
+
+#endif /* AVCODEC_H2645DSP_H */
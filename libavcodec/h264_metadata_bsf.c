@@ -80,6 +80,8 @@ typedef struct H264MetadataContext {
     H264RawSEIDisplayOrientation display_orientation_payload;
 
     int level;
+
+    int lazy;
 } H264MetadataContext;
 
 
@@ -104,7 +106,19 @@ static int h264_metadata_insert_aud(AVBSFContext *bsf,
     for (i = 0; i < au->nb_units; i++) {
         if (au->units[i].type == H264_NAL_SLICE ||
             au->units[i].type == H264_NAL_IDR_SLICE) {
-            H264RawSlice *slice = au->units[i].content;
+            H264RawSlice *slice;
+
+            err = ff_cbs_decompose_unit(ctx->common.input, au, i);
+            if (err < 0)
+                return err;
+            slice = au->units[i].content;
+            if (!slice) {
+                // The slice type is unknown, so only the primary_pic_type
+                // allowing all slice types can be used.
+                primary_pic_type_mask &=
+                    1 << (FF_ARRAY_ELEMS(primary_pic_type_table) - 1);
+                continue;
+            }
             for (j = 0; j < FF_ARRAY_ELEMS(primary_pic_type_table); j++) {
                 if (!(primary_pic_type_table[j] &
                       (1 << slice->header.slice_type)))
@@ -553,9 +567,15 @@ static const CBSBSFType h264_metadata_type = {
     .update_fragment = &h264_metadata_update_fragment,
 };
 
+static const CodedBitstreamUnitType h264_metadata_lazy_unit_types[] = {
+    H264_NAL_SPS,
+    H264_NAL_PPS,
+};
+
 static int h264_metadata_init(AVBSFContext *bsf)
 {
     H264MetadataContext *ctx = bsf->priv_data;
+    int err;
 
     if (ctx->sei_user_data) {
         SEIRawUserDataUnregistered *udu = &ctx->sei_user_data_payload;
@@ -590,7 +610,22 @@ static int h264_metadata_init(AVBSFContext *bsf)
         }
     }
 
-    return ff_cbs_bsf_generic_init(bsf, &h264_metadata_type);
+    err = ff_cbs_bsf_generic_init(bsf, &h264_metadata_type);
+    if (err < 0)
+        return err;
+
+    // In lazy mode, unless SEI messages have to be edited, only parameter
+    // sets are decomposed; slices are decomposed on demand when inserting AUDs
+    // and otherwise passed through untouched.
+    if (ctx->lazy && !ctx->sei_user_data && !ctx->delete_filler &&
+        ctx->display_orientation == BSF_ELEMENT_PASS) {
+        ctx->common.input->decompose_unit_types    = h264_metadata_lazy_unit_types;
+        ctx->common.input->nb_decompose_unit_types =
+            FF_ARRAY_ELEMS(h264_metadata_lazy_unit_types);
+        ctx->common.input->lazy_decompose          = 1;
+    }
+
+    return 0;
 }
 
 #define OFFSET(x) offsetof(H264MetadataContext, x)
@@ -703,6 +738,9 @@ static const AVOption h264_metadata_options[] = {
     { LEVEL("6.2", 62) },
 #undef LEVEL
 
+    { "lazy", "Only decompose the NAL units needed by the other options",
+        OFFSET(lazy), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, FLAGS },
+
     { NULL }
 };
 
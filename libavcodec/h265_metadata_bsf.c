@@ -61,6 +61,8 @@ typedef struct H265MetadataContext {
     int level;
     int level_guess;
     int level_warned;
+
+    int lazy;
 } H265MetadataContext;
 
 
@@ -404,9 +406,31 @@ static const CBSBSFType h265_metadata_type = {
     .update_fragment = &h265_metadata_update_fragment,
 };
 
+static const CodedBitstreamUnitType h265_metadata_lazy_unit_types[] = {
+    HEVC_NAL_VPS,
+    HEVC_NAL_SPS,
+    HEVC_NAL_PPS,
+};
+
 static int h265_metadata_init(AVBSFContext *bsf)
 {
-    return ff_cbs_bsf_generic_init(bsf, &h265_metadata_type);
+    H265MetadataContext *ctx = bsf->priv_data;
+    int err;
+
+    err = ff_cbs_bsf_generic_init(bsf, &h265_metadata_type);
+    if (err < 0)
+        return err;
+
+    // AUD insertion needs the headers of all NAL units, otherwise only
+    // parameter sets are decomposed and everything else is passed through.
+    if (ctx->lazy && ctx->aud != BSF_ELEMENT_INSERT) {
+        ctx->common.input->decompose_unit_types    = h265_metadata_lazy_unit_types;
+        ctx->common.input->nb_decompose_unit_types =
+            FF_ARRAY_ELEMS(h265_metadata_lazy_unit_types);
+        ctx->common.input->lazy_decompose          = 1;
+    }
+
+    return 0;
 }
 
 #define OFFSET(x) offsetof(H265MetadataContext, x)
@@ -485,6 +509,9 @@ static const AVOption h265_metadata_options[] = {
     { LEVEL("8.5", 255) },
 #undef LEVEL
 
+    { "lazy", "Only decompose the NAL units needed by the other options",
+        OFFSET(lazy), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, FLAGS },
+
     { NULL }
 };
 
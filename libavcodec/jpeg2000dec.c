@@ -90,8 +90,18 @@ typedef struct Jpeg2000Tile {
     GetByteContext      packed_headers_stream;  // byte context corresponding to packed headers
     uint16_t tp_idx;                    // Tile-part index
     int coord[2][2];                    // border coordinates {{x0, x1}, {y0, y1}}
+    uint8_t             coded[4];       // whether a component has any coded code-block
 } Jpeg2000Tile;
 
+/* A code-block to be decoded by the code-block level slice threading. */
+typedef struct Jpeg2000CblkJob {
+    Jpeg2000Component   *comp;
+    Jpeg2000CodingStyle *codsty;
+    Jpeg2000Band        *band;
+    Jpeg2000Cblk        *cblk;
+    int                  bandpos;
+} Jpeg2000CblkJob;
+
 typedef struct Jpeg2000DecoderContext {
     AVClass         *class;
     AVCodecContext  *avctx;
@@ -134,6 +144,12 @@ typedef struct Jpeg2000DecoderContext {
     Jpeg2000Tile    *tile;
     Jpeg2000DSPContext dsp;
 
+    Jpeg2000CblkJob *cblk_jobs;
+    unsigned int    cblk_jobs_size;
+    int             nb_cblk_jobs;
+    Jpeg2000T1Context *t1;      // one tier-1 context per slice thread
+    int             nb_t1;
+
     /*options parameters*/
     int             reduction_factor;
 } Jpeg2000DecoderContext;
@@ -1857,11 +1873,16 @@ static void dequantization_float(int x, int y, Jpeg2000Cblk *cblk,
 {
     int i, j;
     int w = cblk->coord[0][1] - cblk->coord[0][0];
-    for (j = 0; j < (cblk->coord[1][1] - cblk->coord[1][0]); ++j) {
-        float *datap = &comp->f_data[(comp->coord[0][1] - comp->coord[0][0]) * (y + j) + x];
-        int *src = t1->data + j*t1->stride;
+    int h = cblk->coord[1][1] - cblk->coord[1][0];
+    ptrdiff_t stride  = comp->coord[0][1] - comp->coord[0][0];
+    const float step  = band->f_stepsize;
+    float *datap      = &comp->f_data[stride * y + x];
+    const int *src    = t1->data;
+    for (j = 0; j < h; ++j) {
         for (i = 0; i < w; ++i)
-            datap[i] = src[i] * band->f_stepsize;
+            datap[i] = src[i] * step;
+        datap += stride;
+        src   += t1->stride;
     }
 }
 
@@ -1872,17 +1893,22 @@ static void dequantization_int(int x, int y, Jpeg2000Cblk *cblk,
 {
     int i, j;
     int w = cblk->coord[0][1] - cblk->coord[0][0];
-    for (j = 0; j < (cblk->coord[1][1] - cblk->coord[1][0]); ++j) {
-        int32_t *datap = &comp->i_data[(comp->coord[0][1] - comp->coord[0][0]) * (y + j) + x];
-        int *src = t1->data + j*t1->stride;
-        if (band->i_stepsize == 32768) {
+    int h = cblk->coord[1][1] - cblk->coord[1][0];
+    ptrdiff_t stride  = comp->coord[0][1] - comp->coord[0][0];
+    const int step    = band->i_stepsize;
+    int32_t *datap    = &comp->i_data[stride * y + x];
+    const int *src    = t1->data;
+    for (j = 0; j < h; ++j) {
+        if (step == 32768) {
             for (i = 0; i < w; ++i)
                 datap[i] = src[i] / 2;
         } else {
             // This should be VERY uncommon
             for (i = 0; i < w; ++i)
-                datap[i] = (src[i] * (int64_t)band->i_stepsize) / 65536;
+                datap[i] = (src[i] * (int64_t)step) / 65536;
         }
+        datap += stride;
+        src   += t1->stride;
     }
 }
 
@@ -1892,11 +1918,16 @@ static void dequantization_int_97(int x, int y, Jpeg2000Cblk *cblk,
 {
     int i, j;
     int w = cblk->coord[0][1] - cblk->coord[0][0];
-    for (j = 0; j < (cblk->coord[1][1] - cblk->coord[1][0]); ++j) {
-        int32_t *datap = &comp->i_data[(comp->coord[0][1] - comp->coord[0][0]) * (y + j) + x];
-        int *src = t1->data + j*t1->stride;
+    int h = cblk->coord[1][1] - cblk->coord[1][0];
+    ptrdiff_t stride  = comp->coord[0][1] - comp->coord[0][0];
+    const int64_t step = band->i_stepsize;
+    int32_t *datap    = &comp->i_data[stride * y + x];
+    const int *src    = t1->data;
+    for (j = 0; j < h; ++j) {
         for (i = 0; i < w; ++i)
-            datap[i] = (src[i] * (int64_t)band->i_stepsize + (1<<15)) >> 16;
+            datap[i] = (src[i] * step + (1<<15)) >> 16;
+        datap += stride;
+        src   += t1->stride;
     }
 }
 
@@ -1941,6 +1972,36 @@ static inline void roi_scale_cblk(Jpeg2000Cblk *cblk,
     }
 }
 
+static int decode_cblk_dequant(const Jpeg2000DecoderContext *s,
+                               Jpeg2000T1Context *t1,
+                               Jpeg2000Component *comp,
+                               Jpeg2000CodingStyle *codsty,
+                               Jpeg2000Band *band, Jpeg2000Cblk *cblk,
+                               int bandpos)
+{
+    int x, y;
+    int ret = decode_cblk(s, codsty, t1, cblk,
+                          cblk->coord[0][1] - cblk->coord[0][0],
+                          cblk->coord[1][1] - cblk->coord[1][0],
+                          bandpos, comp->roi_shift);
+    if (!ret)
+        return 0;
+
+    x = cblk->coord[0][0] - band->coord[0][0];
+    y = cblk->coord[1][0] - band->coord[1][0];
+
+    if (comp->roi_shift)
+        roi_scale_cblk(cblk, comp, t1);
+    if (codsty->transform == FF_DWT97)
+        dequantization_float(x, y, cblk, comp, t1, band);
+    else if (codsty->transform == FF_DWT97_INT)
+        dequantization_int_97(x, y, cblk, comp, t1, band);
+    else
+        dequantization_int(x, y, cblk, comp, t1, band);
+
+    return 1;
+}
+
 static inline void tile_codeblocks(const Jpeg2000DecoderContext *s, Jpeg2000Tile *tile)
 {
     Jpeg2000T1Context t1;
@@ -1979,27 +2040,10 @@ static inline void tile_codeblocks(const Jpeg2000DecoderContext *s, Jpeg2000Tile
                     for (cblkno = 0;
                          cblkno < prec->nb_codeblocks_width * prec->nb_codeblocks_height;
                          cblkno++) {
-                        int x, y;
                         Jpeg2000Cblk *cblk = prec->cblk + cblkno;
-                        int ret = decode_cblk(s, codsty, &t1, cblk,
-                                    cblk->coord[0][1] - cblk->coord[0][0],
-                                    cblk->coord[1][1] - cblk->coord[1][0],
-                                    bandpos, comp->roi_shift);
-                        if (ret)
+                        if (decode_cblk_dequant(s, &t1, comp, codsty, band,
+                                                cblk, bandpos))
                             coded = 1;
-                        else
-                            continue;
-                        x = cblk->coord[0][0] - band->coord[0][0];
-                        y = cblk->coord[1][0] - band->coord[1][0];
-
-                        if (comp->roi_shift)
-                            roi_scale_cblk(cblk, comp, &t1);
-                        if (codsty->transform == FF_DWT97)
-                            dequantization_float(x, y, cblk, comp, &t1, band);
-                        else if (codsty->transform == FF_DWT97_INT)
-                            dequantization_int_97(x, y, cblk, comp, &t1, band);
-                        else
-                            dequantization_int(x, y, cblk, comp, &t1, band);
                    } /* end cblk */
                 } /*end prec */
             } /* end band */
@@ -2012,6 +2056,112 @@ static inline void tile_codeblocks(const Jpeg2000DecoderContext *s, Jpeg2000Tile
     } /*end comp */
 }
 
+/* Gather the code-blocks holding coded data of every tile, so that they can
+ * be decoded in parallel when there are fewer tiles than threads (e.g. the
+ * single tile of a DCI frame). Code-blocks without data are left out, they
+ * do not contribute to the reconstructed samples. */
+static int collect_cblk_jobs(Jpeg2000DecoderContext *s)
+{
+    int tileno, compno, reslevelno, bandno, precno, cblkno;
+    size_t nb_cblks = 0;
+
+    for (tileno = 0; tileno < s->numXtiles * s->numYtiles; tileno++) {
+        Jpeg2000Tile *tile = s->tile + tileno;
+        for (compno = 0; compno < s->ncomponents; compno++) {
+            Jpeg2000Component *comp     = tile->comp + compno;
+            Jpeg2000CodingStyle *codsty = tile->codsty + compno;
+            for (reslevelno = 0; reslevelno < codsty->nreslevels2decode; reslevelno++) {
+                Jpeg2000ResLevel *rlevel = comp->reslevel + reslevelno;
+                for (bandno = 0; bandno < rlevel->nbands; bandno++) {
+                    Jpeg2000Band *band = rlevel->band + bandno;
+                    for (precno = 0; precno < rlevel->num_precincts_x * rlevel->num_precincts_y; precno++)
+                        nb_cblks += band->prec[precno].nb_codeblocks_width *
+                                    band->prec[precno].nb_codeblocks_height;
+                }
+            }
+        }
+    }
+
+    if (nb_cblks > INT_MAX / sizeof(*s->cblk_jobs))
+        return AVERROR(ENOMEM);
+    av_fast_malloc(&s->cblk_jobs, &s->cblk_jobs_size,
+                   FFMAX(nb_cblks, 1) * sizeof(*s->cblk_jobs));
+    if (!s->cblk_jobs)
+        return AVERROR(ENOMEM);
+
+    s->nb_cblk_jobs = 0;
+    for (tileno = 0; tileno < s->numXtiles * s->numYtiles; tileno++) {
+        Jpeg2000Tile *tile = s->tile + tileno;
+        for (compno = 0; compno < s->ncomponents; compno++) {
+            Jpeg2000Component *comp     = tile->comp + compno;
+            Jpeg2000CodingStyle *codsty = tile->codsty + compno;
+
+            tile->coded[compno] = 0;
+            for (reslevelno = 0; reslevelno < codsty->nreslevels2decode; reslevelno++) {
+                Jpeg2000ResLevel *rlevel = comp->reslevel + reslevelno;
+                for (bandno = 0; bandno < rlevel->nbands; bandno++) {
+                    Jpeg2000Band *band = rlevel->band + bandno;
+
+                    if (band->coord[0][0] == band->coord[0][1] ||
+                        band->coord[1][0] == band->coord[1][1])
+                        continue;
+
+                    for (precno = 0; precno < rlevel->num_precincts_x * rlevel->num_precincts_y; precno++) {
+                        Jpeg2000Prec *prec = band->prec + precno;
+                        for (cblkno = 0;
+                             cblkno < prec->nb_codeblocks_width * prec->nb_codeblocks_height;
+                             cblkno++) {
+                            Jpeg2000CblkJob *job = &s->cblk_jobs[s->nb_cblk_jobs];
+
+                            if (!prec->cblk[cblkno].length)
+                                continue;
+
+                            job->comp    = comp;
+                            job->codsty  = codsty;
+                            job->band    = band;
+                            job->cblk    = prec->cblk + cblkno;
+                            job->bandpos = bandno + (reslevelno > 0);
+                            s->nb_cblk_jobs++;
+                            tile->coded[compno] = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int jpeg2000_decode_cblk_job(AVCodecContext *avctx, void *td,
+                                    int jobnr, int threadnr)
+{
+    const Jpeg2000DecoderContext *s = avctx->priv_data;
+    const Jpeg2000CblkJob *job = s->cblk_jobs + jobnr;
+    Jpeg2000T1Context *t1 = s->t1 + threadnr;
+
+    t1->stride = (1 << job->codsty->log2_cblk_width) + 2;
+    decode_cblk_dequant(s, t1, job->comp, job->codsty, job->band,
+                        job->cblk, job->bandpos);
+
+    return 0;
+}
+
+static int jpeg2000_dwt_job(AVCodecContext *avctx, void *td,
+                            int jobnr, int threadnr)
+{
+    const Jpeg2000DecoderContext *s = avctx->priv_data;
+    Jpeg2000Tile *tile = s->tile + jobnr / s->ncomponents;
+    int compno = jobnr % s->ncomponents;
+    Jpeg2000Component *comp     = tile->comp + compno;
+    Jpeg2000CodingStyle *codsty = tile->codsty + compno;
+
+    if (tile->coded[compno])
+        ff_dwt_decode(&comp->dwt, codsty->transform == FF_DWT97 ? (void*)comp->f_data : (void*)comp->i_data);
+
+    return 0;
+}
+
 #define WRITE_FRAME(D, PIXEL)                                                                     \
     static inline void write_frame_ ## D(const Jpeg2000DecoderContext * s, Jpeg2000Tile * tile,   \
                                          AVFrame * picture, int precision)                        \
@@ -2079,15 +2229,9 @@ WRITE_FRAME(16, uint16_t)
 
 #undef WRITE_FRAME
 
-static int jpeg2000_decode_tile(AVCodecContext *avctx, void *td,
-                                int jobnr, int threadnr)
+static void jpeg2000_output_tile(const Jpeg2000DecoderContext *s,
+                                 Jpeg2000Tile *tile, AVFrame *picture)
 {
-    const Jpeg2000DecoderContext *s = avctx->priv_data;
-    AVFrame *picture = td;
-    Jpeg2000Tile *tile = s->tile + jobnr;
-
-    tile_codeblocks(s, tile);
-
     /* inverse MCT transformation */
     if (tile->codsty[0].mct)
         mct_decode(s, tile);
@@ -2102,6 +2246,54 @@ static int jpeg2000_decode_tile(AVCodecContext *avctx, void *td,
 
         write_frame_16(s, tile, picture, precision);
     }
+}
+
+static int jpeg2000_decode_tile(AVCodecContext *avctx, void *td,
+                                int jobnr, int threadnr)
+{
+    const Jpeg2000DecoderContext *s = avctx->priv_data;
+    AVFrame *picture = td;
+    Jpeg2000Tile *tile = s->tile + jobnr;
+
+    tile_codeblocks(s, tile);
+    jpeg2000_output_tile(s, tile, picture);
+
+    return 0;
+}
+
+static int jpeg2000_output_tile_job(AVCodecContext *avctx, void *td,
+                                    int jobnr, int threadnr)
+{
+    const Jpeg2000DecoderContext *s = avctx->priv_data;
+
+    jpeg2000_output_tile(s, s->tile + jobnr, td);
+
+    return 0;
+}
+
+/* Decode all tiles with the code-blocks, and then the components, as the
+ * units of parallelism rather than the tiles. */
+static int jpeg2000_decode_cblks(AVCodecContext *avctx, AVFrame *picture)
+{
+    Jpeg2000DecoderContext *s = avctx->priv_data;
+    int nb_tiles = s->numXtiles * s->numYtiles;
+    int ret;
+
+    if (s->nb_t1 < avctx->thread_count) {
+        av_freep(&s->t1);
+        s->nb_t1 = 0;
+        s->t1 = av_malloc_array(avctx->thread_count, sizeof(*s->t1));
+        if (!s->t1)
+            return AVERROR(ENOMEM);
+        s->nb_t1 = avctx->thread_count;
+    }
+
+    if ((ret = collect_cblk_jobs(s)) < 0)
+        return ret;
+
+    avctx->execute2(avctx, jpeg2000_decode_cblk_job, NULL, NULL, s->nb_cblk_jobs);
+    avctx->execute2(avctx, jpeg2000_dwt_job, NULL, NULL, nb_tiles * s->ncomponents);
+    avctx->execute2(avctx, jpeg2000_output_tile_job, picture, NULL, nb_tiles);
 
     return 0;
 }
@@ -2548,7 +2740,12 @@ static int jpeg2000_decode_frame(AVCodecContext *avctx, AVFrame *picture,
         }
     }
 
-    avctx->execute2(avctx, jpeg2000_decode_tile, picture, NULL, s->numXtiles * s->numYtiles);
+    if (avctx->active_thread_type == FF_THREAD_SLICE &&
+        s->numXtiles * s->numYtiles < avctx->thread_count) {
+        if ((ret = jpeg2000_decode_cblks(avctx, picture)) < 0)
+            goto end;
+    } else
+        avctx->execute2(avctx, jpeg2000_decode_tile, picture, NULL, s->numXtiles * s->numYtiles);
 
     jpeg2000_dec_cleanup(s);
 
@@ -2564,6 +2761,18 @@ end:
     return ret;
 }
 
+static av_cold int jpeg2000_decode_close(AVCodecContext *avctx)
+{
+    Jpeg2000DecoderContext *s = avctx->priv_data;
+
+    av_freep(&s->cblk_jobs);
+    s->cblk_jobs_size = 0;
+    av_freep(&s->t1);
+    s->nb_t1 = 0;
+
+    return 0;
+}
+
 #define OFFSET(x) offsetof(Jpeg2000DecoderContext, x)
 #define VD AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_DECODING_PARAM
 
@@ -2589,6 +2798,7 @@ const FFCodec ff_jpeg2000_decoder = {
     .priv_data_size   = sizeof(Jpeg2000DecoderContext),
     .init             = jpeg2000_decode_init,
     FF_CODEC_DECODE_CB(jpeg2000_decode_frame),
+    .close            = jpeg2000_decode_close,
     .p.priv_class     = &jpeg2000_class,
     .p.max_lowres     = 5,
     .p.profiles       = NULL_IF_CONFIG_SMALL(ff_jpeg2000_profiles),
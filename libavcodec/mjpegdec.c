@@ -788,10 +788,11 @@ int ff_mjpeg_decode_sof(MJpegDecodeContext *s)
     return 0;
 }
 
-static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index)
+static inline int mjpeg_decode_dc(MJpegDecodeContext *s, GetBitContext *gb,
+                                  int dc_index)
 {
     int code;
-    code = get_vlc2(&s->gb, s->vlcs[0][dc_index].table, 9, 2);
+    code = get_vlc2(gb, s->vlcs[0][dc_index].table, 9, 2);
     if (code < 0 || code > 16) {
         av_log(s->avctx, AV_LOG_WARNING,
                "mjpeg_decode_dc: bad vlc: %d:%d (%p)\n",
@@ -800,47 +801,48 @@ static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index)
     }
 
     if (code)
-        return get_xbits(&s->gb, code);
+        return get_xbits(gb, code);
     else
         return 0;
 }
 
 /* decode block and dequantize */
-static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
+static int decode_block(MJpegDecodeContext *s, GetBitContext *gb, int *last_dc,
+                        int16_t *block, int component,
                         int dc_index, int ac_index, uint16_t *quant_matrix)
 {
     int code, i, j, level, val;
 
     /* DC coef */
-    val = mjpeg_decode_dc(s, dc_index);
+    val = mjpeg_decode_dc(s, gb, dc_index);
     if (val == 0xfffff) {
         av_log(s->avctx, AV_LOG_ERROR, "error dc\n");
         return AVERROR_INVALIDDATA;
     }
-    val = val * (unsigned)quant_matrix[0] + s->last_dc[component];
+    val = val * (unsigned)quant_matrix[0] + last_dc[component];
     val = av_clip_int16(val);
-    s->last_dc[component] = val;
+    last_dc[component] = val;
     block[0] = val;
     /* AC coefs */
     i = 0;
-    {OPEN_READER(re, &s->gb);
+    {OPEN_READER(re, gb);
     do {
-        UPDATE_CACHE(re, &s->gb);
-        GET_VLC(code, re, &s->gb, s->vlcs[1][ac_index].table, 9, 2);
+        UPDATE_CACHE(re, gb);
+        GET_VLC(code, re, gb, s->vlcs[1][ac_index].table, 9, 2);
 
         i += ((unsigned)code) >> 4;
             code &= 0xf;
         if (code) {
             if (code > MIN_CACHE_BITS - 16)
-                UPDATE_CACHE(re, &s->gb);
+                UPDATE_CACHE(re, gb);
 
             {
-                int cache = GET_CACHE(re, &s->gb);
+                int cache = GET_CACHE(re, gb);
                 int sign  = (~cache) >> 31;
                 level     = (NEG_USR32(sign ^ cache,code) ^ sign) - sign;
             }
 
-            LAST_SKIP_BITS(re, &s->gb, code);
+            LAST_SKIP_BITS(re, gb, code);
 
             if (i > 63) {
                 av_log(s->avctx, AV_LOG_ERROR, "error count: %d\n", i);
@@ -850,7 +852,7 @@ static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
             block[j] = level * quant_matrix[i];
         }
     } while (i < 63);
-    CLOSE_READER(re, &s->gb);}
+    CLOSE_READER(re, gb);}
 
     return 0;
 }
@@ -861,7 +863,7 @@ static int decode_dc_progressive(MJpegDecodeContext *s, int16_t *block,
 {
     unsigned val;
     s->bdsp.clear_block(block);
-    val = mjpeg_decode_dc(s, dc_index);
+    val = mjpeg_decode_dc(s, &s->gb, dc_index);
     if (val == 0xfffff) {
         av_log(s->avctx, AV_LOG_ERROR, "error dc\n");
         return AVERROR_INVALIDDATA;
@@ -1155,7 +1157,7 @@ static int ljpeg_decode_rgb_scan(MJpegDecodeContext *s, int nb_components, int p
                 topleft[i] = top[i];
                 top[i]     = buffer[mb_x][i];
 
-                dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                 if(dc == 0xFFFFF)
                     return -1;
 
@@ -1289,7 +1291,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
                     for(j=0; j<n; j++) {
                         int pred, dc;
 
-                        dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                        dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                         if(dc == 0xFFFFF)
                             return -1;
                         if (   h * mb_x + x >= s->width
@@ -1360,7 +1362,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
                     for (j = 0; j < n; j++) {
                         int pred;
 
-                        dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                        dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                         if(dc == 0xFFFFF)
                             return -1;
                         if (   h * mb_x + x >= s->width
@@ -1429,17 +1431,155 @@ static void shift_output(MJpegDecodeContext *s, uint8_t *ptr, int linesize)
     }
 }
 
+/* decode one MCU of a sequential or progressive DC scan */
+static av_always_inline int decode_mcu(MJpegDecodeContext *s, GetBitContext *gb,
+                                       int *last_dc, int16_t *block,
+                                       int nb_components, int Ah, int Al,
+                                       int mb_x, int mb_y, int copy_mb,
+                                       const AVFrame *reference,
+                                       int chroma_width, int chroma_height)
+{
+    int bytes_per_pixel = 1 + (s->bits > 8);
+    int i;
+
+    for (i = 0; i < nb_components; i++) {
+        uint8_t *ptr;
+        int n, h, v, x, y, c, j;
+        int block_offset;
+        int linesize;
+        n = s->nb_blocks[i];
+        c = s->comp_index[i];
+        h = s->h_scount[i];
+        v = s->v_scount[i];
+        x = 0;
+        y = 0;
+        linesize = s->linesize[c];
+        for (j = 0; j < n; j++) {
+            block_offset = (((linesize * (v * mb_y + y) * 8) +
+                             (h * mb_x + x) * 8 * bytes_per_pixel) >> s->avctx->lowres);
+
+            if (s->interlaced && s->bottom_field)
+                block_offset += linesize >> 1;
+            if (   8*(h * mb_x + x) < ((c == 1) || (c == 2) ? chroma_width  : s->width)
+                && 8*(v * mb_y + y) < ((c == 1) || (c == 2) ? chroma_height : s->height)) {
+                ptr = s->picture_ptr->data[c] + block_offset;
+            } else
+                ptr = NULL;
+            if (!s->progressive) {
+                if (copy_mb) {
+                    if (ptr)
+                        mjpeg_copy_block(s, ptr, reference->data[c] + block_offset,
+                                        linesize, s->avctx->lowres);
+
+                } else {
+                    s->bdsp.clear_block(block);
+                    if (decode_block(s, gb, last_dc, block, i,
+                                     s->dc_index[i], s->ac_index[i],
+                                     s->quant_matrixes[s->quant_sindex[i]]) < 0) {
+                        av_log(s->avctx, AV_LOG_ERROR,
+                               "error y=%d x=%d\n", mb_y, mb_x);
+                        return AVERROR_INVALIDDATA;
+                    }
+                    if (ptr) {
+                        s->idsp.idct_put(ptr, linesize, block);
+                        if (s->bits & 7)
+                            shift_output(s, ptr, linesize);
+                    }
+                }
+            } else {
+                int block_idx  = s->block_stride[c] * (v * mb_y + y) +
+                                 (h * mb_x + x);
+                int16_t *coefs = s->blocks[c][block_idx];
+                if (Ah)
+                    coefs[0] += get_bits1(&s->gb) *
+                                s->quant_matrixes[s->quant_sindex[i]][0] << Al;
+                else if (decode_dc_progressive(s, coefs, i, s->dc_index[i],
+                                               s->quant_matrixes[s->quant_sindex[i]],
+                                               Al) < 0) {
+                    av_log(s->avctx, AV_LOG_ERROR,
+                           "error y=%d x=%d\n", mb_y, mb_x);
+                    return AVERROR_INVALIDDATA;
+                }
+            }
+            ff_dlog(s->avctx, "mb: %d %d processed\n", mb_y, mb_x);
+            ff_dlog(s->avctx, "%d %d %d %d %d %d %d %d \n",
+                    mb_x, mb_y, x, y, c, s->bottom_field,
+                    (v * mb_y + y) * 8, (h * mb_x + x) * 8);
+            if (++x == h) {
+                x = 0;
+                y++;
+            }
+        }
+    }
+    return 0;
+}
+
+typedef struct MJpegScanThreadArg {
+    int nb_components;
+    int chroma_width, chroma_height;
+    int scan_start;       ///< offset of the first restart interval in the scan
+    int nb_intervals;
+    int nb_jobs;
+    int end_bits;         ///< bit offset of the end of the last interval in the scan
+} MJpegScanThreadArg;
+
+/**
+ * Decode a range of restart intervals of a sequential scan. Every interval
+ * starts byte-aligned after an RSTn marker with reset DC predictors, so the
+ * intervals do not depend on each other.
+ */
+static int decode_scan_intervals(AVCodecContext *avctx, void *arg,
+                                 int jobnr, int threadnr)
+{
+    MJpegDecodeContext *s  = avctx->priv_data;
+    MJpegScanThreadArg *ta = arg;
+    const uint8_t *buf     = s->gb.buffer;
+    const int nb_mcus      = s->mb_width * s->mb_height;
+    const int first        = ta->nb_intervals *  jobnr      / ta->nb_jobs;
+    const int last         = ta->nb_intervals * (jobnr + 1) / ta->nb_jobs;
+    LOCAL_ALIGNED_32(int16_t, block, [64]);
+    int last_dc[MAX_COMPONENTS];
+    GetBitContext gb;
+    int k, i, ret;
+
+    for (k = first; k < last; k++) {
+        int start = k ? s->rst_pos[k - 1] + 2 : ta->scan_start;
+        int end   = k < s->nb_rst_pos ? s->rst_pos[k]
+                                      : s->gb.size_in_bits >> 3;
+        int mcu, mcu_end = FFMIN((k + 1) * s->restart_interval, nb_mcus);
+
+        ret = init_get_bits8(&gb, buf + start, end - start);
+        if (ret < 0)
+            return ret;
+        for (i = 0; i < ta->nb_components; i++)
+            last_dc[i] = 4 << s->bits;
+
+        for (mcu = k * s->restart_interval; mcu < mcu_end; mcu++) {
+            if (get_bits_left(&gb) < 0) {
+                av_log(avctx, AV_LOG_ERROR, "overread %d\n",
+                       -get_bits_left(&gb));
+                return AVERROR_INVALIDDATA;
+            }
+            ret = decode_mcu(s, &gb, last_dc, block, ta->nb_components, 0, 0,
+                             mcu % s->mb_width, mcu / s->mb_width, 0, NULL,
+                             ta->chroma_width, ta->chroma_height);
+            if (ret < 0)
+                return ret;
+        }
+        if (k == ta->nb_intervals - 1)
+            ta->end_bits = start * 8 + get_bits_count(&gb);
+    }
+    return 0;
+}
+
 static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
                              int Al, const uint8_t *mb_bitmask,
                              int mb_bitmask_size,
                              const AVFrame *reference)
 {
     int i, mb_x, mb_y, chroma_h_shift, chroma_v_shift, chroma_width, chroma_height;
-    uint8_t *data[MAX_COMPONENTS];
-    const uint8_t *reference_data[MAX_COMPONENTS];
-    int linesize[MAX_COMPONENTS];
     GetBitContext mb_bitmask_gb = {0}; // initialize to silence gcc warning
-    int bytes_per_pixel = 1 + (s->bits > 8);
+    int ret;
 
     if (mb_bitmask) {
         if (mb_bitmask_size != (s->mb_width * s->mb_height + 7)>>3) {
@@ -1458,12 +1598,45 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
 
     for (i = 0; i < nb_components; i++) {
         int c   = s->comp_index[i];
-        data[c] = s->picture_ptr->data[c];
-        reference_data[c] = reference ? reference->data[c] : NULL;
-        linesize[c] = s->linesize[c];
         s->coefs_finished[c] |= 1;
     }
 
+    /* With every RSTn marker of the scan located while unescaping it, the
+     * restart intervals can be decoded in parallel. */
+    if (s->avctx->active_thread_type & FF_THREAD_SLICE &&
+        s->avctx->thread_count > 1 && !s->progressive && !mb_bitmask &&
+        s->restart_interval && s->nb_rst_pos > 0 &&
+        s->nb_rst_pos == (s->mb_width * s->mb_height - 1) / s->restart_interval &&
+        s->gb.buffer == s->buffer && !(get_bits_count(&s->gb) & 7)) {
+        MJpegScanThreadArg ta = {
+            .nb_components = nb_components,
+            .chroma_width  = chroma_width,
+            .chroma_height = chroma_height,
+            .scan_start    = get_bits_count(&s->gb) >> 3,
+            .nb_intervals  = s->nb_rst_pos + 1,
+        };
+        int *rets;
+
+        ta.nb_jobs = FFMIN(ta.nb_intervals, 4 * s->avctx->thread_count);
+        rets = av_malloc_array(ta.nb_jobs, sizeof(*rets));
+        if (!rets)
+            return AVERROR(ENOMEM);
+        s->avctx->execute2(s->avctx, decode_scan_intervals, &ta, rets, ta.nb_jobs);
+        ret = 0;
+        for (i = 0; i < ta.nb_jobs; i++)
+            if (rets[i] < 0) {
+                ret = rets[i];
+                break;
+            }
+        av_free(rets);
+        if (ret < 0)
+            return ret;
+        /* Leave the bit reader at the end of the scan, as the sequential
+         * path does, so the caller continues after the whole scan. */
+        skip_bits_long(&s->gb, ta.end_bits - get_bits_count(&s->gb));
+        return 0;
+    }
+
     for (mb_y = 0; mb_y < s->mb_height; mb_y++) {
         for (mb_x = 0; mb_x < s->mb_width; mb_x++) {
             const int copy_mb = mb_bitmask && !get_bits1(&mb_bitmask_gb);
@@ -1476,73 +1649,11 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
                        -get_bits_left(&s->gb));
                 return AVERROR_INVALIDDATA;
             }
-            for (i = 0; i < nb_components; i++) {
-                uint8_t *ptr;
-                int n, h, v, x, y, c, j;
-                int block_offset;
-                n = s->nb_blocks[i];
-                c = s->comp_index[i];
-                h = s->h_scount[i];
-                v = s->v_scount[i];
-                x = 0;
-                y = 0;
-                for (j = 0; j < n; j++) {
-                    block_offset = (((linesize[c] * (v * mb_y + y) * 8) +
-                                     (h * mb_x + x) * 8 * bytes_per_pixel) >> s->avctx->lowres);
-
-                    if (s->interlaced && s->bottom_field)
-                        block_offset += linesize[c] >> 1;
-                    if (   8*(h * mb_x + x) < ((c == 1) || (c == 2) ? chroma_width  : s->width)
-                        && 8*(v * mb_y + y) < ((c == 1) || (c == 2) ? chroma_height : s->height)) {
-                        ptr = data[c] + block_offset;
-                    } else
-                        ptr = NULL;
-                    if (!s->progressive) {
-                        if (copy_mb) {
-                            if (ptr)
-                                mjpeg_copy_block(s, ptr, reference_data[c] + block_offset,
-                                                linesize[c], s->avctx->lowres);
-
-                        } else {
-                            s->bdsp.clear_block(s->block);
-                            if (decode_block(s, s->block, i,
-                                             s->dc_index[i], s->ac_index[i],
-                                             s->quant_matrixes[s->quant_sindex[i]]) < 0) {
-                                av_log(s->avctx, AV_LOG_ERROR,
-                                       "error y=%d x=%d\n", mb_y, mb_x);
-                                return AVERROR_INVALIDDATA;
-                            }
-                            if (ptr) {
-                                s->idsp.idct_put(ptr, linesize[c], s->block);
-                                if (s->bits & 7)
-                                    shift_output(s, ptr, linesize[c]);
-                            }
-                        }
-                    } else {
-                        int block_idx  = s->block_stride[c] * (v * mb_y + y) +
-                                         (h * mb_x + x);
-                        int16_t *block = s->blocks[c][block_idx];
-                        if (Ah)
-                            block[0] += get_bits1(&s->gb) *
-                                        s->quant_matrixes[s->quant_sindex[i]][0] << Al;
-                        else if (decode_dc_progressive(s, block, i, s->dc_index[i],
-                                                       s->quant_matrixes[s->quant_sindex[i]],
-                                                       Al) < 0) {
-                            av_log(s->avctx, AV_LOG_ERROR,
-                                   "error y=%d x=%d\n", mb_y, mb_x);
-                            return AVERROR_INVALIDDATA;
-                        }
-                    }
-                    ff_dlog(s->avctx, "mb: %d %d processed\n", mb_y, mb_x);
-                    ff_dlog(s->avctx, "%d %d %d %d %d %d %d %d \n",
-                            mb_x, mb_y, x, y, c, s->bottom_field,
-                            (v * mb_y + y) * 8, (h * mb_x + x) * 8);
-                    if (++x == h) {
-                        x = 0;
-                        y++;
-                    }
-                }
-            }
+            ret = decode_mcu(s, &s->gb, s->last_dc, s->block, nb_components,
+                             Ah, Al, mb_x, mb_y, copy_mb, reference,
+                             chroma_width, chroma_height);
+            if (ret < 0)
+                return ret;
 
             handle_rstn(s, nb_components);
         }
@@ -2239,6 +2350,7 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
             }                                         \
         } while (0)
 
+        s->nb_rst_pos = 0;
         if (s->avctx->codec_id == AV_CODEC_ID_THP) {
             ptr = buf_end;
             copy_data_segment(0);
@@ -2267,6 +2379,17 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
                         copy_data_segment(1);
                         if (x)
                             break;
+                    } else if (s->nb_rst_pos >= 0 &&
+                               s->avctx->active_thread_type & FF_THREAD_SLICE) {
+                        /* remember where the marker ends up in the
+                         * unescaped buffer, for slice threading */
+                        int *tmp = av_fast_realloc(s->rst_pos, &s->rst_pos_size,
+                                                   (s->nb_rst_pos + 1) * sizeof(*s->rst_pos));
+                        if (tmp) {
+                            s->rst_pos = tmp;
+                            s->rst_pos[s->nb_rst_pos++] = (dst - s->buffer) + (ptr - 2 - src);
+                        } else
+                            s->nb_rst_pos = -1;
                     }
                 }
             }
@@ -2963,6 +3086,7 @@ av_cold int ff_mjpeg_decode_end(AVCodecContext *avctx)
     av_frame_free(&s->smv_frame);
 
     av_freep(&s->buffer);
+    av_freep(&s->rst_pos);
     av_freep(&s->stereo3d);
     av_freep(&s->ljpeg_buffer);
     s->ljpeg_buffer_size = 0;
@@ -3020,7 +3144,7 @@ const FFCodec ff_mjpeg_decoder = {
     .close          = ff_mjpeg_decode_end,
     FF_CODEC_RECEIVE_FRAME_CB(ff_mjpeg_receive_frame),
     .flush          = decode_flush,
-    .p.capabilities = AV_CODEC_CAP_DR1,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_SLICE_THREADS,
     .p.max_lowres   = 3,
     .p.priv_class   = &mjpegdec_class,
     .p.profiles     = NULL_IF_CONFIG_SMALL(ff_mjpeg_profiles),
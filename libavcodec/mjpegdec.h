@@ -125,6 +125,9 @@ typedef struct MJpegDecodeContext {
 
     int restart_interval;
     int restart_count;
+    int *rst_pos;             ///< offsets of the RSTn markers in the unescaped scan
+    unsigned int rst_pos_size;
+    int nb_rst_pos;           ///< number of RSTn markers found, -1 if unknown
 
     int buggy_avid;
     int cs_itu601;
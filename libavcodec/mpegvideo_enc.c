@@ -1305,32 +1305,136 @@ static int encode_frame(AVCodecContext *c, const AVFrame *frame, AVPacket *pkt)
     return size;
 }
 
-static int estimate_best_b_count(MpegEncContext *s)
+typedef struct BCountEstimate {
+    MpegEncContext *s;
+    int width, height;
+    int p_lambda, b_lambda, lambda2;
+    int64_t rd[MAX_B_FRAMES + 1];
+} BCountEstimate;
+
+/**
+ * Encode the downscaled lookahead frames using j B-frames between P-frames
+ * and compute the resulting rate-distortion score.
+ * Every candidate uses its own encoder and its own references to the
+ * shared downscaled frames, so they can be run concurrently.
+ */
+static int estimate_b_count_candidate(AVCodecContext *avctx, void *arg,
+                                      int j, int threadnr)
 {
+    BCountEstimate *const e = arg;
+    MpegEncContext *const s = e->s;
+    AVFrame *frames[MAX_B_FRAMES + 2] = { NULL };
+    AVCodecContext *c;
     AVPacket *pkt;
+    int i, out_size, ret = 0;
+    int64_t rd = 0;
+
+    c   = avcodec_alloc_context3(NULL);
+    pkt = av_packet_alloc();
+    if (!c || !pkt) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    for (i = 0; i < s->max_b_frames + 2; i++) {
+        frames[i] = av_frame_alloc();
+        if (!frames[i]) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        ret = av_frame_ref(frames[i], s->tmp_frames[i]);
+        if (ret < 0)
+            goto fail;
+    }
+
+    c->width        = e->width;
+    c->height       = e->height;
+    c->flags        = AV_CODEC_FLAG_QSCALE | AV_CODEC_FLAG_PSNR;
+    c->flags       |= s->avctx->flags & AV_CODEC_FLAG_QPEL;
+    c->mb_decision  = s->avctx->mb_decision;
+    c->me_cmp       = s->avctx->me_cmp;
+    c->mb_cmp       = s->avctx->mb_cmp;
+    c->me_sub_cmp   = s->avctx->me_sub_cmp;
+    c->pix_fmt      = AV_PIX_FMT_YUV420P;
+    c->time_base    = s->avctx->time_base;
+    c->max_b_frames = s->max_b_frames;
+
+    ret = avcodec_open2(c, s->avctx->codec, NULL);
+    if (ret < 0)
+        goto fail;
+
+    frames[0]->pict_type = AV_PICTURE_TYPE_I;
+    frames[0]->quality   = 1 * FF_QP2LAMBDA;
+
+    out_size = encode_frame(c, frames[0], pkt);
+    if (out_size < 0) {
+        ret = out_size;
+        goto fail;
+    }
+
+    //rd += (out_size * lambda2) >> FF_LAMBDA_SHIFT;
+
+    for (i = 0; i < s->max_b_frames + 1; i++) {
+        int is_p = i % (j + 1) == j || i == s->max_b_frames;
+
+        frames[i + 1]->pict_type = is_p ?
+                                   AV_PICTURE_TYPE_P : AV_PICTURE_TYPE_B;
+        frames[i + 1]->quality   = is_p ? e->p_lambda : e->b_lambda;
+
+        out_size = encode_frame(c, frames[i + 1], pkt);
+        if (out_size < 0) {
+            ret = out_size;
+            goto fail;
+        }
+
+        rd += (out_size * e->lambda2) >> (FF_LAMBDA_SHIFT - 3);
+    }
+
+    /* get the delayed frames */
+    out_size = encode_frame(c, NULL, pkt);
+    if (out_size < 0) {
+        ret = out_size;
+        goto fail;
+    }
+    rd += (out_size * e->lambda2) >> (FF_LAMBDA_SHIFT - 3);
+
+    rd += c->error[0] + c->error[1] + c->error[2];
+
+    e->rd[j] = rd;
+
+fail:
+    for (i = 0; i < FF_ARRAY_ELEMS(frames); i++)
+        av_frame_free(&frames[i]);
+    avcodec_free_context(&c);
+    av_packet_free(&pkt);
+
+    return ret;
+}
+
+static int estimate_best_b_count(MpegEncContext *s)
+{
+    BCountEstimate e = { .s = s };
+    int rets[MAX_B_FRAMES + 1];
     const int scale = s->brd_scale;
     int width  = s->width  >> scale;
     int height = s->height >> scale;
-    int i, j, out_size, p_lambda, b_lambda, lambda2;
+    int i, j, nb_candidates;
     int64_t best_rd  = INT64_MAX;
     int best_b_count = -1;
-    int ret = 0;
 
     av_assert0(scale >= 0 && scale <= 3);
 
-    pkt = av_packet_alloc();
-    if (!pkt)
-        return AVERROR(ENOMEM);
-
     //emms_c();
     //s->next_picture_ptr->quality;
-    p_lambda = s->last_lambda_for[AV_PICTURE_TYPE_P];
+    e.p_lambda = s->last_lambda_for[AV_PICTURE_TYPE_P];
     //p_lambda * FFABS(s->avctx->b_quant_factor) + s->avctx->b_quant_offset;
-    b_lambda = s->last_lambda_for[AV_PICTURE_TYPE_B];
-    if (!b_lambda) // FIXME we should do this somewhere else
-        b_lambda = p_lambda;
-    lambda2  = (b_lambda * b_lambda + (1 << FF_LAMBDA_SHIFT) / 2) >>
-               FF_LAMBDA_SHIFT;
+    e.b_lambda = s->last_lambda_for[AV_PICTURE_TYPE_B];
+    if (!e.b_lambda) // FIXME we should do this somewhere else
+        e.b_lambda = e.p_lambda;
+    e.lambda2  = (e.b_lambda * e.b_lambda + (1 << FF_LAMBDA_SHIFT) / 2) >>
+                 FF_LAMBDA_SHIFT;
+    e.width    = width;
+    e.height   = height;
 
     for (i = 0; i < s->max_b_frames + 2; i++) {
         const Picture *pre_input_ptr = i ? s->input_picture[i - 1] :
@@ -1364,89 +1468,25 @@ static int estimate_best_b_count(MpegEncContext *s)
         }
     }
 
-    for (j = 0; j < s->max_b_frames + 1; j++) {
-        AVCodecContext *c;
-        int64_t rd = 0;
-
-        if (!s->input_picture[j])
+    for (nb_candidates = 0; nb_candidates < s->max_b_frames + 1; nb_candidates++)
+        if (!s->input_picture[nb_candidates])
             break;
 
-        c = avcodec_alloc_context3(NULL);
-        if (!c) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-
-        c->width        = width;
-        c->height       = height;
-        c->flags        = AV_CODEC_FLAG_QSCALE | AV_CODEC_FLAG_PSNR;
-        c->flags       |= s->avctx->flags & AV_CODEC_FLAG_QPEL;
-        c->mb_decision  = s->avctx->mb_decision;
-        c->me_cmp       = s->avctx->me_cmp;
-        c->mb_cmp       = s->avctx->mb_cmp;
-        c->me_sub_cmp   = s->avctx->me_sub_cmp;
-        c->pix_fmt      = AV_PIX_FMT_YUV420P;
-        c->time_base    = s->avctx->time_base;
-        c->max_b_frames = s->max_b_frames;
-
-        ret = avcodec_open2(c, s->avctx->codec, NULL);
-        if (ret < 0)
-            goto fail;
-
-
-        s->tmp_frames[0]->pict_type = AV_PICTURE_TYPE_I;
-        s->tmp_frames[0]->quality   = 1 * FF_QP2LAMBDA;
-
-        out_size = encode_frame(c, s->tmp_frames[0], pkt);
-        if (out_size < 0) {
-            ret = out_size;
-            goto fail;
-        }
-
-        //rd += (out_size * lambda2) >> FF_LAMBDA_SHIFT;
-
-        for (i = 0; i < s->max_b_frames + 1; i++) {
-            int is_p = i % (j + 1) == j || i == s->max_b_frames;
-
-            s->tmp_frames[i + 1]->pict_type = is_p ?
-                                     AV_PICTURE_TYPE_P : AV_PICTURE_TYPE_B;
-            s->tmp_frames[i + 1]->quality   = is_p ? p_lambda : b_lambda;
-
-            out_size = encode_frame(c, s->tmp_frames[i + 1], pkt);
-            if (out_size < 0) {
-                ret = out_size;
-                goto fail;
-            }
-
-            rd += (out_size * lambda2) >> (FF_LAMBDA_SHIFT - 3);
-        }
-
-        /* get the delayed frames */
-        out_size = encode_frame(c, NULL, pkt);
-        if (out_size < 0) {
-            ret = out_size;
-            goto fail;
-        }
-        rd += (out_size * lambda2) >> (FF_LAMBDA_SHIFT - 3);
-
-        rd += c->error[0] + c->error[1] + c->error[2];
-
-        if (rd < best_rd) {
-            best_rd = rd;
+    /* The candidates are independent, try them in parallel when slice
+     * threading is available. */
+    if (nb_candidates)
+        s->avctx->execute2(s->avctx, estimate_b_count_candidate, &e, rets,
+                           nb_candidates);
+
+    for (j = 0; j < nb_candidates; j++) {
+        if (rets[j] < 0)
+            return rets[j];
+        if (e.rd[j] < best_rd) {
+            best_rd = e.rd[j];
             best_b_count = j;
         }
-
-fail:
-        avcodec_free_context(&c);
-        av_packet_unref(pkt);
-        if (ret < 0) {
-            best_b_count = ret;
-            break;
-        }
     }
 
-    av_packet_free(&pkt);
-
     return best_b_count;
 }
 
@@ -736,7 +736,8 @@ const FFCodec ff_opus_encoder = {
     .p.type         = AVMEDIA_TYPE_AUDIO,
     .p.id           = AV_CODEC_ID_OPUS,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
-                      AV_CODEC_CAP_SMALL_LAST_FRAME | AV_CODEC_CAP_EXPERIMENTAL,
+                      AV_CODEC_CAP_SMALL_LAST_FRAME | AV_CODEC_CAP_EXPERIMENTAL |
+                      AV_CODEC_CAP_SLICE_THREADS,
     .defaults       = opusenc_defaults,
     .p.priv_class   = &opusenc_class,
     .priv_data_size = sizeof(OpusEncContext),
@@ -366,6 +366,7 @@ static void celt_gauge_psy_weight(OpusPsyContext *s, OpusPsyStep **start,
 static int bands_dist(OpusPsyContext *s, CeltFrame *f, float *total_dist)
 {
     int i, tdist = 0.0f;
+    uint32_t seed = f->seed;
     OpusRangeCoder dump;
 
     ff_opus_rc_enc_init(&dump);
@@ -379,6 +380,11 @@ static int bands_dist(OpusPsyContext *s, CeltFrame *f, float *total_dist)
 
     *total_dist = tdist;
 
+    /* This was only a trial run, do not let the noise filling advance the
+     * seed, which keeps it in sync with the decoder. It also makes every
+     * trial independent of the ones before it. */
+    f->seed = seed;
+
     return 0;
 }
 
@@ -398,6 +404,24 @@ static void celt_search_for_dual_stereo(OpusPsyContext *s, CeltFrame *f)
     s->dual_stereo_used += td2 < td1;
 }
 
+static int intensity_search_job(AVCodecContext *avctx, void *arg,
+                                int jobnr, int threadnr)
+{
+    OpusPsyContext *s = arg;
+    CeltFrame *f = &s->search_frames[jobnr];
+    struct CeltPVQ *pvq = f->pvq;
+
+    *f     = *s->search_src;
+    f->pvq = pvq;
+
+    for (int i = f->end_band - jobnr; i >= 0; i -= s->nb_search_frames) {
+        f->intensity_stereo = i;
+        bands_dist(s, f, &s->search_dist[i]);
+    }
+
+    return 0;
+}
+
 static void celt_search_for_intensity(OpusPsyContext *s, CeltFrame *f)
 {
     int i, best_band = CELT_MAX_BANDS - 1;
@@ -408,9 +432,19 @@ static void celt_search_for_intensity(OpusPsyContext *s, CeltFrame *f)
     if (s->avctx->ch_layout.nb_channels < 2)
         return;
 
+    if (s->nb_search_frames) {
+        s->search_src = f;
+        s->avctx->execute2(s->avctx, intensity_search_job, s, NULL,
+                           FFMIN(s->nb_search_frames, f->end_band + 1));
+    }
+
     for (i = f->end_band; i >= end_band; i--) {
-        f->intensity_stereo = i;
-        bands_dist(s, f, &dist);
+        if (s->nb_search_frames) {
+            dist = s->search_dist[i];
+        } else {
+            f->intensity_stereo = i;
+            bands_dist(s, f, &dist);
+        }
         if (best_dist > dist) {
             best_dist = dist;
             best_band = i;
@@ -569,12 +603,37 @@ av_cold int ff_opus_psy_init(OpusPsyContext *s, AVCodecContext *avctx,
             goto fail;
     }
 
+    /* The intensity stereo search runs one trial quantization of all bands
+     * for each candidate band, those are independent and can be threaded. */
+    if (avctx->active_thread_type & FF_THREAD_SLICE &&
+        avctx->ch_layout.nb_channels == 2 && avctx->thread_count > 1) {
+        int nb_frames = FFMIN(avctx->thread_count, CELT_MAX_BANDS);
+
+        s->search_frames = av_calloc(nb_frames, sizeof(*s->search_frames));
+        if (!s->search_frames) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        s->nb_search_frames = nb_frames;
+
+        for (i = 0; i < nb_frames; i++) {
+            ret = ff_celt_pvq_init(&s->search_frames[i].pvq, 1);
+            if (ret < 0)
+                goto fail;
+        }
+    }
+
     return 0;
 
 fail:
     av_freep(&s->inflection_points);
     av_freep(&s->dsp);
 
+    for (i = 0; i < s->nb_search_frames; i++)
+        ff_celt_pvq_uninit(&s->search_frames[i].pvq);
+    av_freep(&s->search_frames);
+    s->nb_search_frames = 0;
+
     for (i = 0; i < CELT_BLOCK_NB; i++) {
         av_tx_uninit(&s->mdct[i]);
         av_freep(&s->window[i]);
@@ -606,6 +665,11 @@ av_cold int ff_opus_psy_end(OpusPsyContext *s)
     for (i = 0; i < s->max_steps; i++)
         av_freep(&s->steps[i]);
 
+    for (i = 0; i < s->nb_search_frames; i++)
+        ff_celt_pvq_uninit(&s->search_frames[i].pvq);
+    av_freep(&s->search_frames);
+    s->nb_search_frames = 0;
+
     av_log(s->avctx, AV_LOG_INFO, "Average Intensity Stereo band: %0.1f\n", s->avg_is_band);
     av_log(s->avctx, AV_LOG_INFO, "Dual Stereo used: %0.2f%%\n", ((float)s->dual_stereo_used/s->total_packets_out)*100.0f);
 
@@ -69,6 +69,12 @@ typedef struct OpusPsyContext {
 
     DECLARE_ALIGNED(32, float, scratch)[2048];
 
+    /* Slice threaded intensity stereo search */
+    CeltFrame *search_frames;
+    int nb_search_frames;
+    CeltFrame *search_src;
+    float search_dist[CELT_MAX_BANDS];
+
     /* Stats */
     float avg_is_band;
     int64_t dual_stereo_used;
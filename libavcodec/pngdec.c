@@ -223,48 +223,11 @@ void ff_add_png_paeth_prediction(uint8_t *dst, uint8_t *src, uint8_t *top,
     }
 }
 
-#define UNROLL1(bpp, op)                                                      \
-    {                                                                         \
-        r = dst[0];                                                           \
-        if (bpp >= 2)                                                         \
-            g = dst[1];                                                       \
-        if (bpp >= 3)                                                         \
-            b = dst[2];                                                       \
-        if (bpp >= 4)                                                         \
-            a = dst[3];                                                       \
-        for (; i <= size - bpp; i += bpp) {                                   \
-            dst[i + 0] = r = op(r, src[i + 0], last[i + 0]);                  \
-            if (bpp == 1)                                                     \
-                continue;                                                     \
-            dst[i + 1] = g = op(g, src[i + 1], last[i + 1]);                  \
-            if (bpp == 2)                                                     \
-                continue;                                                     \
-            dst[i + 2] = b = op(b, src[i + 2], last[i + 2]);                  \
-            if (bpp == 3)                                                     \
-                continue;                                                     \
-            dst[i + 3] = a = op(a, src[i + 3], last[i + 3]);                  \
-        }                                                                     \
-    }
-
-#define UNROLL_FILTER(op)                                                     \
-    if (bpp == 1) {                                                           \
-        UNROLL1(1, op)                                                        \
-    } else if (bpp == 2) {                                                    \
-        UNROLL1(2, op)                                                        \
-    } else if (bpp == 3) {                                                    \
-        UNROLL1(3, op)                                                        \
-    } else if (bpp == 4) {                                                    \
-        UNROLL1(4, op)                                                        \
-    }                                                                         \
-    for (; i < size; i++) {                                                   \
-        dst[i] = op(dst[i - bpp], src[i], last[i]);                           \
-    }
-
-/* NOTE: 'dst' can be equal to 'last' */
+/* NOTE: 'dst' and 'last' must not overlap */
 void ff_png_filter_row(PNGDSPContext *dsp, uint8_t *dst, int filter_type,
                        uint8_t *src, uint8_t *last, int size, int bpp)
 {
-    int i, p, r, g, b, a;
+    int i, p;
 
     switch (filter_type) {
     case PNG_FILTER_VALUE_NONE:
@@ -273,17 +236,7 @@ void ff_png_filter_row(PNGDSPContext *dsp, uint8_t *dst, int filter_type,
     case PNG_FILTER_VALUE_SUB:
         for (i = 0; i < bpp; i++)
             dst[i] = src[i];
-        if (bpp == 4) {
-            p = *(int *)dst;
-            for (; i < size; i += bpp) {
-                unsigned s = *(int *)(src + i);
-                p = ((s & 0x7f7f7f7f) + (p & 0x7f7f7f7f)) ^ ((s ^ p) & 0x80808080);
-                *(int *)(dst + i) = p;
-            }
-        } else {
-#define OP_SUB(x, s, l) ((x) + (s))
-            UNROLL_FILTER(OP_SUB);
-        }
+        dsp->add_sub_prediction(dst + i, src + i, size - i, bpp);
         break;
     case PNG_FILTER_VALUE_UP:
         dsp->add_bytes_l2(dst, src, last, size);
@@ -293,8 +246,7 @@ void ff_png_filter_row(PNGDSPContext *dsp, uint8_t *dst, int filter_type,
             p      = (last[i] >> 1);
             dst[i] = p + src[i];
         }
-#define OP_AVG(x, s, l) (((((x) + (l)) >> 1) + (s)) & 0xff)
-        UNROLL_FILTER(OP_AVG);
+        dsp->add_avg_prediction(dst + i, src + i, last + i, size - i, bpp);
         break;
     case PNG_FILTER_VALUE_PAETH:
         for (i = 0; i < bpp; i++) {
@@ -21,6 +21,7 @@
 
 #include "config.h"
 #include "libavutil/attributes.h"
+#include "libavutil/intreadwrite.h"
 #include "png.h"
 #include "pngdsp.h"
 
@@ -40,10 +41,76 @@ static void add_bytes_l2_c(uint8_t *dst, uint8_t *src1, uint8_t *src2, int w)
         dst[i] = src1[i] + src2[i];
 }
 
+#define UNROLL1(bpp, op)                                                      \
+    {                                                                         \
+        r = dst[-bpp];                                                        \
+        if (bpp >= 2)                                                         \
+            g = dst[1 - bpp];                                                 \
+        if (bpp >= 3)                                                         \
+            b = dst[2 - bpp];                                                 \
+        if (bpp >= 4)                                                         \
+            a = dst[3 - bpp];                                                 \
+        for (; i <= w - bpp; i += bpp) {                                      \
+            dst[i + 0] = r = op(r, src[i + 0], top[i + 0]);                   \
+            if (bpp == 1)                                                     \
+                continue;                                                     \
+            dst[i + 1] = g = op(g, src[i + 1], top[i + 1]);                   \
+            if (bpp == 2)                                                     \
+                continue;                                                     \
+            dst[i + 2] = b = op(b, src[i + 2], top[i + 2]);                   \
+            if (bpp == 3)                                                     \
+                continue;                                                     \
+            dst[i + 3] = a = op(a, src[i + 3], top[i + 3]);                   \
+        }                                                                     \
+    }
+
+#define UNROLL_FILTER(op)                                                     \
+    if (bpp == 1) {                                                           \
+        UNROLL1(1, op)                                                        \
+    } else if (bpp == 2) {                                                    \
+        UNROLL1(2, op)                                                        \
+    } else if (bpp == 3) {                                                    \
+        UNROLL1(3, op)                                                        \
+    } else if (bpp == 4) {                                                    \
+        UNROLL1(4, op)                                                        \
+    }                                                                         \
+    for (; i < w; i++) {                                                      \
+        dst[i] = op(dst[i - bpp], src[i], top[i]);                            \
+    }
+
+static void add_sub_prediction_c(uint8_t *dst, const uint8_t *src,
+                                 int w, int bpp)
+{
+    int i = 0, r, g, b, a;
+
+    if (bpp == 4) {
+        unsigned p = AV_RN32(dst - 4);
+        for (; i < w; i += 4) {
+            unsigned s = AV_RN32(src + i);
+            p = ((s & 0x7f7f7f7f) + (p & 0x7f7f7f7f)) ^ ((s ^ p) & 0x80808080);
+            AV_WN32(dst + i, p);
+        }
+    } else {
+#define OP_SUB(x, s, l) ((x) + (s))
+        UNROLL_FILTER(OP_SUB);
+    }
+}
+
+static void add_avg_prediction_c(uint8_t *dst, const uint8_t *src,
+                                 const uint8_t *top, int w, int bpp)
+{
+    int i = 0, r, g, b, a;
+
+#define OP_AVG(x, s, l) (((((x) + (l)) >> 1) + (s)) & 0xff)
+    UNROLL_FILTER(OP_AVG);
+}
+
 av_cold void ff_pngdsp_init(PNGDSPContext *dsp)
 {
     dsp->add_bytes_l2         = add_bytes_l2_c;
     dsp->add_paeth_prediction = ff_add_png_paeth_prediction;
+    dsp->add_sub_prediction   = add_sub_prediction_c;
+    dsp->add_avg_prediction   = add_avg_prediction_c;
 
 #if ARCH_X86
     ff_pngdsp_init_x86(dsp);
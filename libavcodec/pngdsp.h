@@ -32,6 +32,15 @@ typedef struct PNGDSPContext {
     /* this might write to dst[w] */
     void (*add_paeth_prediction)(uint8_t *dst, uint8_t *src,
                                  uint8_t *top, int w, int bpp);
+
+    /* dst[i] = src[i] + dst[i - bpp] for 0 <= i < w */
+    void (*add_sub_prediction)(uint8_t *dst, const uint8_t *src,
+                               int w, int bpp);
+
+    /* dst[i] = src[i] + ((dst[i - bpp] + top[i]) >> 1) for 0 <= i < w,
+     * dst and top must not overlap */
+    void (*add_avg_prediction)(uint8_t *dst, const uint8_t *src,
+                               const uint8_t *top, int w, int bpp);
 } PNGDSPContext;
 
 void ff_pngdsp_init(PNGDSPContext *dsp);
@@ -47,6 +47,25 @@ typedef struct APNGFctlChunk {
     uint8_t dispose_op, blend_op;
 } APNGFctlChunk;
 
+/**
+ * State of one independently deflated group of rows when encoding
+ * non-interlaced PNG images with slice threading. Each slice is a raw
+ * deflate stream ending on a byte boundary (sync flush), so the slices
+ * can simply be concatenated into one zlib stream.
+ */
+typedef struct PNGEncSlice {
+    FFZStream zstream;
+    uint8_t *crow_base;
+    unsigned int crow_base_size;
+    uint8_t *dict;
+    unsigned int dict_size;
+    uint8_t *buf;               ///< compressed output of this slice
+    unsigned int buf_size;
+    int buf_len;
+    uLong adler;                ///< Adler-32 of the uncompressed slice data
+    uLong in_len;
+} PNGEncSlice;
+
 typedef struct PNGEncContext {
     AVClass *class;
     LLVidEncDSPContext llvidencdsp;
@@ -59,6 +78,10 @@ typedef struct PNGEncContext {
 
     FFZStream zstream;
     uint8_t buf[IOBUF_SIZE];
+    int compression_level;
+    PNGEncSlice *slices;
+    int *slice_ret;              ///< return codes of the slice jobs
+    int nb_slices;
     int dpi;                     ///< Physical pixel density, in dots per inch, if set
     int dpm;                     ///< Physical pixel density, in dots per meter, if set
 
@@ -193,6 +216,27 @@ static void png_filter_row(PNGEncContext *c, uint8_t *dst, int filter_type,
     }
 }
 
+/**
+ * Sum of absolute values of the filtered bytes, as used by the mixed
+ * filter heuristic. Stops early once the sum reaches limit, in which case
+ * the returned value is only guaranteed to be >= limit.
+ */
+static int png_filter_cost(const uint8_t *buf, int size, int limit)
+{
+    int cost = 0;
+
+    while (size > 0) {
+        int n = FFMIN(size, 256);
+        for (int i = 0; i < n; i++)
+            cost += abs((int8_t)buf[i]);
+        if (cost >= limit)
+            break;
+        buf  += n;
+        size -= n;
+    }
+    return cost;
+}
+
 static uint8_t *png_choose_filter(PNGEncContext *s, uint8_t *dst,
                                   const uint8_t *src, const uint8_t *top, int size, int bpp)
 {
@@ -201,20 +245,29 @@ static uint8_t *png_choose_filter(PNGEncContext *s, uint8_t *dst,
     if (!top && pred)
         pred = PNG_FILTER_VALUE_SUB;
     if (pred == PNG_FILTER_VALUE_MIXED) {
-        int i;
-        int cost, bcost = INT_MAX;
-        uint8_t *buf1 = dst, *buf2 = dst + size + 16;
-        for (pred = 0; pred < 5; pred++) {
+        int cost, bcost;
+        uint8_t *buf1 = dst, *buf2 = NULL;
+
+        /* The unfiltered row (whose filter type byte is 0) needs no copy
+         * to be evaluated; it is only written out if no other filter
+         * does better. */
+        bcost = png_filter_cost(src, size, INT_MAX);
+        for (pred = PNG_FILTER_VALUE_SUB; pred < 5; pred++) {
             png_filter_row(s, buf1 + 1, pred, src, top, size, bpp);
             buf1[0] = pred;
-            cost = 0;
-            for (i = 0; i <= size; i++)
-                cost += abs((int8_t) buf1[i]);
+            cost = png_filter_cost(buf1, size + 1, bcost);
             if (cost < bcost) {
                 bcost = cost;
+                if (!buf2)
+                    buf2 = dst + size + 16;
                 FFSWAP(uint8_t *, buf1, buf2);
             }
         }
+        if (!buf2) {
+            memcpy(dst + 1, src, size);
+            dst[0] = PNG_FILTER_VALUE_NONE;
+            return dst;
+        }
         return buf2;
     } else {
         png_filter_row(s, dst + 1, pred, src, top, size, bpp);
@@ -573,6 +626,132 @@ the_end:
     return ret;
 }
 
+static int encode_slice(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    PNGEncContext *s       = avctx->priv_data;
+    PNGEncSlice *sl        = &s->slices[jobnr];
+    z_stream *const zstream = &sl->zstream.zstream;
+    const AVFrame *const p = arg;
+    const int bpp          = s->bits_per_pixel >> 3;
+    const int row_size     = (p->width * s->bits_per_pixel + 7) >> 3;
+    const int y_start      = p->height *  jobnr      / s->nb_slices;
+    const int y_end        = p->height * (jobnr + 1) / s->nb_slices;
+    const int last         = jobnr == s->nb_slices - 1;
+    const uint8_t *top     = NULL;
+    uint8_t *crow_buf, *crow;
+    uLong bound;
+    int y, ret;
+
+    sl->buf_len = 0;
+    av_fast_malloc(&sl->crow_base, &sl->crow_base_size,
+                   (row_size + 32) << (s->filter_type == PNG_FILTER_VALUE_MIXED));
+    if (!sl->crow_base)
+        return AVERROR(ENOMEM);
+    // pixel data should be aligned, but there's a control byte before it
+    crow_buf = sl->crow_base + 15;
+
+    sl->in_len = (uLong)(y_end - y_start) * (row_size + 1);
+    bound = deflateBound(zstream, sl->in_len) + 16;
+    if (bound > INT_MAX - 6)
+        return AVERROR(EINVAL);
+    av_fast_malloc(&sl->buf, &sl->buf_size, bound + 6);
+    if (!sl->buf)
+        return AVERROR(ENOMEM);
+
+    /* Prime the window with the filtered rows preceding this slice, which
+     * a decoder has already seen when it reaches this slice; this keeps
+     * most of the compression of a single stream across slice borders. */
+    if (y_start > 0) {
+        int nb_rows = FFMIN(y_start, (32768 + row_size) / (row_size + 1));
+        int dict_len = nb_rows * (row_size + 1);
+        int win_len  = FFMIN(dict_len, 32768);
+        uint8_t *dict;
+
+        av_fast_malloc(&sl->dict, &sl->dict_size, dict_len);
+        if (!sl->dict)
+            return AVERROR(ENOMEM);
+        dict = sl->dict;
+        for (y = y_start - nb_rows; y < y_start; y++) {
+            const uint8_t *ptr = p->data[0] + y * p->linesize[0];
+            top  = y ? ptr - p->linesize[0] : NULL;
+            crow = png_choose_filter(s, crow_buf, ptr, top,
+                                     row_size, bpp);
+            memcpy(dict, crow, row_size + 1);
+            dict += row_size + 1;
+        }
+        top = p->data[0] + (y_start - 1) * p->linesize[0];
+        deflateSetDictionary(zstream, dict - win_len, win_len);
+    }
+
+    /* Leave room for the zlib header and the Adler-32 trailer. */
+    zstream->next_out  = sl->buf + (jobnr ? 0 : 2);
+    zstream->avail_out = bound;
+    sl->adler          = adler32(0, NULL, 0);
+
+    for (y = y_start; y < y_end; y++) {
+        const uint8_t *ptr = p->data[0] + y * p->linesize[0];
+        crow = png_choose_filter(s, crow_buf, ptr, top,
+                                 row_size, bpp);
+        sl->adler = adler32(sl->adler, crow, row_size + 1);
+        zstream->next_in  = crow;
+        zstream->avail_in = row_size + 1;
+        ret = deflate(zstream, Z_NO_FLUSH);
+        if (ret != Z_OK || zstream->avail_in)
+            goto fail;
+        top = ptr;
+    }
+
+    /* All but the last slice end with a sync flush, i.e. on a byte
+     * boundary without the final block bit set. */
+    ret = deflate(zstream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    if (ret != (last ? Z_STREAM_END : Z_OK) || (!last && !zstream->avail_out))
+        goto fail;
+
+    sl->buf_len = zstream->next_out - sl->buf;
+    deflateReset(zstream);
+    return 0;
+fail:
+    deflateReset(zstream);
+    return AVERROR_EXTERNAL;
+}
+
+static int encode_frame_slices(AVCodecContext *avctx, const AVFrame *pict)
+{
+    PNGEncContext *s = avctx->priv_data;
+    PNGEncSlice *sl;
+    uLong adler;
+    int level, header, i;
+
+    avctx->execute2(avctx, encode_slice, (void *)pict, s->slice_ret, s->nb_slices);
+
+    for (i = 0; i < s->nb_slices; i++)
+        if (s->slice_ret[i] < 0)
+            return s->slice_ret[i];
+
+    /* zlib header, using the same FLEVEL zlib would write */
+    level  = s->compression_level == Z_DEFAULT_COMPRESSION ? 6 : s->compression_level;
+    header = (Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8;
+    header |= (level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6;
+    header += 31 - header % 31;
+    AV_WB16(s->slices[0].buf, header);
+
+    adler = s->slices[0].adler;
+    for (i = 1; i < s->nb_slices; i++)
+        adler = adler32_combine(adler, s->slices[i].adler, s->slices[i].in_len);
+    sl = &s->slices[s->nb_slices - 1];
+    AV_WB32(sl->buf + sl->buf_len, adler);
+    sl->buf_len += 4;
+
+    for (i = 0; i < s->nb_slices; i++) {
+        sl = &s->slices[i];
+        if (s->bytestream_end - s->bytestream < sl->buf_len + 12 + 100)
+            return AVERROR(ENOMEM);
+        png_write_image_data(avctx, sl->buf, sl->buf_len);
+    }
+
+    return 0;
+}
+
 static int add_icc_profile_size(AVCodecContext *avctx, const AVFrame *pict,
                                 uint64_t *max_packet_size)
 {
@@ -617,6 +796,8 @@ static int encode_png(AVCodecContext *avctx, AVPacket *pkt,
             enc_row_size +
             12 * (((int64_t)enc_row_size + IOBUF_SIZE - 1) / IOBUF_SIZE) // IDAT * ceil(enc_row_size / IOBUF_SIZE)
         );
+    // zlib header and trailer, IDAT and sync flush per slice
+    max_packet_size += s->nb_slices * 64;
     if ((ret = add_icc_profile_size(avctx, pict, &max_packet_size)))
         return ret;
     ret = ff_alloc_packet(avctx, pkt, max_packet_size);
@@ -634,7 +815,10 @@ static int encode_png(AVCodecContext *avctx, AVPacket *pkt,
     if (ret < 0)
         return ret;
 
-    ret = encode_frame(avctx, pict);
+    if (s->nb_slices > 1)
+        ret = encode_frame_slices(avctx, pict);
+    else
+        ret = encode_frame(avctx, pict);
     if (ret < 0)
         return ret;
 
@@ -1072,7 +1256,7 @@ static int encode_apng(AVCodecContext *avctx, AVPacket *pkt,
 static av_cold int png_enc_init(AVCodecContext *avctx)
 {
     PNGEncContext *s = avctx->priv_data;
-    int compression_level;
+    int compression_level, ret;
 
     switch (avctx->pix_fmt) {
     case AV_PIX_FMT_RGBA:
@@ -1153,7 +1337,34 @@ static av_cold int png_enc_init(AVCodecContext *avctx)
     compression_level = avctx->compression_level == FF_COMPRESSION_DEFAULT
                       ? Z_DEFAULT_COMPRESSION
                       : av_clip(avctx->compression_level, 0, 9);
-    return ff_deflate_init(&s->zstream, compression_level, avctx);
+    s->compression_level = compression_level;
+    ret = ff_deflate_init(&s->zstream, compression_level, avctx);
+    if (ret < 0)
+        return ret;
+
+    /* Non-interlaced images can be split into groups of rows that are
+     * deflated independently; with slice threading each thread gets at
+     * least 16 rows unless a number of slices is explicitly requested. */
+    if (avctx->codec_id == AV_CODEC_ID_PNG && !s->is_progressive) {
+        if (avctx->slices > 0)
+            s->nb_slices = FFMIN(avctx->slices, avctx->height);
+        else if (avctx->active_thread_type & FF_THREAD_SLICE)
+            s->nb_slices = FFMIN(avctx->thread_count, avctx->height / 16);
+    }
+    if (s->nb_slices > 1) {
+        s->slices    = av_calloc(s->nb_slices, sizeof(*s->slices));
+        s->slice_ret = av_calloc(s->nb_slices, sizeof(*s->slice_ret));
+        if (!s->slices || !s->slice_ret)
+            return AVERROR(ENOMEM);
+        for (int i = 0; i < s->nb_slices; i++) {
+            ret = ff_deflate_init2(&s->slices[i].zstream, compression_level,
+                                   -MAX_WBITS, avctx);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    return 0;
 }
 
 static av_cold int png_enc_close(AVCodecContext *avctx)
@@ -1161,6 +1372,15 @@ static av_cold int png_enc_close(AVCodecContext *avctx)
     PNGEncContext *s = avctx->priv_data;
 
     ff_deflate_end(&s->zstream);
+    for (int i = 0; s->slices && i < s->nb_slices; i++) {
+        PNGEncSlice *sl = &s->slices[i];
+        ff_deflate_end(&sl->zstream);
+        av_freep(&sl->crow_base);
+        av_freep(&sl->dict);
+        av_freep(&sl->buf);
+    }
+    av_freep(&s->slices);
+    av_freep(&s->slice_ret);
     av_frame_free(&s->last_frame);
     av_frame_free(&s->prev_frame);
     av_freep(&s->last_frame_packet);
@@ -1196,7 +1416,8 @@ const FFCodec ff_png_encoder = {
     CODEC_LONG_NAME("PNG (Portable Network Graphics) image"),
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_PNG,
-    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_FRAME_THREADS,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_FRAME_THREADS |
+                      AV_CODEC_CAP_SLICE_THREADS,
     .priv_data_size = sizeof(PNGEncContext),
     .init           = png_enc_init,
     .close          = png_enc_close,
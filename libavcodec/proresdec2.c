@@ -59,7 +59,7 @@ static void permute(uint8_t *dst, const uint8_t *src, const uint8_t permutation[
 static void inline unpack_alpha(GetBitContext *gb, uint16_t *dst, int num_coeffs,
                                 const int num_bits, const int decode_precision) {
     const int mask = (1 << num_bits) - 1;
-    int i, idx, val, alpha_val;
+    int i, idx, val, alpha_val, out;
 
     idx       = 0;
     alpha_val = mask;
@@ -78,17 +78,18 @@ static void inline unpack_alpha(GetBitContext *gb, uint16_t *dst, int num_coeffs
             alpha_val = (alpha_val + val) & mask;
             if (num_bits == 16) {
                 if (decode_precision == 10) {
-                    dst[idx++] = ALPHA_SHIFT_16_TO_10(alpha_val);
+                    out = ALPHA_SHIFT_16_TO_10(alpha_val);
                 } else { /* 12b */
-                    dst[idx++] = ALPHA_SHIFT_16_TO_12(alpha_val);
+                    out = ALPHA_SHIFT_16_TO_12(alpha_val);
                 }
             } else {
                 if (decode_precision == 10) {
-                    dst[idx++] = ALPHA_SHIFT_8_TO_10(alpha_val);
+                    out = ALPHA_SHIFT_8_TO_10(alpha_val);
                 } else { /* 12b */
-                    dst[idx++] = ALPHA_SHIFT_8_TO_12(alpha_val);
+                    out = ALPHA_SHIFT_8_TO_12(alpha_val);
                 }
             }
+            dst[idx++] = out;
             if (idx >= num_coeffs)
                 break;
         } while (get_bits_left(gb)>0 && get_bits1(gb));
@@ -97,23 +98,10 @@ static void inline unpack_alpha(GetBitContext *gb, uint16_t *dst, int num_coeffs
             val = get_bits(gb, 11);
         if (idx + val > num_coeffs)
             val = num_coeffs - idx;
-        if (num_bits == 16) {
-            for (i = 0; i < val; i++) {
-                if (decode_precision == 10) {
-                    dst[idx++] = ALPHA_SHIFT_16_TO_10(alpha_val);
-                } else { /* 12b */
-                    dst[idx++] = ALPHA_SHIFT_16_TO_12(alpha_val);
-                }
-            }
-        } else {
-            for (i = 0; i < val; i++) {
-                if (decode_precision == 10) {
-                    dst[idx++] = ALPHA_SHIFT_8_TO_10(alpha_val);
-                } else { /* 12b */
-                    dst[idx++] = ALPHA_SHIFT_8_TO_12(alpha_val);
-                }
-            }
-        }
+        /* repeat the last value */
+        for (i = 0; i < val; i++)
+            dst[idx + i] = out;
+        idx += val;
     } while (idx < num_coeffs);
 }
 
@@ -492,6 +480,41 @@ static av_always_inline int decode_dc_coeffs(GetBitContext *gb, int16_t *out,
     return 0;
 }
 
+/**
+ * Same as DECODE_CODEWORD, but without branching between the Rice and the
+ * exp-Golomb case. Both are read as the next len bits, including the leading
+ * zeros and the terminating one, plus a codebook dependent offset. This
+ * avoids hard to predict branches in the AC coefficients loop.
+ */
+#define DECODE_CODEWORD_BRANCHLESS(val, codebook, SKIP)                 \
+    do {                                                                \
+        unsigned int rice_order, exp_order, switch_bits;                \
+        unsigned int q, buf, len, exp_len;                              \
+        int offset, exp_offset;                                         \
+                                                                        \
+        UPDATE_CACHE(re, gb);                                           \
+        buf = GET_CACHE(re, gb);                                        \
+                                                                        \
+        switch_bits =  codebook & 3;                                    \
+        rice_order  =  codebook >> 5;                                   \
+        exp_order   = (codebook >> 2) & 7;                              \
+                                                                        \
+        q = 31 - av_log2(buf);                                          \
+                                                                        \
+        len        = q + 1 + rice_order;                                \
+        offset     = (q << rice_order) - (1 << rice_order);             \
+        exp_len    = exp_order - switch_bits + (q << 1);                \
+        exp_offset = ((switch_bits + 1) << rice_order) - (1 << exp_order); \
+        if (q > switch_bits) {                                          \
+            len    = exp_len;                                           \
+            offset = exp_offset;                                        \
+        }                                                               \
+        if (len > FFMIN(MIN_CACHE_BITS, 31))                            \
+            return AVERROR_INVALIDDATA;                                 \
+        val = SHOW_UBITS(re, gb, len) + offset;                         \
+        SKIP(re, gb, len);                                              \
+    } while (0)
+
 // adaptive codebook switching lut according to previous run/level values
 static const uint8_t run_to_cb[16] = { 0x06, 0x06, 0x05, 0x05, 0x04, 0x29, 0x29, 0x29, 0x29, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x4C };
 static const uint8_t lev_to_cb[10] = { 0x04, 0x0A, 0x05, 0x06, 0x04, 0x28, 0x28, 0x28, 0x28, 0x4C };
@@ -518,14 +541,14 @@ static av_always_inline int decode_ac_coeffs(AVCodecContext *avctx, GetBitContex
         if (!bits_left || (bits_left < 32 && !SHOW_UBITS(re, gb, bits_left)))
             break;
 
-        DECODE_CODEWORD(run, run_to_cb[FFMIN(run,  15)], LAST_SKIP_BITS);
+        DECODE_CODEWORD_BRANCHLESS(run, run_to_cb[FFMIN(run, 15)], LAST_SKIP_BITS);
         pos += run + 1;
         if (pos >= max_coeffs) {
             av_log(avctx, AV_LOG_ERROR, "ac tex damaged %d, %d\n", pos, max_coeffs);
             return AVERROR_INVALIDDATA;
         }
 
-        DECODE_CODEWORD(level, lev_to_cb[FFMIN(level, 9)], SKIP_BITS);
+        DECODE_CODEWORD_BRANCHLESS(level, lev_to_cb[FFMIN(level, 9)], SKIP_BITS);
         level += 1;
 
         i = pos >> log2_block_count;
@@ -620,9 +643,6 @@ static void decode_slice_alpha(const ProresContext *ctx,
     LOCAL_ALIGNED_32(int16_t, blocks, [8*4*64]);
     int16_t *block;
 
-    for (i = 0; i < blocks_per_slice<<2; i++)
-        ctx->bdsp.clear_block(blocks+(i<<6));
-
     init_get_bits(&gb, buf, buf_size << 3);
 
     if (ctx->alpha_info == 2) {
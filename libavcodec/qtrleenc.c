@@ -23,6 +23,8 @@
  */
 
 #include "libavutil/imgutils.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem.h"
 #include "avcodec.h"
 #include "bytestream.h"
 #include "codec_internal.h"
@@ -35,12 +37,7 @@
 /** Maximum RLE code for skip */
 #define MAX_RLE_SKIP   254
 
-typedef struct QtrleEncContext {
-    AVCodecContext *avctx;
-    int pixel_size;
-    AVFrame *previous_frame;
-    unsigned int max_buf_size;
-    int logical_width;
+typedef struct QtrleEncSlice {
     /**
      * This array will contain at ith position the value of the best RLE code
      * if the line started at pixel i
@@ -60,6 +57,23 @@ typedef struct QtrleEncContext {
      * frame starting from pixel i */
     uint8_t* skip_table;
 
+    /** Output buffer of the slice, unused if the frame has a single slice */
+    uint8_t *buf;
+    unsigned int buf_size;
+    int start_line, end_line;
+    int size;
+} QtrleEncSlice;
+
+typedef struct QtrleEncContext {
+    AVCodecContext *avctx;
+    int pixel_size;
+    AVFrame *previous_frame;
+    unsigned int max_buf_size;
+    int logical_width;
+
+    QtrleEncSlice *slices;
+    int nb_slices;
+
     /** Encoded frame is a key frame */
     int key_frame;
 } QtrleEncContext;
@@ -69,9 +83,14 @@ static av_cold int qtrle_encode_end(AVCodecContext *avctx)
     QtrleEncContext *s = avctx->priv_data;
 
     av_frame_free(&s->previous_frame);
-    av_free(s->rlecode_table);
-    av_free(s->length_table);
-    av_free(s->skip_table);
+    for (int i = 0; i < s->nb_slices; i++) {
+        QtrleEncSlice *sl = &s->slices[i];
+        av_free(sl->rlecode_table);
+        av_free(sl->length_table);
+        av_free(sl->skip_table);
+        av_free(sl->buf);
+    }
+    av_freep(&s->slices);
     return 0;
 }
 
@@ -109,12 +128,22 @@ static av_cold int qtrle_encode_init(AVCodecContext *avctx)
     }
     avctx->bits_per_coded_sample = avctx->pix_fmt == AV_PIX_FMT_GRAY8 ? 40 : s->pixel_size*8;
 
-    s->rlecode_table = av_mallocz(s->logical_width);
-    s->skip_table    = av_mallocz(s->logical_width);
-    s->length_table  = av_calloc(s->logical_width + 1, sizeof(*s->length_table));
-    if (!s->skip_table || !s->length_table || !s->rlecode_table) {
-        av_log(avctx, AV_LOG_ERROR, "Error allocating memory.\n");
+    s->nb_slices = 1;
+    if (avctx->active_thread_type & FF_THREAD_SLICE)
+        s->nb_slices = av_clip(avctx->thread_count, 1, avctx->height);
+    s->slices = av_calloc(s->nb_slices, sizeof(*s->slices));
+    if (!s->slices)
         return AVERROR(ENOMEM);
+    for (int i = 0; i < s->nb_slices; i++) {
+        QtrleEncSlice *sl = &s->slices[i];
+
+        sl->rlecode_table = av_mallocz(s->logical_width);
+        sl->skip_table    = av_mallocz(s->logical_width);
+        sl->length_table  = av_calloc(s->logical_width + 1, sizeof(*sl->length_table));
+        if (!sl->skip_table || !sl->length_table || !sl->rlecode_table) {
+            av_log(avctx, AV_LOG_ERROR, "Error allocating memory.\n");
+            return AVERROR(ENOMEM);
+        }
     }
     s->previous_frame = av_frame_alloc();
     if (!s->previous_frame) {
@@ -130,10 +159,21 @@ static av_cold int qtrle_encode_init(AVCodecContext *avctx)
     return 0;
 }
 
+static av_always_inline int pixel_equal(const uint8_t *a, const uint8_t *b,
+                                        int pixel_size)
+{
+    switch (pixel_size) {
+    case 2:  return AV_RN16(a) == AV_RN16(b);
+    case 3:  return AV_RN16(a) == AV_RN16(b) && a[2] == b[2];
+    default: return AV_RN32(a) == AV_RN32(b);
+    }
+}
+
 /**
  * Compute the best RLE sequence for a line
  */
-static void qtrle_encode_line(QtrleEncContext *s, const AVFrame *p, int line, uint8_t **buf)
+static void qtrle_encode_line(const QtrleEncContext *s, QtrleEncSlice *sl,
+                              const AVFrame *p, int line, uint8_t **buf)
 {
     int width=s->logical_width;
     int i;
@@ -165,7 +205,7 @@ static void qtrle_encode_line(QtrleEncContext *s, const AVFrame *p, int line, ui
                                               + line * s->previous_frame->linesize[0]
                                               + width * s->pixel_size;
 
-    s->length_table[width] = 0;
+    sl->length_table[width] = 0;
     skipcount = 0;
 
     /* Initial values */
@@ -202,7 +242,7 @@ static void qtrle_encode_line(QtrleEncContext *s, const AVFrame *p, int line, ui
 
         /* Look at the bulk cost of the previous loop and see if it is
          * a new lower bulk cost */
-        prev_bulk_cost = s->length_table[i + 1] + base_bulk_cost;
+        prev_bulk_cost = sl->length_table[i + 1] + base_bulk_cost;
         if (prev_bulk_cost <= sec_lowest_bulk_cost) {
             /* If it's lower than the 2nd lowest, then it may be lower
              * than the lowest */
@@ -222,21 +262,21 @@ static void qtrle_encode_line(QtrleEncContext *s, const AVFrame *p, int line, ui
             }
         }
 
-        if (!s->key_frame && !memcmp(this_line, prev_line, s->pixel_size))
+        if (!s->key_frame && pixel_equal(this_line, prev_line, s->pixel_size))
             skipcount = FFMIN(skipcount + 1, MAX_RLE_SKIP);
         else
             skipcount = 0;
 
-        total_skip_cost  = s->length_table[i + skipcount] + 2;
-        s->skip_table[i] = skipcount;
+        total_skip_cost  = sl->length_table[i + skipcount] + 2;
+        sl->skip_table[i] = skipcount;
 
 
-        if (i < width - 1 && !memcmp(this_line, this_line + s->pixel_size, s->pixel_size))
+        if (i < width - 1 && pixel_equal(this_line, this_line + s->pixel_size, s->pixel_size))
             repeatcount = FFMIN(repeatcount + 1, MAX_RLE_REPEAT);
         else
             repeatcount = 1;
 
-        total_repeat_cost = s->length_table[i + repeatcount] + 1 + s->pixel_size;
+        total_repeat_cost = sl->length_table[i + repeatcount] + 1 + s->pixel_size;
 
         /* skip code is free for the first pixel, it costs one byte for repeat and bulk copy
          * so let's make it aware */
@@ -247,20 +287,20 @@ static void qtrle_encode_line(QtrleEncContext *s, const AVFrame *p, int line, ui
 
         if (repeatcount > 1 && (skipcount == 0 || total_repeat_cost < total_skip_cost)) {
             /* repeat is the best */
-            s->length_table[i]  = total_repeat_cost;
-            s->rlecode_table[i] = -repeatcount;
+            sl->length_table[i]  = total_repeat_cost;
+            sl->rlecode_table[i] = -repeatcount;
         }
         else if (skipcount > 0) {
             /* skip is the best choice here */
-            s->length_table[i]  = total_skip_cost;
-            s->rlecode_table[i] = 0;
+            sl->length_table[i]  = total_skip_cost;
+            sl->rlecode_table[i] = 0;
         }
         else {
             /* We cannot do neither skip nor repeat
              * thus we use the best bulk copy  */
 
-            s->length_table[i]  = lowest_bulk_cost;
-            s->rlecode_table[i] = lowest_bulk_cost_index - i;
+            sl->length_table[i]  = lowest_bulk_cost;
+            sl->rlecode_table[i] = lowest_bulk_cost_index - i;
 
         }
 
@@ -277,20 +317,20 @@ static void qtrle_encode_line(QtrleEncContext *s, const AVFrame *p, int line, ui
     i=0;
     this_line = p->               data[0] + line*p->linesize[0];
 
-    if (s->rlecode_table[0] == 0) {
-        bytestream_put_byte(buf, s->skip_table[0] + 1);
-        i += s->skip_table[0];
+    if (sl->rlecode_table[0] == 0) {
+        bytestream_put_byte(buf, sl->skip_table[0] + 1);
+        i += sl->skip_table[0];
     }
     else bytestream_put_byte(buf, 1);
 
 
     while (i < width) {
-        rlecode = s->rlecode_table[i];
+        rlecode = sl->rlecode_table[i];
         bytestream_put_byte(buf, rlecode);
         if (rlecode == 0) {
             /* Write a skip sequence */
-            bytestream_put_byte(buf, s->skip_table[i] + 1);
-            i += s->skip_table[i];
+            bytestream_put_byte(buf, sl->skip_table[i] + 1);
+            i += sl->skip_table[i];
         }
         else if (rlecode > 0) {
             /* bulk copy */
@@ -322,12 +362,27 @@ static void qtrle_encode_line(QtrleEncContext *s, const AVFrame *p, int line, ui
     bytestream_put_byte(buf, -1); // end RLE line
 }
 
+static int encode_slice(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    const QtrleEncContext *s = avctx->priv_data;
+    const AVFrame *p = arg;
+    QtrleEncSlice *sl = &s->slices[jobnr];
+    uint8_t *buf = sl->buf;
+
+    for (int i = sl->start_line; i < sl->end_line; i++)
+        qtrle_encode_line(s, sl, p, i, &buf);
+    sl->size = buf - sl->buf;
+
+    return 0;
+}
+
 /** Encode frame including header */
 static int encode_frame(QtrleEncContext *s, const AVFrame *p, uint8_t *buf)
 {
     int i;
     int start_line = 0;
     int end_line = s->avctx->height;
+    int nb_slices;
     uint8_t *orig_buf = buf;
 
     if (!s->key_frame) {
@@ -356,8 +411,29 @@ static int encode_frame(QtrleEncContext *s, const AVFrame *p, uint8_t *buf)
         bytestream_put_be16(&buf, end_line - start_line); // lines to update
         bytestream_put_be16(&buf, 0);                     // unknown
     }
-    for (i = start_line; i < end_line; i++)
-        qtrle_encode_line(s, p, i, &buf);
+
+    nb_slices = FFMIN(s->nb_slices, end_line - start_line);
+    if (nb_slices <= 1) {
+        for (i = start_line; i < end_line; i++)
+            qtrle_encode_line(s, &s->slices[0], p, i, &buf);
+    } else {
+        /* Lines only depend on the previous frame, encode ranges of them
+         * into separate buffers and concatenate these. */
+        for (i = 0; i < nb_slices; i++) {
+            QtrleEncSlice *sl = &s->slices[i];
+
+            sl->start_line = start_line + (end_line - start_line) *  i      / nb_slices;
+            sl->end_line   = start_line + (end_line - start_line) * (i + 1) / nb_slices;
+            av_fast_malloc(&sl->buf, &sl->buf_size,
+                           (sl->end_line - sl->start_line) *
+                           (s->logical_width * s->pixel_size * 2 + 4));
+            if (!sl->buf)
+                return AVERROR(ENOMEM);
+        }
+        s->avctx->execute2(s->avctx, encode_slice, (void *)p, NULL, nb_slices);
+        for (i = 0; i < nb_slices; i++)
+            bytestream_put_buffer(&buf, s->slices[i].buf, s->slices[i].size);
+    }
 
     bytestream_put_byte(&buf, 0);                         // zero skip code = frame finished
     AV_WB32(orig_buf, buf - orig_buf);                    // patch the chunk size
@@ -382,7 +458,10 @@ static int qtrle_encode_frame(AVCodecContext *avctx, AVPacket *pkt,
         s->key_frame = 0;
     }
 
-    pkt->size = encode_frame(s, pict, pkt->data);
+    ret = encode_frame(s, pict, pkt->data);
+    if (ret < 0)
+        return ret;
+    pkt->size = ret;
 
     /* save the current frame */
     av_frame_unref(s->previous_frame);
@@ -404,7 +483,7 @@ const FFCodec ff_qtrle_encoder = {
     CODEC_LONG_NAME("QuickTime Animation (RLE) video"),
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_QTRLE,
-    .p.capabilities = AV_CODEC_CAP_DR1,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_SLICE_THREADS,
     .priv_data_size = sizeof(QtrleEncContext),
     .init           = qtrle_encode_init,
     FF_CODEC_ENCODE_CB(qtrle_encode_frame),
@@ -22,10 +22,12 @@
 
 #include "libavutil/channel_layout.h"
 #include "libavutil/intreadwrite.h"
+#include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "avcodec.h"
 #include "codec_internal.h"
 #include "encode.h"
+#include "internal.h"
 #include "put_bits.h"
 #include "bytestream.h"
 #include "wavpackenc.h"
@@ -104,6 +106,7 @@ typedef struct WavPackEncodeContext {
 
     unsigned extra_flags;
     int optimize_mono;
+    int frame_threads;
     int decorr_filter;
     int joint;
     int num_branches;
@@ -2851,6 +2854,18 @@ static void set_samplerate(WavPackEncodeContext *s)
     s->flags = i << SRATE_LSB;
 }
 
+static void reset_history(WavPackEncodeContext *s)
+{
+    CLEAR(s->w);
+    CLEAR(s->decorr_passes);
+    s->num_terms    = 0;
+    s->best_decorr  = s->mask_decorr = 0;
+    s->shift        = 0;
+    s->joint_stereo = 0;
+    s->false_stereo = 0;
+    s->delta_decay  = 2.0;
+}
+
 static int wavpack_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                                 const AVFrame *frame, int *got_packet_ptr)
 {
@@ -2870,6 +2885,15 @@ static int wavpack_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
             return AVERROR(ENOMEM);
     }
 
+    if (avctx->internal->frame_thread_encoder) {
+        /* A frame thread only sees a subset of the frames: encode each frame
+         * without the history of the previous one, so that the output does
+         * not depend on the scheduling, and derive the block index from the
+         * position of the frame, as all but the last one are frame_size long. */
+        s->sample_index = (int64_t)avctx->frame_number * avctx->frame_size;
+        reset_history(s);
+    }
+
     buf_size = s->block_samples * avctx->ch_layout.nb_channels * 8
              + 200 * avctx->ch_layout.nb_channels /* for headers */;
     if ((ret = ff_alloc_packet(avctx, avpkt, buf_size)) < 0)
@@ -2948,6 +2972,7 @@ static av_cold int wavpack_encode_close(AVCodecContext *avctx)
 static const AVOption options[] = {
     { "joint_stereo",  "", OFFSET(joint), AV_OPT_TYPE_BOOL, {.i64=-1}, -1, 1, FLAGS },
     { "optimize_mono", "", OFFSET(optimize_mono), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, FLAGS },
+    { "frame_threads", "allow frame threading, encoding every frame without the history of the previous one", OFFSET(frame_threads), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, FLAGS },
     { NULL },
 };
 
@@ -2963,7 +2988,8 @@ const FFCodec ff_wavpack_encoder = {
     CODEC_LONG_NAME("WavPack"),
     .p.type         = AVMEDIA_TYPE_AUDIO,
     .p.id           = AV_CODEC_ID_WAVPACK,
-    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_SMALL_LAST_FRAME,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_SMALL_LAST_FRAME |
+                      AV_CODEC_CAP_FRAME_THREADS,
     .priv_data_size = sizeof(WavPackEncodeContext),
     .p.priv_class   = &wavpack_encoder_class,
     .init           = wavpack_encode_init,
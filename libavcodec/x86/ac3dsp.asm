@@ -35,6 +35,13 @@ pw_bap_mul2: dw 5, 7, 0, 7, 5, 7, 0, 7
 cextern pd_1
 pd_151: times 4 dd 151
 
+; used in ff_ac3_bit_alloc_calc_bap()
+cextern ac3_bin_to_band_tab
+cextern ac3_band_start_tab
+cextern pb_15
+pb_16: times 16 db 16
+pb_63: times 16 db 63
+
 SECTION .text
 
 ;-----------------------------------------------------------------------------
@@ -231,3 +238,131 @@ AC3_EXTRACT_EXPONENTS
 INIT_XMM ssse3
 AC3_EXTRACT_EXPONENTS
 %endif
+;------------------------------------------------------------------------------
+; void ff_ac3_bit_alloc_calc_bap(int16_t *mask, int16_t *psd, int start, int end,
+;                                int snr_offset, int floor,
+;                                const uint8_t *bap_tab, uint8_t *bap)
+;------------------------------------------------------------------------------
+
+; look up 16 bap values for the bins starting at curq
+%macro BAP_16 0
+    movu        m0, [psdq+curq*2]
+    movu        m1, [psdq+curq*2+mmsize]
+    movu        m2, [rsp+curq*2]
+    movu        m3, [rsp+curq*2+mmsize]
+    psubw       m0, m2
+    psubw       m1, m3
+    psraw       m0, 5
+    psraw       m1, 5
+    packuswb    m0, m1
+    pminub      m0, m9              ; address = av_clip_uintp2((psd - m) >> 5, 6)
+    ; 64-entry table lookup as 4 pshufb on 16-entry chunks. Indices outside
+    ; the current chunk get their high bit set, so that pshufb returns 0.
+    mova        m1, m0
+    pcmpgtb     m1, m10
+    por         m1, m0
+    mova        m2, m4
+    pshufb      m2, m1
+%assign %%i 5
+%rep 3
+    psubb       m0, m11
+    mova        m1, m0
+    pcmpgtb     m1, m10
+    por         m1, m0
+    mova        m3, m %+ %%i
+    pshufb      m3, m1
+    por         m2, m3
+%assign %%i %%i+1
+%endrep
+    movu  [bapq+curq], m2
+%endmacro
+
+%if ARCH_X86_64 && HAVE_SSSE3_EXTERNAL
+INIT_XMM ssse3
+cglobal ac3_bit_alloc_calc_bap, 8, 13, 12, 528, mask, psd, start, end, snr, floor, bap_tab, bap, band, bend, tmp, cur, tab
+    movsxdifnidn startq, startd
+    movsxdifnidn   endq, endd
+    cmp            snrd, -960
+    je .zero
+
+    ; expand the per-band masking values to one value per bin on the stack:
+    ; m = (FFMAX(mask[band] - snr_offset - floor, 0) & 0x1FE0) + floor
+    add            snrd, floord
+    lea            tabq, [ac3_bin_to_band_tab]
+    movzx         bandd, byte [tabq+startq]
+    lea            tabq, [ac3_band_start_tab]
+.band_loop:
+    movsx          tmpd, word [maskq+bandq*2]
+    sub            tmpd, snrd
+    mov            curd, tmpd
+    sar            curd, 31
+    not            curd
+    and            tmpd, curd
+    and            tmpd, 0x1FE0
+    add            tmpd, floord
+    movd            xm0, tmpd
+    SPLATW           m0, m0
+    movzx          curd, byte [tabq+bandq]
+    inc           bandd
+    movzx         bendd, byte [tabq+bandq]
+.store_loop:
+    movu  [rsp+curq*2], m0
+    add            curd, mmsize / 2
+    cmp            curd, bendd
+    jl .store_loop
+    cmp           bendd, endd
+    jl .band_loop
+
+    mova             m9, [pb_63]
+    mova            m10, [pb_15]
+    mova            m11, [pb_16]
+    movu             m4, [bap_tabq]
+    movu             m5, [bap_tabq+16]
+    movu             m6, [bap_tabq+32]
+    movu             m7, [bap_tabq+48]
+
+    mov            curq, startq
+    lea            tmpq, [endq-16]
+    cmp            tmpq, curq
+    jl .scalar_check
+.loop:
+    BAP_16
+    add            curq, 16
+    cmp            curq, tmpq
+    jle .loop
+    ; handle the tail by redoing the last 16 bins
+    cmp            curq, endq
+    jge .end
+    mov            curq, tmpq
+    BAP_16
+.end:
+    RET
+
+.scalar:
+    movsx          tmpd, word [psdq+curq*2]
+    movsx         bendd, word [rsp+curq*2]
+    sub            tmpd, bendd
+    sar            tmpd, 5
+    xor           bendd, bendd
+    cmp            tmpd, 0
+    cmovl          tmpd, bendd
+    mov           bendd, 63
+    cmp            tmpd, 63
+    cmovg          tmpd, bendd
+    movzx          tmpd, byte [bap_tabq+tmpq]
+    mov     [bapq+curq], tmpb
+    inc            curq
+.scalar_check:
+    cmp            curq, endq
+    jl .scalar
+    RET
+
+.zero:
+    pxor             m0, m0
+    mov            curq, 256 - mmsize
+.zero_loop:
+    movu  [bapq+curq], m0
+    sub            curq, mmsize
+    jge .zero_loop
+    RET
+%endif
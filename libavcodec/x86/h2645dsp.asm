@@ -0,0 +1,87 @@
+;******************************************************************************
+;* SIMD-optimized H.264/HEVC emulation prevention search
+;*
+;* This file is part of FFmpeg.
+;*
+;* FFmpeg is free software; you can redistribute it and/or
+;* modify it under the terms of the GNU Lesser General Public
+;* License as published by the Free Software Foundation; either
+;* version 2.1 of the License, or (at your option) any later version.
+;*
+;* FFmpeg is distributed in the hope that it will be useful,
+;* but WITHOUT ANY WARRANTY; without even the implied warranty of
+;* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;* Lesser General Public License for more details.
+;*
+;* You should have received a copy of the GNU Lesser General Public
+;* License along with FFmpeg; if not, write to the Free Software
+;* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+;******************************************************************************
+
+%include "libavutil/x86/x86util.asm"
+
+cextern pb_3
+
+SECTION .text
+
+;------------------------------------------------------------------------------
+; int ff_h2645_find_escape(const uint8_t *buf, int size)
+;------------------------------------------------------------------------------
+
+%macro FIND_ESCAPE 0
+cglobal h2645_find_escape, 2, 5, 5, buf, size, pos, mask, end
+    movsxdifnidn sizeq, sized
+    xor        posq, posq
+    ; whole vectors are only checked while buf[pos + mmsize + 1] is valid
+    lea        endq, [sizeq - mmsize - 2]
+    test       endq, endq
+    jl .tail
+    mova       m3, [pb_3]
+    pxor       m4, m4
+.loop:
+    movu       m0, [bufq + posq]
+    movu       m1, [bufq + posq + 1]
+    movu       m2, [bufq + posq + 2]
+    por        m0, m1                   ; 0 if buf[i] == buf[i + 1] == 0
+    psubusb    m2, m3                   ; 0 if buf[i + 2] <= 3
+    por        m0, m2
+    pcmpeqb    m0, m4
+    pmovmskb   maskd, m0
+    test       maskd, maskd
+    jnz .found
+    add        posq, mmsize
+    cmp        posq, endq
+    jle .loop
+
+.tail:
+    lea        endq, [posq + 2]
+    cmp        endq, sizeq
+    jge .end
+    cmp        byte [bufq + posq], 0
+    jne .next
+    cmp        byte [bufq + posq + 1], 0
+    jne .next
+    cmp        byte [bufq + posq + 2], 3
+    jbe .ret
+.next:
+    inc        posq
+    jmp .tail
+
+.found:
+    bsf        maskd, maskd
+    add        posq, maskq
+    jmp .ret
+.end:
+    mov        posq, sizeq
+.ret:
+    mov        eax, posd
+    RET
+%endmacro
+
+INIT_XMM sse2
+FIND_ESCAPE
+
+%if HAVE_AVX2_EXTERNAL
+INIT_YMM avx2
+FIND_ESCAPE
+%endif
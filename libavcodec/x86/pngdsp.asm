@@ -25,6 +25,7 @@
 
 SECTION_RODATA
 
+cextern pb_1
 cextern pw_255
 
 SECTION .text
@@ -159,3 +160,134 @@ ADD_PAETH_PRED_FN 0
 
 INIT_MMX ssse3
 ADD_PAETH_PRED_FN 0
+
+; The Sub filter is a prefix sum over pixels, computed for a whole register
+; of pixels at a time with log2(pixels per register) shifted adds. For bpp 3
+; and 6 only the first 15 resp. 12 bytes of each register are used.
+%macro ADD_SUB_PRED_BPP 1 ; bpp
+%assign %%blk 16 - (16 % %1)
+.bpp%1:
+    movq                m0, [dstq-%1]
+    pslldq              m0, 16-%1
+    psrldq              m0, 16-%1
+.loop%1:
+    movu                m1, [dstq+srcq]
+    paddb               m1, m0
+%assign %%shift %1
+%rep 4
+%if %%shift < %%blk
+    mova                m2, m1
+    pslldq              m2, %%shift
+    paddb               m1, m2
+%endif
+%assign %%shift %%shift*2
+%endrep
+    movu            [dstq], m1
+    ; keep only the last pixel of the block for the next one
+%if %%blk < 16
+    pslldq              m1, 16-%%blk
+%endif
+    psrldq              m1, 16-%1
+    mova                m0, m1
+    add               dstq, %%blk
+    cmp               dstq, endq
+    jle .loop%1
+    add               endq, 16
+    jmp .scalar_init
+%endmacro
+
+INIT_XMM sse2
+cglobal add_png_sub_prediction, 4, 5, 3, dst, src, w, bpp, end
+    movsxdifnidn        wq, wd
+    movsxdifnidn      bppq, bppd
+    lea               endq, [dstq+wq]
+    sub               srcq, dstq
+    cmp                 wq, 16
+    jl .scalar_init
+    sub               endq, 16
+    cmp               bppd, 1
+    je .bpp1
+    cmp               bppd, 2
+    je .bpp2
+    cmp               bppd, 3
+    je .bpp3
+    cmp               bppd, 4
+    je .bpp4
+    cmp               bppd, 6
+    je .bpp6
+    cmp               bppd, 8
+    je .bpp8
+    add               endq, 16
+    jmp .scalar_init
+
+    ADD_SUB_PRED_BPP 1
+    ADD_SUB_PRED_BPP 2
+    ADD_SUB_PRED_BPP 3
+    ADD_SUB_PRED_BPP 4
+    ADD_SUB_PRED_BPP 6
+    ADD_SUB_PRED_BPP 8
+
+    ; the bytes written past the last complete block get overwritten here
+.scalar_init:
+    neg               bppq
+    jmp .end_s
+.loop_s:
+    mov                wb, [dstq+bppq]
+    add                wb, [dstq+srcq]
+    mov            [dstq], wb
+    inc               dstq
+.end_s:
+    cmp               dstq, endq
+    jl .loop_s
+    RET
+
+; The Average filter has a rounding step between consecutive pixels, so it is
+; computed one pixel at a time, but for all bytes of the pixel in parallel.
+; The unused upper bytes of each 8-byte store are overwritten by the
+; following pixels.
+INIT_XMM sse2
+cglobal add_png_avg_prediction, 5, 7, 6, dst, src, top, w, bpp, end, tmp
+    movsxdifnidn        wq, wd
+    movsxdifnidn      bppq, bppd
+    lea               endq, [dstq+wq]
+    sub               srcq, dstq
+    sub               topq, dstq
+    cmp               bppd, 3
+    jl .scalar_init
+    cmp                 wq, 8
+    jl .scalar_init
+    sub               endq, 8
+    mov               tmpq, dstq
+    sub               tmpq, bppq
+    movq                m0, [tmpq]
+    mova                m5, [pb_1]
+.loop_v:
+    movq                m1, [dstq+topq]
+    movq                m2, [dstq+srcq]
+    mova                m3, m0
+    pxor                m3, m1
+    pavgb               m0, m1
+    pand                m3, m5
+    psubb               m0, m3
+    paddb               m0, m2
+    movq            [dstq], m0
+    add               dstq, bppq
+    cmp               dstq, endq
+    jle .loop_v
+    add               endq, 8
+
+.scalar_init:
+    neg               bppq
+    jmp .end_s
+.loop_s:
+    movzx               wd, byte [dstq+bppq]
+    movzx             tmpd, byte [dstq+topq]
+    add                 wd, tmpd
+    shr                 wd, 1
+    add                wb, [dstq+srcq]
+    mov            [dstq], wb
+    inc               dstq
+.end_s:
+    cmp               dstq, endq
+    jl .loop_s
+    RET
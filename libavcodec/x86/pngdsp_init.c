@@ -30,6 +30,10 @@ void ff_add_png_paeth_prediction_ssse3(uint8_t *dst, uint8_t *src,
                                        uint8_t *top, int w, int bpp);
 void ff_add_bytes_l2_sse2(uint8_t *dst, uint8_t *src1,
                           uint8_t *src2, int w);
+void ff_add_png_sub_prediction_sse2(uint8_t *dst, const uint8_t *src,
+                                    int w, int bpp);
+void ff_add_png_avg_prediction_sse2(uint8_t *dst, const uint8_t *src,
+                                    const uint8_t *top, int w, int bpp);
 
 av_cold void ff_pngdsp_init_x86(PNGDSPContext *dsp)
 {
@@ -37,8 +41,11 @@ av_cold void ff_pngdsp_init_x86(PNGDSPContext *dsp)
 
     if (EXTERNAL_MMXEXT(cpu_flags))
         dsp->add_paeth_prediction = ff_add_png_paeth_prediction_mmxext;
-    if (EXTERNAL_SSE2(cpu_flags))
+    if (EXTERNAL_SSE2(cpu_flags)) {
         dsp->add_bytes_l2         = ff_add_bytes_l2_sse2;
+        dsp->add_sub_prediction   = ff_add_png_sub_prediction_sse2;
+        dsp->add_avg_prediction   = ff_add_png_avg_prediction_sse2;
+    }
     if (EXTERNAL_SSSE3(cpu_flags))
         dsp->add_paeth_prediction = ff_add_png_paeth_prediction_ssse3;
 }
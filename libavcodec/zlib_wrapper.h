@@ -53,6 +53,14 @@ void ff_inflate_end(FFZStream *zstream);
  */
 int ff_deflate_init(FFZStream *zstream, int level, void *logctx);
 
+/**
+ * Wrapper around deflateInit2() with the default memLevel and strategy.
+ * A negative window_bits selects a raw deflate stream without zlib header
+ * and trailer. It works analogously to ff_inflate_init().
+ */
+int ff_deflate_init2(FFZStream *zstream, int level, int window_bits,
+                     void *logctx);
+
 /**
  * Wrapper around deflateEnd(). It works analogously to ff_inflate_end().
  */
@@ -77,6 +77,28 @@ typedef struct FFIOContext {
      * is updated each time a successful writeout ends up further position-wise
      */
     int64_t written_output_size;
+
+    /**
+     * Maximum size of a single read when reading sequentially, 0 disables
+     * growing the reads beyond the buffer size.
+     */
+    int readahead_max;
+
+    /**
+     * Current read size, doubled on every buffer refill and reset on seeks.
+     * 0 until the first refill.
+     */
+    int readahead_size;
+
+    /**
+     * read statistic: number of read_packet calls
+     */
+    int64_t read_count;
+
+    /**
+     * read statistic: time spent in read_packet calls, in microseconds
+     */
+    int64_t read_time;
 } FFIOContext;
 
 static av_always_inline FFIOContext *ffiocontext(AVIOContext *ctx)
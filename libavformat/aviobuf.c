@@ -27,6 +27,7 @@
 #include "libavutil/log.h"
 #include "libavutil/opt.h"
 #include "libavutil/avassert.h"
+#include "libavutil/time.h"
 #include "libavcodec/defs.h"
 #include "avio.h"
 #include "avio_internal.h"
@@ -43,6 +44,11 @@
  */
 #define SHORT_SEEK_THRESHOLD 32768
 
+/**
+ * Upper limit for the readahead_max option.
+ */
+#define MAX_READAHEAD (64 << 20)
+
 static void *ff_avio_child_next(void *obj, void *prev)
 {
     AVIOContext *s = obj;
@@ -59,8 +65,15 @@ static const AVClass *child_class_iterate(void **iter)
 #define OFFSET(x) offsetof(AVIOContext,x)
 #define E AV_OPT_FLAG_ENCODING_PARAM
 #define D AV_OPT_FLAG_DECODING_PARAM
+#define FOFFSET(x) offsetof(FFIOContext,x)
+#define RO AV_OPT_FLAG_READONLY | AV_OPT_FLAG_EXPORT
 static const AVOption ff_avio_options[] = {
     {"protocol_whitelist", "List of protocols that are allowed to be used", OFFSET(protocol_whitelist), AV_OPT_TYPE_STRING, { .str = NULL },  0, 0, D },
+    {"readahead_max", "Maximum size of reads when reading sequentially", FOFFSET(readahead_max), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, MAX_READAHEAD, D },
+    {"io_bytes_read", "Number of bytes read", FOFFSET(bytes_read), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, D | RO },
+    {"io_read_calls", "Number of reads from the underlying protocol", FOFFSET(read_count), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, D | RO },
+    {"io_read_time", "Time spent reading from the underlying protocol, in microseconds", FOFFSET(read_time), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, D | RO },
+    {"io_seeks", "Number of seeks in the underlying protocol", FOFFSET(seek_count), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, D | RO },
     { NULL },
 };
 
@@ -321,6 +334,7 @@ int64_t avio_seek(AVIOContext *s, int64_t offset, int whence)
         pos -= FFMIN(buffer_size>>1, pos);
         if ((res = s->seek(s->opaque, pos, SEEK_SET)) < 0)
             return res;
+        ctx->readahead_size = 0;
         s->buf_end =
         s->buf_ptr = s->buffer;
         s->pos = pos;
@@ -337,6 +351,7 @@ int64_t avio_seek(AVIOContext *s, int64_t offset, int whence)
         if ((res = s->seek(s->opaque, offset, SEEK_SET)) < 0)
             return res;
         ctx->seek_count++;
+        ctx->readahead_size = 0;
         if (!s->write_flag)
             s->buf_end = s->buffer;
         s->buf_ptr = s->buf_ptr_max = s->buffer;
@@ -528,11 +543,16 @@ void avio_write_marker(AVIOContext *s, int64_t time, enum AVIODataMarkerType typ
 
 static int read_packet_wrapper(AVIOContext *s, uint8_t *buf, int size)
 {
+    FFIOContext *const ctx = ffiocontext(s);
+    int64_t start;
     int ret;
 
     if (!s->read_packet)
         return AVERROR(EINVAL);
+    start = av_gettime_relative();
     ret = s->read_packet(s->opaque, buf, size);
+    ctx->read_time += av_gettime_relative() - start;
+    ctx->read_count++;
     av_assert2(ret || s->max_packet_size);
     return ret;
 }
@@ -563,17 +583,41 @@ static void fill_buffer(AVIOContext *s)
         s->checksum_ptr = s->buffer;
     }
 
+    /* While reading sequentially, double the size of the reads up to
+     * readahead_max to save round trips to the protocol. The buffer can only
+     * be replaced when its contents are discarded anyway. */
+    if (ctx->readahead_max > ctx->orig_buffer_size && s->read_packet &&
+        ctx->orig_buffer_size) {
+        int orig_buffer_size = ctx->orig_buffer_size;
+        int target = ctx->readahead_size ?
+                     FFMIN(2LL * ctx->readahead_size, ctx->readahead_max) :
+                     orig_buffer_size;
+
+        if (dst == s->buffer && s->buf_ptr != dst && s->buffer_size < target) {
+            if (set_buf_size(s, target) >= 0) {
+                s->checksum_ptr = dst = s->buffer;
+                len = s->buffer_size;
+            }
+            ctx->orig_buffer_size = orig_buffer_size;
+        }
+        ctx->readahead_size = FFMIN(target, s->buffer_size);
+    }
+
     /* make buffer smaller in case it ended up large after probing */
     if (s->read_packet && ctx->orig_buffer_size &&
-        s->buffer_size > ctx->orig_buffer_size  && len >= ctx->orig_buffer_size) {
+        s->buffer_size > FFMAX(ctx->orig_buffer_size, ctx->readahead_size) &&
+        len >= ctx->orig_buffer_size) {
+        int size = FFMAX(ctx->orig_buffer_size, ctx->readahead_size);
         if (dst == s->buffer && s->buf_ptr != dst) {
-            int ret = set_buf_size(s, ctx->orig_buffer_size);
+            int orig_buffer_size = ctx->orig_buffer_size;
+            int ret = set_buf_size(s, size);
             if (ret < 0)
                 av_log(s, AV_LOG_WARNING, "Failed to decrease buffer size\n");
+            ctx->orig_buffer_size = orig_buffer_size;
 
             s->checksum_ptr = dst = s->buffer;
         }
-        len = ctx->orig_buffer_size;
+        len = FFMIN(len, size);
     }
 
     len = read_packet_wrapper(s, dst, len);
@@ -1227,6 +1271,32 @@ int avio_open(AVIOContext **s, const char *filename, int flags)
     return avio_open2(s, filename, flags, NULL, NULL);
 }
 
+/* Like av_opt_set_dict(), but the exported read-only statistics are left in
+ * the dictionary as unused options instead of failing the open. */
+static int set_options(AVIOContext *s, AVDictionary **options)
+{
+    const AVDictionaryEntry *t = NULL;
+    AVDictionary *readonly = NULL;
+    int ret;
+
+    while ((t = av_dict_get(*options, "", t, AV_DICT_IGNORE_SUFFIX))) {
+        const AVOption *o = av_opt_find(s, t->key, NULL, 0, 0);
+        if (o && (o->flags & AV_OPT_FLAG_READONLY) &&
+            (ret = av_dict_set(&readonly, t->key, t->value, 0)) < 0)
+            goto end;
+    }
+    t = NULL;
+    while ((t = av_dict_get(readonly, "", t, AV_DICT_IGNORE_SUFFIX)))
+        av_dict_set(options, t->key, NULL, 0);
+
+    ret = av_opt_set_dict(s, options);
+    if (ret >= 0)
+        ret = av_dict_copy(options, readonly, 0);
+end:
+    av_dict_free(&readonly);
+    return ret;
+}
+
 int ffio_open_whitelist(AVIOContext **s, const char *filename, int flags,
                          const AVIOInterruptCB *int_cb, AVDictionary **options,
                          const char *whitelist, const char *blacklist
@@ -1245,6 +1315,10 @@ int ffio_open_whitelist(AVIOContext **s, const char *filename, int flags,
         ffurl_close(h);
         return err;
     }
+    if (options && (err = set_options(*s, options)) < 0) {
+        avio_closep(s);
+        return err;
+    }
     return 0;
 }
 
@@ -1273,8 +1347,8 @@ int avio_close(AVIOContext *s)
                "Statistics: %"PRId64" bytes written, %d seeks, %d writeouts\n",
                ctx->bytes_written, ctx->seek_count, ctx->writeout_count);
     else
-        av_log(s, AV_LOG_VERBOSE, "Statistics: %"PRId64" bytes read, %d seeks\n",
-               ctx->bytes_read, ctx->seek_count);
+        av_log(s, AV_LOG_VERBOSE, "Statistics: %"PRId64" bytes read, %"PRId64" reads, %d seeks, %"PRId64" us spent reading\n",
+               ctx->bytes_read, ctx->read_count, ctx->seek_count, ctx->read_time);
     av_opt_free(s);
 
     error = s->error;
@@ -28,8 +28,10 @@
 #include "avio_internal.h"
 #include "dash.h"
 #include "demux.h"
+#include "segment_prefetch.h"
 
 #define INITIAL_BUFFER_SIZE 32768
+#define MAX_INIT_SECTION_SIZE (1024 * 1024)
 
 struct fragment {
     int64_t url_offset;
@@ -37,6 +39,15 @@ struct fragment {
     char *url;
 };
 
+/* Downloaded initialization section, shared by all representations using it. */
+struct init_section_entry {
+    char *url;
+    int64_t url_offset;
+    int64_t size;
+    uint8_t *data;
+    int data_len;
+};
+
 /*
  * reference to : ISO_IEC_23009-1-DASH-2012
  * Section: 5.3.9.6.2
@@ -115,6 +126,8 @@ struct representation {
     uint32_t init_sec_buf_read_offset;
     int64_t cur_timestamp;
     int is_restart_needed;
+
+    SegmentPrefetch *cur_prefetch;
 };
 
 typedef struct DASHContext {
@@ -157,6 +170,22 @@ typedef struct DASHContext {
     int is_init_section_common_audio;
     int is_init_section_common_subtitle;
 
+    int prefetch_segments;
+    int prefetch_size;
+    SegmentPrefetchPool prefetch;
+
+    int init_cache_size;
+    struct init_section_entry **init_cache;
+    int n_init_cache;
+    int64_t init_cache_bytes;
+
+    /* statistics, printed on close */
+    int nb_fragments;
+    int nb_prefetched;
+    int64_t bytes_read;
+    int64_t wait_time;
+    int init_cache_hits;
+    int init_cache_misses;
 } DASHContext;
 
 static int ishttp(char *url)
@@ -345,8 +374,21 @@ static void free_timelines_list(struct representation *pls)
     pls->n_timelines = 0;
 }
 
+static void free_init_cache(DASHContext *c)
+{
+    for (int i = 0; i < c->n_init_cache; i++) {
+        av_freep(&c->init_cache[i]->url);
+        av_freep(&c->init_cache[i]->data);
+        av_freep(&c->init_cache[i]);
+    }
+    av_freep(&c->init_cache);
+    c->n_init_cache     = 0;
+    c->init_cache_bytes = 0;
+}
+
 static void free_representation(struct representation *pls)
 {
+    ff_segment_prefetch_free(pls->parent, &pls->cur_prefetch);
     free_fragment_list(pls);
     free_timelines_list(pls);
     free_fragment(&pls->cur_seg);
@@ -398,14 +440,11 @@ static void free_subtitle_list(DASHContext *c)
     c->n_subtitles = 0;
 }
 
-static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
-                    AVDictionary **opts, AVDictionary *opts2, int *is_http)
+static int check_url(AVFormatContext *s, const char *url, const char **proto_name_out)
 {
     DASHContext *c = s->priv_data;
-    AVDictionary *tmp = NULL;
     const char *proto_name = NULL;
     int proto_name_len;
-    int ret;
 
     if (av_strstart(url, "crypto", NULL)) {
         if (url[6] == '+' || url[6] == ':')
@@ -440,6 +479,22 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
     else if (strcmp(proto_name, "file") || !strncmp(url, "file,", 5))
         return AVERROR_INVALIDDATA;
 
+    if (proto_name_out)
+        *proto_name_out = proto_name;
+    return 0;
+}
+
+static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
+                    AVDictionary **opts, AVDictionary *opts2, int *is_http)
+{
+    DASHContext *c = s->priv_data;
+    AVDictionary *tmp = NULL;
+    const char *proto_name = NULL;
+    int ret;
+
+    if ((ret = check_url(s, url, &proto_name)) < 0)
+        return ret;
+
     av_freep(pb);
     av_dict_copy(&tmp, *opts, 0);
     av_dict_copy(&tmp, opts2, 0);
@@ -1579,6 +1634,36 @@ finish:
     return ret;
 }
 
+static int fill_template_fragment(struct representation *pls, struct fragment *seg,
+                                  int64_t seq_no)
+{
+    DASHContext *c = pls->parent->priv_data;
+    char *tmpfilename;
+
+    if (!pls->url_template) {
+        av_log(pls->parent, AV_LOG_ERROR, "Cannot get fragment, missing template URL\n");
+        return AVERROR_INVALIDDATA;
+    }
+    tmpfilename = av_mallocz(c->max_url_size);
+    if (!tmpfilename)
+        return AVERROR(ENOMEM);
+    ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, seq_no, 0, get_segment_start_time_based_on_timeline(pls, seq_no));
+    seg->url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
+    if (!seg->url) {
+        av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
+        seg->url = av_strdup(pls->url_template);
+        if (!seg->url) {
+            av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
+            av_free(tmpfilename);
+            return AVERROR(ENOMEM);
+        }
+    }
+    av_free(tmpfilename);
+    seg->size = -1;
+
+    return 0;
+}
+
 static struct fragment *get_current_fragment(struct representation *pls)
 {
     int64_t min_seq_no = 0;
@@ -1631,32 +1716,36 @@ static struct fragment *get_current_fragment(struct representation *pls)
             return NULL;
         }
     }
-    if (seg) {
-        char *tmpfilename;
-        if (!pls->url_template) {
-            av_log(pls->parent, AV_LOG_ERROR, "Cannot get fragment, missing template URL\n");
-            av_free(seg);
-            return NULL;
-        }
-        tmpfilename = av_mallocz(c->max_url_size);
-        if (!tmpfilename) {
+    if (seg && fill_template_fragment(pls, seg, pls->cur_seq_no) < 0) {
+        av_free(seg);
+        return NULL;
+    }
+
+    return seg;
+}
+
+/* Like get_current_fragment(), for a later fragment of a static manifest. */
+static struct fragment *get_fragment(struct representation *pls, int64_t seq_no)
+{
+    struct fragment *seg;
+
+    if (pls->n_fragments ? seq_no >= pls->n_fragments : seq_no > pls->last_seq_no)
+        return NULL;
+    seg = av_mallocz(sizeof(*seg));
+    if (!seg)
+        return NULL;
+
+    if (seq_no < pls->n_fragments) {
+        seg->url = av_strdup(pls->fragments[seq_no]->url);
+        if (!seg->url) {
             av_free(seg);
             return NULL;
         }
-        ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, pls->cur_seq_no, 0, get_segment_start_time_based_on_timeline(pls, pls->cur_seq_no));
-        seg->url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
-        if (!seg->url) {
-            av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
-            seg->url = av_strdup(pls->url_template);
-            if (!seg->url) {
-                av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
-                av_free(tmpfilename);
-                av_free(seg);
-                return NULL;
-            }
-        }
-        av_free(tmpfilename);
-        seg->size = -1;
+        seg->size       = pls->fragments[seq_no]->size;
+        seg->url_offset = pls->fragments[seq_no]->url_offset;
+    } else if (fill_template_fragment(pls, seg, seq_no) < 0) {
+        av_free(seg);
+        return NULL;
     }
 
     return seg;
@@ -1665,15 +1754,21 @@ static struct fragment *get_current_fragment(struct representation *pls)
 static int read_from_url(struct representation *pls, struct fragment *seg,
                          uint8_t *buf, int buf_size)
 {
+    DASHContext *c = pls->parent->priv_data;
     int ret;
 
     /* limit read if the fragment was only a part of a file */
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, pls->cur_seg_size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
-    if (ret > 0)
+    if (pls->cur_prefetch)
+        ret = ff_segment_prefetch_read(pls->cur_prefetch, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
+    if (ret > 0) {
         pls->cur_seg_offset += ret;
+        c->bytes_read       += ret;
+    }
 
     return ret;
 }
@@ -1710,56 +1805,269 @@ cleanup:
     return ret;
 }
 
+static struct init_section_entry *find_init_section(DASHContext *c, const char *url,
+                                                    const struct fragment *sec)
+{
+    for (int i = 0; i < c->n_init_cache; i++) {
+        struct init_section_entry *e = c->init_cache[i];
+        if (!strcmp(e->url, url) && e->url_offset == sec->url_offset && e->size == sec->size)
+            return e;
+    }
+    return NULL;
+}
+
+/* Keep a copy of a downloaded initialization section, evicting the oldest
+ * entries to stay within init_cache_size. */
+static void add_init_section(DASHContext *c, const char *url, const struct fragment *sec,
+                             const uint8_t *data, int data_len)
+{
+    struct init_section_entry *e;
+
+    if (data_len > c->init_cache_size)
+        return;
+
+    while (c->n_init_cache && c->init_cache_bytes + data_len > c->init_cache_size) {
+        e = c->init_cache[0];
+        c->init_cache_bytes -= e->data_len;
+        av_freep(&e->url);
+        av_freep(&e->data);
+        av_freep(&e);
+        c->n_init_cache--;
+        memmove(&c->init_cache[0], &c->init_cache[1], c->n_init_cache * sizeof(*c->init_cache));
+    }
+
+    e = av_mallocz(sizeof(*e));
+    if (!e)
+        return;
+    e->url  = av_strdup(url);
+    e->data = av_memdup(data, data_len);
+    if (!e->url || !e->data ||
+        av_dynarray_add_nofree(&c->init_cache, &c->n_init_cache, e) < 0) {
+        av_freep(&e->url);
+        av_freep(&e->data);
+        av_freep(&e);
+        return;
+    }
+    e->url_offset = sec->url_offset;
+    e->size       = sec->size;
+    e->data_len   = data_len;
+    c->init_cache_bytes += data_len;
+}
+
+static int set_init_section(struct representation *pls, const uint8_t *data, int data_len)
+{
+    av_fast_malloc(&pls->init_sec_buf, &pls->init_sec_buf_size, data_len);
+    if (!pls->init_sec_buf)
+        return AVERROR(ENOMEM);
+    memcpy(pls->init_sec_buf, data, data_len);
+    pls->init_sec_data_len = data_len;
+    pls->init_sec_buf_read_offset = 0;
+
+    return 0;
+}
+
 static int update_init_section(struct representation *pls)
 {
-    static const int max_init_section_size = 1024 * 1024;
     DASHContext *c = pls->parent->priv_data;
+    struct init_section_entry *cached;
+    SegmentPrefetch *job = NULL;
     int64_t sec_size;
     int64_t urlsize;
+    char *url;
     int ret;
 
     if (!pls->init_section || pls->init_sec_buf)
         return 0;
 
-    ret = open_input(c, pls, pls->init_section);
-    if (ret < 0) {
-        av_log(pls->parent, AV_LOG_WARNING,
-               "Failed to open an initialization section\n");
-        return ret;
+    url = av_mallocz(c->max_url_size);
+    if (!url)
+        return AVERROR(ENOMEM);
+    ff_make_absolute_url(url, c->max_url_size, c->base_url, pls->init_section->url);
+
+    if ((cached = find_init_section(c, url, pls->init_section))) {
+        c->init_cache_hits++;
+        ret = set_init_section(pls, cached->data, cached->data_len);
+        goto end;
     }
+    c->init_cache_misses++;
 
-    if (pls->init_section->size >= 0)
-        sec_size = pls->init_section->size;
-    else if ((urlsize = avio_size(pls->input)) >= 0)
-        sec_size = urlsize;
-    else
-        sec_size = max_init_section_size;
+    if (c->prefetch_segments)
+        job = ff_segment_prefetch_take(&c->prefetch, url, pls->init_section->url_offset,
+                                       pls->init_section->size);
+    if (job && (job->buf_len || job->ret >= 0)) {
+        ret = set_init_section(pls, job->buf, job->buf_len);
+        ff_segment_prefetch_free(pls->parent, &job);
+        if (ret < 0)
+            goto end;
+        ret = pls->init_sec_data_len;
+    } else {
+        ff_segment_prefetch_free(pls->parent, &job);
+
+        ret = open_input(c, pls, pls->init_section);
+        if (ret < 0) {
+            av_log(pls->parent, AV_LOG_WARNING,
+                   "Failed to open an initialization section\n");
+            goto end;
+        }
+
+        if (pls->init_section->size >= 0)
+            sec_size = pls->init_section->size;
+        else if ((urlsize = avio_size(pls->input)) >= 0)
+            sec_size = urlsize;
+        else
+            sec_size = MAX_INIT_SECTION_SIZE;
 
-    av_log(pls->parent, AV_LOG_DEBUG,
-           "Downloading an initialization section of size %"PRId64"\n",
-           sec_size);
+        av_log(pls->parent, AV_LOG_DEBUG,
+               "Downloading an initialization section of size %"PRId64"\n",
+               sec_size);
 
-    sec_size = FFMIN(sec_size, max_init_section_size);
+        sec_size = FFMIN(sec_size, MAX_INIT_SECTION_SIZE);
 
-    av_fast_malloc(&pls->init_sec_buf, &pls->init_sec_buf_size, sec_size);
+        av_fast_malloc(&pls->init_sec_buf, &pls->init_sec_buf_size, sec_size);
 
-    ret = read_from_url(pls, pls->init_section, pls->init_sec_buf,
-                        pls->init_sec_buf_size);
-    ff_format_io_close(pls->parent, &pls->input);
+        ret = read_from_url(pls, pls->init_section, pls->init_sec_buf,
+                            pls->init_sec_buf_size);
+        ff_format_io_close(pls->parent, &pls->input);
+    }
 
     if (ret < 0)
-        return ret;
+        goto end;
 
     pls->init_sec_data_len = ret;
     pls->init_sec_buf_read_offset = 0;
+    add_init_section(c, url, pls->init_section, pls->init_sec_buf, ret);
+    ret = 0;
 
-    return 0;
+end:
+    av_free(url);
+    return ret;
+}
+
+/* Queue a fragment unless it is queued already. Must be called with the
+ * pool locked. */
+static SegmentPrefetch *add_prefetch(AVFormatContext *s, struct representation *rep,
+                                     int64_t seq_no, const struct fragment *seg, char *url)
+{
+    DASHContext *c = s->priv_data;
+    SegmentPrefetch *job;
+
+    ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
+    if (ff_segment_prefetch_find(&c->prefetch, url, seg->url_offset, seg->size))
+        return NULL;
+
+    job = ff_segment_prefetch_add(&c->prefetch, rep, seq_no, url,
+                                  seg->url_offset, seg->size, c->avio_opts);
+    if (!job)
+        return NULL;
+    /* A rejected url fails like open_url() would, once it is reached. */
+    job->ret = check_url(s, url, NULL);
+    if (job->ret < 0)
+        job->state = SEGMENT_PREFETCH_DONE;
+
+    return job;
+}
+
+/* Fetch the initialization sections of all representations concurrently. */
+static void prefetch_init_sections(AVFormatContext *s, struct representation **reps, int n_reps)
+{
+    DASHContext *c = s->priv_data;
+    char *url = av_mallocz(c->max_url_size);
+
+    if (!url)
+        return;
+
+    ff_segment_prefetch_lock(&c->prefetch);
+    for (int i = 0; i < n_reps; i++) {
+        SegmentPrefetch *job;
+
+        if (!reps[i]->init_section)
+            continue;
+        job = add_prefetch(s, NULL, -1, reps[i]->init_section, url);
+        if (job) {
+            job->max_size = MAX_INIT_SECTION_SIZE;
+            job->truncate = 1;
+        }
+    }
+    ff_segment_prefetch_unlock(&c->prefetch);
+
+    av_free(url);
+}
+
+/* Queue the fragments following the current one that are not requested
+ * yet, and drop the ones we are already past. */
+static void schedule_prefetch(DASHContext *c, struct representation *pls)
+{
+    char *url;
+
+    if (!c->prefetch_segments || c->is_live ||
+        /* seek_data() needs a real input for these */
+        (pls->n_fragments && !pls->init_section))
+        return;
+
+    url = av_mallocz(c->max_url_size);
+    if (!url)
+        return;
+
+    ff_segment_prefetch_lock(&c->prefetch);
+    ff_segment_prefetch_cancel(&c->prefetch, pls, pls->cur_seq_no);
+
+    for (int64_t seq_no = pls->cur_seq_no + 1;
+         seq_no <= pls->cur_seq_no + c->prefetch_segments; seq_no++) {
+        struct fragment *seg = get_fragment(pls, seq_no);
+        if (!seg)
+            break;
+        add_prefetch(pls->parent, pls, seq_no, seg, url);
+        free_fragment(&seg);
+    }
+    ff_segment_prefetch_unlock(&c->prefetch);
+
+    av_free(url);
+}
+
+/* Drop all fragments prefetched for a representation, including the current one. */
+static void release_prefetch(DASHContext *c, struct representation *pls)
+{
+    ff_segment_prefetch_free(pls->parent, &pls->cur_prefetch);
+    if (!c->prefetch_segments)
+        return;
+    ff_segment_prefetch_lock(&c->prefetch);
+    ff_segment_prefetch_cancel(&c->prefetch, pls, INT64_MAX);
+    ff_segment_prefetch_unlock(&c->prefetch);
+}
+
+/* Open the current fragment, from the prefetched data if there is any. */
+static int open_fragment(DASHContext *c, struct representation *pls, struct fragment *seg)
+{
+    char *url;
+    int ret;
+
+    if (!c->prefetch_segments)
+        return open_input(c, pls, seg);
+
+    url = av_mallocz(c->max_url_size);
+    if (!url)
+        return AVERROR(ENOMEM);
+    ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
+    pls->cur_prefetch = ff_segment_prefetch_take(&c->prefetch, url, seg->url_offset, seg->size);
+    av_free(url);
+
+    if (!pls->cur_prefetch)
+        return open_input(c, pls, seg);
+
+    c->nb_prefetched++;
+    pls->cur_seg_offset = 0;
+    pls->cur_seg_size   = seg->size;
+    ret = pls->cur_prefetch->buf_len || pls->cur_prefetch->in ? 0 : pls->cur_prefetch->ret;
+    if (ret < 0)
+        ff_segment_prefetch_free(pls->parent, &pls->cur_prefetch);
+
+    return ret;
 }
 
 static int64_t seek_data(void *opaque, int64_t offset, int whence)
 {
     struct representation *v = opaque;
-    if (v->n_fragments && !v->init_sec_data_len) {
+    if (v->n_fragments && !v->init_sec_data_len && v->input) {
         return avio_seek(v->input, offset, whence);
     }
 
@@ -1773,7 +2081,9 @@ static int read_data(void *opaque, uint8_t *buf, int buf_size)
     DASHContext *c = v->parent->priv_data;
 
 restart:
-    if (!v->input) {
+    if (!v->input && !v->cur_prefetch) {
+        int64_t start = av_gettime_relative();
+
         free_fragment(&v->cur_seg);
         v->cur_seg = get_current_fragment(v);
         if (!v->cur_seg) {
@@ -1786,7 +2096,8 @@ restart:
         if (ret)
             goto end;
 
-        ret = open_input(c, v, v->cur_seg);
+        ret = open_fragment(c, v, v->cur_seg);
+        c->wait_time += av_gettime_relative() - start;
         if (ret < 0) {
             if (ff_check_interrupt(c->interrupt_callback)) {
                 ret = AVERROR_EXIT;
@@ -1796,6 +2107,8 @@ restart:
             v->cur_seq_no++;
             goto restart;
         }
+        c->nb_fragments++;
+        schedule_prefetch(c, v);
     }
 
     if (v->init_sec_buf_read_offset < v->init_sec_data_len) {
@@ -2045,6 +2358,20 @@ static int dash_read_header(AVFormatContext *s)
         av_dict_set(&c->avio_opts, "seekable", "0", 0);
     }
 
+    if (c->prefetch_segments) {
+        ret = ff_segment_prefetch_init(&c->prefetch, s, c->prefetch_segments, c->prefetch_size);
+        if (ret < 0) {
+            c->prefetch_segments = 0;
+            if (ret != AVERROR(ENOSYS))
+                return ret;
+            av_log(s, AV_LOG_WARNING, "Fragment prefetching requires threads, disabling it\n");
+        } else {
+            prefetch_init_sections(s, c->videos, c->n_videos);
+            prefetch_init_sections(s, c->audios, c->n_audios);
+            prefetch_init_sections(s, c->subtitles, c->n_subtitles);
+        }
+    }
+
     if(c->n_videos)
         c->is_init_section_common_video = is_common_init_section_exist(c->videos, c->n_videos);
 
@@ -2156,6 +2483,7 @@ static void recheck_discard_flags(AVFormatContext *s, struct representation **p,
         } else if (!needed && pls->ctx) {
             close_demux_for_component(pls);
             ff_format_io_close(pls->parent, &pls->input);
+            release_prefetch(s->priv_data, pls);
             av_log(s, AV_LOG_INFO, "No longer receiving stream_index %d\n", pls->stream_index);
         }
     }
@@ -2217,6 +2545,7 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
             cur->cur_seg_offset = 0;
             cur->init_sec_buf_read_offset = 0;
             ff_format_io_close(cur->parent, &cur->input);
+            ff_segment_prefetch_free(s, &cur->cur_prefetch);
             ret = reopen_demux_for_component(s, cur);
             cur->is_restart_needed = 0;
         }
@@ -2227,9 +2556,17 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
 static int dash_close(AVFormatContext *s)
 {
     DASHContext *c = s->priv_data;
+
+    av_log(s, AV_LOG_VERBOSE, "Statistics: %d fragments (%d prefetched), %"PRId64" bytes read, "
+           "%"PRId64" us waiting for data, %d init section cache hits, %d misses\n",
+           c->nb_fragments, c->nb_prefetched, c->bytes_read, c->wait_time,
+           c->init_cache_hits, c->init_cache_misses);
+
+    ff_segment_prefetch_uninit(&c->prefetch);
     free_audio_list(c);
     free_video_list(c);
     free_subtitle_list(c);
+    free_init_cache(c);
     av_dict_free(&c->avio_opts);
     av_freep(&c->base_url);
     return 0;
@@ -2256,6 +2593,7 @@ static int dash_seek(AVFormatContext *s, struct representation *pls, int64_t see
     }
 
     ff_format_io_close(pls->parent, &pls->input);
+    release_prefetch(s->priv_data, pls);
 
     // find the nearest fragment
     if (pls->n_timelines > 0 && pls->fragment_timescale > 0) {
@@ -2354,6 +2692,12 @@ static const AVOption dash_options[] = {
         {.str = "aac,m4a,m4s,m4v,mov,mp4,webm,ts"},
         INT_MIN, INT_MAX, FLAGS},
     { "cenc_decryption_key", "Media decryption key (hex)", OFFSET(cenc_decryption_key), AV_OPT_TYPE_STRING, {.str = NULL}, INT_MIN, INT_MAX, .flags = FLAGS },
+    {"prefetch_segments", "Number of fragments per representation to fetch ahead concurrently, 0 = disable",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 32, FLAGS},
+    {"prefetch_size", "Maximum number of bytes of each prefetched fragment to keep in memory",
+        OFFSET(prefetch_size), AV_OPT_TYPE_INT, {.i64 = 16 * 1024 * 1024}, 0, INT_MAX, FLAGS},
+    {"init_cache_size", "Maximum number of bytes of initialization sections to cache",
+        OFFSET(init_cache_size), AV_OPT_TYPE_INT, {.i64 = 8 * 1024 * 1024}, 0, INT_MAX, FLAGS},
     {NULL}
 };
 
@@ -1323,7 +1323,8 @@ static int read_frame_internal(AVFormatContext *s, AVPacket *pkt)
         if (!sti->need_parsing || !sti->parser) {
             /* no parsing needed: we just output the packet as is */
             compute_pkt_fields(s, st, NULL, pkt, AV_NOPTS_VALUE, AV_NOPTS_VALUE);
-            if ((s->iformat->flags & AVFMT_GENERIC_INDEX) &&
+            if ((s->iformat->flags & AVFMT_GENERIC_INDEX ||
+                 si->generic_index && pkt->pos >= 0) &&
                 (pkt->flags & AV_PKT_FLAG_KEY) && pkt->dts != AV_NOPTS_VALUE) {
                 ff_reduce_index(s, st->index);
                 av_add_index_entry(st, pkt->pos, pkt->dts,
@@ -1518,7 +1519,9 @@ int av_read_frame(AVFormatContext *s, AVPacket *pkt)
 
 return_packet:
     st = s->streams[pkt->stream_index];
-    if ((s->iformat->flags & AVFMT_GENERIC_INDEX) && pkt->flags & AV_PKT_FLAG_KEY) {
+    if ((s->iformat->flags & AVFMT_GENERIC_INDEX ||
+         si->generic_index && pkt->pos >= 0 && pkt->dts != AV_NOPTS_VALUE) &&
+        pkt->flags & AV_PKT_FLAG_KEY) {
         ff_reduce_index(s, st->index);
         av_add_index_entry(st, pkt->pos, pkt->dts, 0, 0, AVINDEX_KEYFRAME);
     }
@@ -179,6 +179,45 @@ void ff_rescale_interval(AVRational tb_in, AVRational tb_out,
 
 void avpriv_stream_set_need_parsing(AVStream *st, enum AVStreamParseType type);
 
+typedef struct FFSeekIndexStream {
+    int id;                 ///< AVStream.id of the stream
+    AVIndexEntry *entries;  ///< NULL once added to the stream
+    int nb_entries;
+} FFSeekIndexStream;
+
+/**
+ * Index entries loaded from a seek index file, waiting for the streams they
+ * belong to, which demuxers like MPEG-PS only create while reading packets.
+ */
+typedef struct FFSeekIndex {
+    FFSeekIndexStream *streams;
+    int nb_streams;
+    int nb_pending;         ///< number of streams not found yet
+    int nb_entries;         ///< total number of entries loaded
+} FFSeekIndex;
+
+/**
+ * Load a seek index file written by ff_seek_index_write() for the input of s.
+ * An index written for a file of a different size is rejected.
+ *
+ * @return 0 on success, a negative AVERROR if there is no usable index
+ */
+int ff_seek_index_read(AVFormatContext *s, FFSeekIndex *idx, const char *url);
+
+/**
+ * Add the loaded entries to the index of the streams with matching ids.
+ * Cheap once all streams were found; demuxers call it for every packet.
+ */
+void ff_seek_index_apply(AVFormatContext *s, FFSeekIndex *idx);
+
+/**
+ * Write the index entries of all streams of s to a seek index file, if there
+ * are more than were loaded by ff_seek_index_read().
+ */
+int ff_seek_index_write(AVFormatContext *s, FFSeekIndex *idx, const char *url);
+
+void ff_seek_index_free(FFSeekIndex *idx);
+
 /**
  * Add a new chapter.
  *
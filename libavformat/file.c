@@ -19,6 +19,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#define _DEFAULT_SOURCE /* syscall() and MAP_POPULATE for io_uring */
+
 #include "config_components.h"
 
 #include "libavutil/avstring.h"
@@ -41,6 +43,17 @@
 #include "os_support.h"
 #include "url.h"
 
+#define USE_IO_URING (HAVE_LINUX_IO_URING_H && HAVE_MMAP)
+
+#if USE_IO_URING
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "libavutil/mem.h"
+#endif
+
 /* Some systems may not have S_ISFIFO */
 #ifndef S_ISFIFO
 #  ifdef S_IFIFO
@@ -70,6 +83,41 @@
 
 /* standard file protocol */
 
+#if USE_IO_URING
+#define URING_BLOCK_SIZE (1 << 18)
+
+typedef struct FileUringBlock {
+    uint8_t *data;
+    struct iovec iov;
+    int len;                ///< result of the read, valid once it is no longer pending
+    int pending;
+} FileUringBlock;
+
+/**
+ * Read-ahead through io_uring: up to nb_blocks consecutive blocks of the
+ * file are read asynchronously while the caller consumes the first one.
+ */
+typedef struct FileUring {
+    int fd;
+    uint8_t *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    FileUringBlock *blocks;
+    int nb_blocks;
+    int first;              ///< block holding the data at pos
+    int nb_queued;          ///< blocks queued from first on, in file order
+    int in_flight;
+    int buf_pos;            ///< offset of pos in the first block
+    int64_t pos;            ///< position of the next byte returned by file_read()
+    int64_t next_pos;       ///< file offset of the next block to queue
+} FileUring;
+#endif
+
 typedef struct FileContext {
     const AVClass *class;
     int fd;
@@ -77,9 +125,13 @@ typedef struct FileContext {
     int blocksize;
     int follow;
     int seekable;
+    int io_uring;
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
+#if USE_IO_URING
+    FileUring ring;
+#endif
 } FileContext;
 
 static const AVOption file_options[] = {
@@ -87,6 +139,7 @@ static const AVOption file_options[] = {
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "io_uring", "number of 256 KiB blocks to read ahead through io_uring, 0 to use read()", offsetof(FileContext, io_uring), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 64, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -109,11 +162,238 @@ static const AVClass pipe_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+#if USE_IO_URING
+static int uring_enter(FileUring *r, unsigned to_submit, unsigned min_complete)
+{
+    int ret;
+    do {
+        ret = syscall(__NR_io_uring_enter, r->fd, to_submit, min_complete,
+                      min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 ? AVERROR(errno) : ret;
+}
+
+static void uring_reap(FileUring *r)
+{
+    unsigned head = *r->cq_head;
+    unsigned tail = atomic_load_explicit((atomic_uint *)r->cq_tail, memory_order_acquire);
+
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        FileUringBlock *b = &r->blocks[cqe->user_data];
+        b->len     = cqe->res;
+        b->pending = 0;
+        r->in_flight--;
+    }
+    atomic_store_explicit((atomic_uint *)r->cq_head, head, memory_order_release);
+}
+
+/* Queue reads for all the blocks not holding data yet. */
+static int uring_fill(FileContext *c, FileUring *r)
+{
+    unsigned tail = *r->sq_tail;
+    int ret, n = 0;
+
+    while (r->nb_queued < r->nb_blocks) {
+        int idx = (r->first + r->nb_queued) % r->nb_blocks;
+        FileUringBlock *b = &r->blocks[idx];
+        unsigned sq_idx = tail & *r->sq_mask;
+        struct io_uring_sqe *sqe = &r->sqes[sq_idx];
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode    = IORING_OP_READV;
+        sqe->fd        = c->fd;
+        sqe->addr      = (uintptr_t)&b->iov;
+        sqe->len       = 1;
+        sqe->off       = r->next_pos;
+        sqe->user_data = idx;
+        r->sq_array[sq_idx] = sq_idx;
+        tail++;
+
+        b->pending   = 1;
+        r->next_pos += URING_BLOCK_SIZE;
+        r->nb_queued++;
+        r->in_flight++;
+        n++;
+    }
+    if (!n)
+        return 0;
+    atomic_store_explicit((atomic_uint *)r->sq_tail, tail, memory_order_release);
+
+    while (n > 0) {
+        ret = uring_enter(r, n, 0);
+        if (ret < 0)
+            return ret;
+        n -= ret;
+    }
+    return 0;
+}
+
+/* Wait for all reads and drop the queued blocks, so that reading restarts at pos. */
+static int uring_reset(FileUring *r)
+{
+    int ret;
+
+    while (r->in_flight) {
+        if ((ret = uring_enter(r, 0, 1)) < 0)
+            return ret;
+        uring_reap(r);
+    }
+    r->nb_queued = 0;
+    r->buf_pos   = 0;
+    r->next_pos  = r->pos;
+    return 0;
+}
+
+static int uring_read(FileContext *c, unsigned char *buf, int size)
+{
+    FileUring *r = &c->ring;
+    FileUringBlock *b;
+    int ret;
+
+    if ((ret = uring_fill(c, r)) < 0)
+        return ret;
+
+    b = &r->blocks[r->first];
+    while (b->pending) {
+        if ((ret = uring_enter(r, 0, 1)) < 0)
+            return ret;
+        uring_reap(r);
+    }
+
+    if (b->len <= 0) {
+        int err = b->len;
+        if ((ret = uring_reset(r)) < 0)
+            return ret;
+        if (err < 0)
+            return AVERROR(-err);
+        return c->follow ? AVERROR(EAGAIN) : AVERROR_EOF;
+    }
+
+    size = FFMIN(size, b->len - r->buf_pos);
+    memcpy(buf, b->data + r->buf_pos, size);
+    r->buf_pos += size;
+    r->pos     += size;
+
+    if (r->buf_pos == b->len) {
+        /* After a short read, the blocks queued behind are at the wrong
+         * offsets; this only happens at the end of the file. */
+        if (b->len < URING_BLOCK_SIZE) {
+            if ((ret = uring_reset(r)) < 0)
+                return ret;
+        } else {
+            r->first = (r->first + 1) % r->nb_blocks;
+            r->nb_queued--;
+            r->buf_pos = 0;
+        }
+    }
+    return size;
+}
+
+static void uring_uninit(FileUring *r)
+{
+    if (r->blocks) {
+        /* The kernel may still write into the blocks */
+        if (uring_reset(r) < 0)
+            return;
+        for (int i = 0; i < r->nb_blocks; i++)
+            av_free(r->blocks[i].data);
+        av_freep(&r->blocks);
+    }
+    if (r->sqes)
+        munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring && r->cq_ring != r->sq_ring)
+        munmap(r->cq_ring, r->cq_ring_size);
+    if (r->sq_ring)
+        munmap(r->sq_ring, r->sq_ring_size);
+    if (r->fd > 0)
+        close(r->fd);
+    memset(r, 0, sizeof(*r));
+}
+
+static int uring_init(FileContext *c, int nb_blocks, int64_t pos)
+{
+    FileUring *r = &c->ring;
+    struct io_uring_params p = { 0 };
+    void *ptr;
+    int ret;
+
+    ret = syscall(__NR_io_uring_setup, nb_blocks, &p);
+    if (ret < 0)
+        return AVERROR(errno);
+    r->fd = ret;
+
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        r->sq_ring_size = r->cq_ring_size = FFMAX(r->sq_ring_size, r->cq_ring_size);
+
+    ptr = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (ptr == MAP_FAILED)
+        goto fail;
+    r->sq_ring = ptr;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ring = r->sq_ring;
+    } else {
+        ptr = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (ptr == MAP_FAILED)
+            goto fail;
+        r->cq_ring = ptr;
+    }
+
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ptr = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (ptr == MAP_FAILED)
+        goto fail;
+    r->sqes = ptr;
+
+    r->sq_tail  = (unsigned *)(r->sq_ring + p.sq_off.tail);
+    r->sq_mask  = (unsigned *)(r->sq_ring + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(r->sq_ring + p.sq_off.array);
+    r->cq_head  = (unsigned *)(r->cq_ring + p.cq_off.head);
+    r->cq_tail  = (unsigned *)(r->cq_ring + p.cq_off.tail);
+    r->cq_mask  = (unsigned *)(r->cq_ring + p.cq_off.ring_mask);
+    r->cqes     = (struct io_uring_cqe *)(r->cq_ring + p.cq_off.cqes);
+
+    r->blocks = av_calloc(nb_blocks, sizeof(*r->blocks));
+    if (!r->blocks) {
+        uring_uninit(r);
+        return AVERROR(ENOMEM);
+    }
+    r->nb_blocks = nb_blocks;
+    for (int i = 0; i < nb_blocks; i++) {
+        FileUringBlock *b = &r->blocks[i];
+        b->data = av_malloc(URING_BLOCK_SIZE);
+        if (!b->data) {
+            uring_uninit(r);
+            return AVERROR(ENOMEM);
+        }
+        b->iov.iov_base = b->data;
+        b->iov.iov_len  = URING_BLOCK_SIZE;
+    }
+    r->pos = r->next_pos = pos;
+    return 0;
+
+fail:
+    ret = AVERROR(errno);
+    uring_uninit(r);
+    return ret;
+}
+#endif /* USE_IO_URING */
+
 static int file_read(URLContext *h, unsigned char *buf, int size)
 {
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+#if USE_IO_URING
+    if (c->ring.blocks)
+        return uring_read(c, buf, size);
+#endif
     ret = read(c->fd, buf, size);
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
@@ -208,7 +488,7 @@ static int file_open(URLContext *h, const char *filename, int flags)
 {
     FileContext *c = h->priv_data;
     int access;
-    int fd;
+    int fd, ret;
     struct stat st;
 
     av_strstart(filename, "file:", &filename);
@@ -232,7 +512,8 @@ static int file_open(URLContext *h, const char *filename, int flags)
         return AVERROR(errno);
     c->fd = fd;
 
-    h->is_streamed = !fstat(fd, &st) && S_ISFIFO(st.st_mode);
+    ret = fstat(fd, &st);
+    h->is_streamed = !ret && S_ISFIFO(st.st_mode);
 
     /* Buffer writes more than the default 32k to improve throughput especially
      * with networked file systems */
@@ -242,6 +523,17 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (c->seekable >= 0)
         h->is_streamed = !c->seekable;
 
+    if (c->io_uring && !ret && S_ISREG(st.st_mode) && !(flags & AVIO_FLAG_WRITE)) {
+#if USE_IO_URING
+        ret = uring_init(c, c->io_uring, 0);
+        if (ret < 0)
+            av_log(h, AV_LOG_WARNING, "Could not set up io_uring (%s), using read()\n",
+                   av_err2str(ret));
+#else
+        av_log(h, AV_LOG_WARNING, "io_uring is not supported by this build, using read()\n");
+#endif
+    }
+
     return 0;
 }
 
@@ -257,6 +549,27 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
         return ret < 0 ? AVERROR(errno) : (S_ISFIFO(st.st_mode) ? 0 : st.st_size);
     }
 
+#if USE_IO_URING
+    if (c->ring.blocks) {
+        FileUring *r = &c->ring;
+        /* The reads do not move the file offset */
+        if (whence == SEEK_CUR) {
+            pos   += r->pos;
+            whence = SEEK_SET;
+        }
+        ret = lseek(c->fd, pos, whence);
+        if (ret < 0)
+            return AVERROR(errno);
+        if (ret != r->pos) {
+            int err = uring_reset(r);
+            if (err < 0)
+                return err;
+            r->pos = r->next_pos = ret;
+        }
+        return ret;
+    }
+#endif
+
     ret = lseek(c->fd, pos, whence);
 
     return ret < 0 ? AVERROR(errno) : ret;
@@ -265,7 +578,11 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
-    int ret = close(c->fd);
+    int ret;
+#if USE_IO_URING
+    uring_uninit(&c->ring);
+#endif
+    ret = close(c->fd);
     return (ret == -1) ? AVERROR(errno) : 0;
 }
 
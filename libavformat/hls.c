@@ -45,6 +45,7 @@
 #include "id3v2.h"
 
 #include "hls_sample_encryption.h"
+#include "segment_prefetch.h"
 
 #define INITIAL_BUFFER_SIZE 32768
 
@@ -105,6 +106,7 @@ struct playlist {
     int input_read_done;
     AVIOContext *input_next;
     int input_next_requested;
+    SegmentPrefetch *cur_prefetch;
     AVFormatContext *parent;
     int index;
     AVFormatContext *ctx;
@@ -225,10 +227,24 @@ typedef struct HLSContext {
     int http_persistent;
     int http_multiple;
     int http_seekable;
+    int prefetch_segments;
+    int prefetch_size;
     AVIOContext *playlist_pb;
     HLSCryptoContext  crypto_ctx;
+    SegmentPrefetchPool prefetch;
 } HLSContext;
 
+/* Drop all segments prefetched for a playlist, including the current one. */
+static void release_prefetch(HLSContext *c, struct playlist *pls)
+{
+    ff_segment_prefetch_free(c->ctx, &pls->cur_prefetch);
+    if (!c->prefetch_segments)
+        return;
+    ff_segment_prefetch_lock(&c->prefetch);
+    ff_segment_prefetch_cancel(&c->prefetch, pls, INT64_MAX);
+    ff_segment_prefetch_unlock(&c->prefetch);
+}
+
 static void free_segment_dynarray(struct segment **segments, int n_segments)
 {
     int i;
@@ -277,6 +293,7 @@ static void free_playlist_list(HLSContext *c)
         pls->input_read_done = 0;
         ff_format_io_close(c->ctx, &pls->input_next);
         pls->input_next_requested = 0;
+        release_prefetch(c, pls);
         if (pls->ctx) {
             pls->ctx->pb = NULL;
             avformat_close_input(&pls->ctx);
@@ -636,13 +653,10 @@ static int open_url_keepalive(AVFormatContext *s, AVIOContext **pb,
 #endif
 }
 
-static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
-                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out)
+static int check_url(AVFormatContext *s, const char *url, int *is_http_out)
 {
     HLSContext *c = s->priv_data;
-    AVDictionary *tmp = NULL;
     const char *proto_name = NULL;
-    int ret;
     int is_http = 0;
 
     if (av_strstart(url, "crypto", NULL)) {
@@ -684,6 +698,21 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
     else if (strcmp(proto_name, "file") || !strncmp(url, "file,", 5))
         return AVERROR_INVALIDDATA;
 
+    *is_http_out = is_http;
+    return 0;
+}
+
+static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
+                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out)
+{
+    HLSContext *c = s->priv_data;
+    AVDictionary *tmp = NULL;
+    int ret;
+    int is_http = 0;
+
+    if ((ret = check_url(s, url, &is_http)) < 0)
+        return ret;
+
     av_dict_copy(&tmp, *opts, 0);
     av_dict_copy(&tmp, opts2, 0);
 
@@ -1064,7 +1093,10 @@ static int read_from_url(struct playlist *pls, struct segment *seg,
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->cur_prefetch)
+        ret = ff_segment_prefetch_read(pls->cur_prefetch, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
@@ -1419,6 +1451,43 @@ static int64_t default_reload_interval(struct playlist *pls)
                           pls->target_duration;
 }
 
+/* Queue the unencrypted segments following the current one that are not
+ * requested yet, and drop the ones we are already past. */
+static void schedule_prefetch(HLSContext *c, struct playlist *pls)
+{
+    int64_t seq_no;
+
+    if (!c->prefetch_segments)
+        return;
+
+    ff_segment_prefetch_lock(&c->prefetch);
+    ff_segment_prefetch_cancel(&c->prefetch, pls, pls->cur_seq_no);
+
+    for (seq_no = pls->cur_seq_no + 1;
+         seq_no <= pls->cur_seq_no + c->prefetch_segments &&
+         seq_no <  pls->start_seq_no + pls->n_segments; seq_no++) {
+        struct segment *seg = pls->segments[seq_no - pls->start_seq_no];
+        SegmentPrefetch *job;
+        int is_http = 0;
+
+        if (seg->key_type != KEY_NONE ||
+            ff_segment_prefetch_find(&c->prefetch, seg->url, seg->url_offset, seg->size))
+            continue;
+
+        job = ff_segment_prefetch_add(&c->prefetch, pls, seq_no, seg->url,
+                                      seg->url_offset, seg->size, c->avio_opts);
+        if (!job)
+            break;
+        /* A rejected url fails like open_url() would, once it is reached. */
+        job->ret = check_url(pls->parent, seg->url, &is_http);
+        if (job->ret < 0)
+            job->state = SEGMENT_PREFETCH_DONE;
+        /* See open_input() for why this is not done for HTTP. */
+        job->seek = !is_http;
+    }
+    ff_segment_prefetch_unlock(&c->prefetch);
+}
+
 static int playlist_needed(struct playlist *pls)
 {
     AVFormatContext *s = pls->parent;
@@ -1478,7 +1547,7 @@ restart:
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if ((!v->input && !v->cur_prefetch) || (c->http_persistent && v->input_read_done)) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1554,6 +1623,12 @@ reload:
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
             ret = 0;
+        } else if ((v->cur_prefetch = ff_segment_prefetch_take(&c->prefetch, seg->url,
+                                                                seg->url_offset, seg->size))) {
+            v->cur_seg_offset = 0;
+            ret = v->cur_prefetch->buf_len || v->cur_prefetch->in ? 0 : v->cur_prefetch->ret;
+            if (ret < 0)
+                ff_segment_prefetch_free(c->ctx, &v->cur_prefetch);
         } else {
             ret = open_input(c, v, seg, &v->input);
         }
@@ -1567,9 +1642,10 @@ reload:
             goto reload;
         }
         just_opened = 1;
+        schedule_prefetch(c, v);
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && v->input) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1579,7 +1655,7 @@ reload:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (c->http_multiple == 1 && !v->input_next_requested && !c->prefetch_segments &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         ret = open_input(c, v, seg, &v->input_next);
         if (ret < 0) {
@@ -1612,7 +1688,11 @@ reload:
 
         return ret;
     }
-    if (c->http_persistent &&
+    if (v->cur_prefetch) {
+        ff_segment_prefetch_free(c->ctx, &v->cur_prefetch);
+        /* anything left in input is an idle persistent connection */
+        v->input_read_done = !!v->input;
+    } else if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
     } else {
@@ -1906,6 +1986,7 @@ static int hls_close(AVFormatContext *s)
     HLSContext *c = s->priv_data;
 
     free_playlist_list(c);
+    ff_segment_prefetch_uninit(&c->prefetch);
     free_variant_list(c);
     free_rendition_list(c);
 
@@ -1939,6 +2020,16 @@ static int hls_read_header(AVFormatContext *s)
        the range header */
     av_dict_set_int(&c->avio_opts, "seekable", c->http_seekable, 0);
 
+    if (c->prefetch_segments) {
+        ret = ff_segment_prefetch_init(&c->prefetch, s, c->prefetch_segments, c->prefetch_size);
+        if (ret < 0) {
+            c->prefetch_segments = 0;
+            if (ret != AVERROR(ENOSYS))
+                return ret;
+            av_log(s, AV_LOG_WARNING, "Segment prefetching requires threads, disabling it\n");
+        }
+    }
+
     if ((ret = parse_playlist(c, s->url, NULL, s->pb)) < 0)
         return ret;
 
@@ -2076,6 +2167,7 @@ static int hls_read_header(AVFormatContext *s)
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next = NULL;
             pls->input_next_requested = 0;
+            release_prefetch(c, pls);
             pls->cur_seg_offset = 0;
             pls->cur_init_section = NULL;
             /* Reset EOF flag */
@@ -2228,6 +2320,7 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
             pls->input_read_done = 0;
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next_requested = 0;
+            release_prefetch(c, pls);
             pls->needed = 0;
             changed = 1;
             av_log(s, AV_LOG_INFO, "No longer receiving playlist %d\n", i);
@@ -2484,6 +2577,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         pls->input_read_done = 0;
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
+        release_prefetch(c, pls);
         av_packet_unref(pls->pkt);
         pb->eof_reached = 0;
         /* Clear any buffered data */
@@ -2547,6 +2641,10 @@ static const AVOption hls_options[] = {
         OFFSET(http_multiple), AV_OPT_TYPE_BOOL, {.i64 = -1}, -1, 1, FLAGS},
     {"http_seekable", "Use HTTP partial requests, 0 = disable, 1 = enable, -1 = auto",
         OFFSET(http_seekable), AV_OPT_TYPE_BOOL, { .i64 = -1}, -1, 1, FLAGS},
+    {"prefetch_segments", "Number of segments to fetch ahead concurrently, 0 = disable",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 32, FLAGS},
+    {"prefetch_size", "Maximum number of bytes of each prefetched segment to keep in memory",
+        OFFSET(prefetch_size), AV_OPT_TYPE_INT, {.i64 = 16 * 1024 * 1024}, 0, INT_MAX, FLAGS},
     {"seg_format_options", "Set options for segment demuxer",
         OFFSET(seg_format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
     {NULL}
@@ -40,6 +40,8 @@
 #include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
 #include "libavutil/log.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadmessage.h"
 #include "libavutil/time.h"
 #include "libavutil/time_internal.h"
 
@@ -193,6 +195,20 @@ typedef struct ClosedCaptionsStream {
     const char *language;   /* closed captions language */
 } ClosedCaptionsStream;
 
+/**
+ * File to write after a segment has been cut, handled in order by the
+ * finalization thread.
+ */
+typedef struct HLSFinalizeJob {
+    char *filename;         ///< file to write buf to, NULL to only rename
+    AVDictionary *options;
+    uint8_t *buf;
+    int size;
+    int write_styp;
+    char *rename_from;      ///< file to rename once written, if any
+    char *rename_to;
+} HLSFinalizeJob;
+
 typedef struct HLSContext {
     const AVClass *class;  // Class for private options.
     int64_t start_sequence;
@@ -257,6 +273,14 @@ typedef struct HLSContext {
     char *headers;
     int has_default_key; /* has DEFAULT field of var_stream_map */
     int has_video_m3u8; /* has video stream m3u8 list */
+
+    int async_finalize; /* number of segments which can wait for finalization */
+#if HAVE_THREADS
+    AVThreadMessageQueue *finalize_queue;
+    pthread_t finalize_thread;
+#endif
+    int finalize_thread_started;
+    int finalize_ret;
 } HLSContext;
 
 static int strftime_expand(const char *fmt, char **dest)
@@ -558,6 +582,247 @@ static void reflush_dynbuf(VariantStream *vs, int *range_length)
     avio_write(vs->out, vs->temp_buffer, *range_length);
 }
 
+static void hls_free_finalize_job(HLSFinalizeJob **pjob)
+{
+    HLSFinalizeJob *job = *pjob;
+
+    if (!job)
+        return;
+    av_freep(&job->filename);
+    av_dict_free(&job->options);
+    av_freep(&job->buf);
+    av_freep(&job->rename_from);
+    av_freep(&job->rename_to);
+    av_freep(pjob);
+}
+
+static int hls_finalize_write(AVFormatContext *s, HLSFinalizeJob *job)
+{
+    AVDictionary *options = NULL;
+    AVIOContext *pb = NULL;
+    int ret;
+
+    if ((ret = av_dict_copy(&options, job->options, 0)) < 0)
+        return ret;
+    ret = hlsenc_io_open(s, &pb, job->filename, &options);
+    av_dict_free(&options);
+    if (ret < 0)
+        return ret;
+    if (job->write_styp)
+        write_styp(pb);
+    avio_write(pb, job->buf, job->size);
+    /* Also returns any write error */
+    return ff_format_io_close(s, &pb);
+}
+
+static int hls_finalize(AVFormatContext *s, HLSFinalizeJob *job)
+{
+    HLSContext *hls = s->priv_data;
+    int ret;
+
+    if (job->filename) {
+        ret = hls_finalize_write(s, job);
+        if (ret < 0) {
+            av_log(s, AV_LOG_WARNING, "upload of '%s' failed,"
+                   " will retry with a new http session.\n", job->filename);
+            ret = hls_finalize_write(s, job);
+        }
+        if (ret < 0) {
+            av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
+                   "Failed to write file '%s'\n", job->filename);
+            if (!hls->ignore_io_errors)
+                return ret;
+        }
+    }
+    if (job->rename_from)
+        ff_rename(job->rename_from, job->rename_to, s);
+
+    return 0;
+}
+
+#if HAVE_THREADS
+static void *hls_finalize_thread(void *arg)
+{
+    AVFormatContext *s = arg;
+    HLSContext *hls = s->priv_data;
+    HLSFinalizeJob *job;
+    int ret;
+
+    ff_thread_setname("hls-finalize");
+
+    while ((ret = av_thread_message_queue_recv(hls->finalize_queue, &job, 0)) >= 0) {
+        ret = hls_finalize(s, job);
+        hls_free_finalize_job(&job);
+        if (ret < 0)
+            break;
+    }
+
+    hls->finalize_ret = ret == AVERROR_EOF ? 0 : ret;
+    av_thread_message_queue_set_err_send(hls->finalize_queue, ret);
+    return NULL;
+}
+
+static int hls_start_finalize_thread(AVFormatContext *s)
+{
+    HLSContext *hls = s->priv_data;
+    int ret;
+
+    ret = av_thread_message_queue_alloc(&hls->finalize_queue, hls->async_finalize,
+                                        sizeof(HLSFinalizeJob *));
+    if (ret < 0)
+        return ret;
+
+    ret = pthread_create(&hls->finalize_thread, NULL, hls_finalize_thread, s);
+    if (ret) {
+        av_thread_message_queue_free(&hls->finalize_queue);
+        return AVERROR(ret);
+    }
+    hls->finalize_thread_started = 1;
+    return 0;
+}
+
+static int hls_stop_finalize_thread(AVFormatContext *s)
+{
+    HLSContext *hls = s->priv_data;
+    HLSFinalizeJob *job;
+
+    if (!hls->finalize_thread_started)
+        return 0;
+
+    /* Let the thread write out what is still queued */
+    av_thread_message_queue_set_err_recv(hls->finalize_queue, AVERROR_EOF);
+    pthread_join(hls->finalize_thread, NULL);
+    hls->finalize_thread_started = 0;
+    /* Jobs left behind by a failure are only released */
+    while (av_thread_message_queue_recv(hls->finalize_queue, &job,
+                                        AV_THREAD_MESSAGE_NONBLOCK) >= 0)
+        hls_free_finalize_job(&job);
+    av_thread_message_queue_free(&hls->finalize_queue);
+    return hls->finalize_ret;
+}
+
+static int hls_queue_finalize_job(AVFormatContext *s, HLSFinalizeJob *job)
+{
+    HLSContext *hls = s->priv_data;
+    int ret = av_thread_message_queue_send(hls->finalize_queue, &job, 0);
+
+    if (ret < 0)
+        hls_free_finalize_job(&job);
+    return ret;
+}
+#else
+static int hls_start_finalize_thread(AVFormatContext *s)
+{
+    return AVERROR(ENOSYS);
+}
+
+static int hls_stop_finalize_thread(AVFormatContext *s)
+{
+    return 0;
+}
+
+static int hls_queue_finalize_job(AVFormatContext *s, HLSFinalizeJob *job)
+{
+    hls_free_finalize_job(&job);
+    return AVERROR(ENOSYS);
+}
+#endif
+
+/**
+ * Queue the data buffered in pb to be written to filename, and renamed
+ * to final_filename if not NULL.
+ */
+static int hls_queue_file(AVFormatContext *s, AVIOContext **pb,
+                          const char *filename, const char *final_filename)
+{
+    HLSContext *hls = s->priv_data;
+    HLSFinalizeJob *job;
+
+    if (!*pb)
+        return 0;
+
+    job = av_mallocz(sizeof(*job));
+    if (!job) {
+        ffio_free_dyn_buf(pb);
+        return AVERROR(ENOMEM);
+    }
+    job->size = avio_close_dyn_buf(*pb, &job->buf);
+    *pb = NULL;
+    job->filename = av_strdup(filename);
+    if (!job->filename)
+        goto fail;
+    if (final_filename) {
+        job->rename_from = av_strdup(filename);
+        job->rename_to   = av_strdup(final_filename);
+        if (!job->rename_from || !job->rename_to)
+            goto fail;
+    }
+    set_http_options(s, &job->options, hls);
+
+    return hls_queue_finalize_job(s, job);
+fail:
+    hls_free_finalize_job(&job);
+    return AVERROR(ENOMEM);
+}
+
+/**
+ * Queue the segment buffered in the variant stream muxer to be written
+ * to filename, and the muxer to continue in a new buffer.
+ */
+static int hls_queue_segment(AVFormatContext *s, VariantStream *vs, const char *filename,
+                             AVDictionary *options, int use_temp_file)
+{
+    HLSContext *hls = s->priv_data;
+    AVFormatContext *oc = vs->avf;
+    HLSFinalizeJob *job;
+    int ret;
+
+    job = av_mallocz(sizeof(*job));
+    if (!job)
+        return AVERROR(ENOMEM);
+
+    av_write_frame(oc, NULL); /* Flush any buffered data */
+    job->size = avio_close_dyn_buf(oc->pb, &job->buf);
+    oc->pb = NULL;
+    if ((ret = avio_open_dyn_buf(&oc->pb)) < 0)
+        goto fail;
+
+    ret = AVERROR(ENOMEM);
+    job->filename = av_strdup(filename);
+    if (!job->filename || av_dict_copy(&job->options, options, 0) < 0)
+        goto fail;
+    job->write_styp = hls->segment_type == SEGMENT_TYPE_FMP4;
+
+    if (use_temp_file) {
+        /* The segment is renamed by the finalization thread, its final
+         * name is used from now on. */
+        job->rename_from = av_strdup(oc->url);
+        oc->url[strlen(oc->url) - 4] = '\0';
+        job->rename_to   = av_strdup(oc->url);
+        if (!job->rename_from || !job->rename_to)
+            goto fail;
+    }
+
+    return hls_queue_finalize_job(s, job);
+fail:
+    hls_free_finalize_job(&job);
+    return ret;
+}
+
+/**
+ * Open a playlist for writing, in memory if it is to be written out by
+ * the finalization thread.
+ */
+static int hls_open_playlist(AVFormatContext *s, AVIOContext **pb, const char *filename,
+                             AVDictionary **options)
+{
+    HLSContext *hls = s->priv_data;
+
+    if (hls->finalize_thread_started)
+        return avio_open_dyn_buf(pb);
+    return hlsenc_io_open(s, pb, filename, options);
+}
+
 #if HAVE_DOS_PATHS
 #define SEPARATOR '\\'
 #else
@@ -1058,6 +1323,27 @@ static void sls_flag_file_rename(HLSContext *hls, VariantStream *vs, char *old_f
     }
 }
 
+static int hls_queue_sls_rename(AVFormatContext *s, VariantStream *vs, char *old_filename)
+{
+    HLSContext *hls = s->priv_data;
+    HLSFinalizeJob *job;
+
+    if (!(hls->flags & (HLS_SECOND_LEVEL_SEGMENT_SIZE | HLS_SECOND_LEVEL_SEGMENT_DURATION)) ||
+        !strlen(vs->current_segment_final_filename_fmt))
+        return 0;
+
+    job = av_mallocz(sizeof(*job));
+    if (!job)
+        return AVERROR(ENOMEM);
+    job->rename_from = av_strdup(old_filename);
+    job->rename_to   = av_strdup(vs->avf->url);
+    if (!job->rename_from || !job->rename_to) {
+        hls_free_finalize_job(&job);
+        return AVERROR(ENOMEM);
+    }
+    return hls_queue_finalize_job(s, job);
+}
+
 static int sls_flag_use_localtime_filename(AVFormatContext *oc, HLSContext *c, VariantStream *vs)
 {
     if (c->flags & HLS_SECOND_LEVEL_SEGMENT_INDEX) {
@@ -1400,7 +1686,7 @@ static int create_master_playlist(AVFormatContext *s,
 
     set_http_options(s, &options, hls);
     snprintf(temp_filename, sizeof(temp_filename), use_temp_file ? "%s.tmp" : "%s", hls->master_m3u8_url);
-    ret = hlsenc_io_open(s, &hls->m3u8_out, temp_filename, &options);
+    ret = hls_open_playlist(s, &hls->m3u8_out, temp_filename, &options);
     av_dict_free(&options);
     if (ret < 0) {
         av_log(s, AV_LOG_ERROR, "Failed to open master play list file '%s'\n",
@@ -1525,6 +1811,11 @@ static int create_master_playlist(AVFormatContext *s,
 fail:
     if (ret >=0)
         hls->master_m3u8_created = 1;
+    if (hls->finalize_thread_started) {
+        int err = hls_queue_file(s, &hls->m3u8_out, temp_filename,
+                                 use_temp_file ? hls->master_m3u8_url : NULL);
+        return ret < 0 ? ret : err;
+    }
     hlsenc_io_close(s, &hls->m3u8_out, temp_filename);
     if (use_temp_file)
         ff_rename(temp_filename, hls->master_m3u8_url, s);
@@ -1579,7 +1870,7 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
 
     set_http_options(s, &options, hls);
     snprintf(temp_filename, sizeof(temp_filename), use_temp_file ? "%s.tmp" : "%s", vs->m3u8_name);
-    if ((ret = hlsenc_io_open(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename, &options)) < 0) {
+    if ((ret = hls_open_playlist(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename, &options)) < 0) {
         if (hls->ignore_io_errors)
             ret = 0;
         goto fail;
@@ -1635,7 +1926,7 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
 
     if (vs->vtt_m3u8_name) {
         snprintf(temp_vtt_filename, sizeof(temp_vtt_filename), use_temp_file ? "%s.tmp" : "%s", vs->vtt_m3u8_name);
-        if ((ret = hlsenc_io_open(s, &hls->sub_m3u8_out, temp_vtt_filename, &options)) < 0) {
+        if ((ret = hls_open_playlist(s, &hls->sub_m3u8_out, temp_vtt_filename, &options)) < 0) {
             if (hls->ignore_io_errors)
                 ret = 0;
             goto fail;
@@ -1658,15 +1949,26 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
 
 fail:
     av_dict_free(&options);
-    ret = hlsenc_io_close(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename);
-    if (ret < 0) {
-        return ret;
-    }
-    hlsenc_io_close(s, &hls->sub_m3u8_out, vs->vtt_m3u8_name);
-    if (use_temp_file) {
-        ff_rename(temp_filename, vs->m3u8_name, s);
-        if (vs->vtt_m3u8_name)
-            ff_rename(temp_vtt_filename, vs->vtt_m3u8_name, s);
+    if (hls->finalize_thread_started) {
+        int err  = hls_queue_file(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename,
+                                  use_temp_file ? vs->m3u8_name : NULL);
+        int err2 = hls_queue_file(s, &hls->sub_m3u8_out, temp_vtt_filename,
+                                  use_temp_file ? vs->vtt_m3u8_name : NULL);
+        if (ret >= 0)
+            ret = err < 0 ? err : err2;
+        if (ret < 0)
+            return ret;
+    } else {
+        ret = hlsenc_io_close(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename);
+        if (ret < 0) {
+            return ret;
+        }
+        hlsenc_io_close(s, &hls->sub_m3u8_out, vs->vtt_m3u8_name);
+        if (use_temp_file) {
+            ff_rename(temp_filename, vs->m3u8_name, s);
+            if (vs->vtt_m3u8_name)
+                ff_rename(temp_vtt_filename, vs->vtt_m3u8_name, s);
+        }
     }
     if (ret >= 0 && hls->master_pl_name)
         if (create_master_playlist(s, vs) < 0)
@@ -2562,38 +2864,47 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
 
                 set_http_options(s, &options, hls);
 
-                ret = hlsenc_io_open(s, &vs->out, filename, &options);
-                if (ret < 0) {
-                    av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
-                           "Failed to open file '%s'\n", filename);
-                    av_freep(&filename);
-                    av_dict_free(&options);
-                    return hls->ignore_io_errors ? 0 : ret;
-                }
-                if (hls->segment_type == SEGMENT_TYPE_FMP4) {
-                    write_styp(vs->out);
-                }
-                ret = flush_dynbuf(vs, &range_length);
-                if (ret < 0) {
-                    av_freep(&filename);
-                    av_dict_free(&options);
-                    return ret;
-                }
-                ret = hlsenc_io_close(s, &vs->out, filename);
-                if (ret < 0) {
-                    av_log(s, AV_LOG_WARNING, "upload segment failed,"
-                           " will retry with a new http session.\n");
-                    ff_format_io_close(s, &vs->out);
+                if (hls->finalize_thread_started) {
+                    ret = hls_queue_segment(s, vs, filename, options, use_temp_file);
+                    if (ret < 0) {
+                        av_freep(&filename);
+                        av_dict_free(&options);
+                        return ret;
+                    }
+                } else {
                     ret = hlsenc_io_open(s, &vs->out, filename, &options);
-                    reflush_dynbuf(vs, &range_length);
+                    if (ret < 0) {
+                        av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
+                               "Failed to open file '%s'\n", filename);
+                        av_freep(&filename);
+                        av_dict_free(&options);
+                        return hls->ignore_io_errors ? 0 : ret;
+                    }
+                    if (hls->segment_type == SEGMENT_TYPE_FMP4) {
+                        write_styp(vs->out);
+                    }
+                    ret = flush_dynbuf(vs, &range_length);
+                    if (ret < 0) {
+                        av_freep(&filename);
+                        av_dict_free(&options);
+                        return ret;
+                    }
                     ret = hlsenc_io_close(s, &vs->out, filename);
+                    if (ret < 0) {
+                        av_log(s, AV_LOG_WARNING, "upload segment failed,"
+                               " will retry with a new http session.\n");
+                        ff_format_io_close(s, &vs->out);
+                        ret = hlsenc_io_open(s, &vs->out, filename, &options);
+                        reflush_dynbuf(vs, &range_length);
+                        ret = hlsenc_io_close(s, &vs->out, filename);
+                    }
                 }
                 av_dict_free(&options);
                 av_freep(&vs->temp_buffer);
                 av_freep(&filename);
             }
 
-            if (use_temp_file)
+            if (use_temp_file && !hls->finalize_thread_started)
                 hls_rename_temp_file(s, oc);
         }
 
@@ -2653,7 +2964,15 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
             }
         } else {
             vs->start_pos = new_start_pos;
-            sls_flag_file_rename(hls, vs, old_filename);
+            if (hls->finalize_thread_started) {
+                ret = hls_queue_sls_rename(s, vs, old_filename);
+                if (ret < 0) {
+                    av_freep(&old_filename);
+                    return ret;
+                }
+            } else {
+                sls_flag_file_rename(hls, vs, old_filename);
+            }
             ret = hls_start(s, vs);
         }
         vs->number++;
@@ -2686,6 +3005,8 @@ static void hls_deinit(AVFormatContext *s)
     int i = 0;
     VariantStream *vs = NULL;
 
+    hls_stop_finalize_thread(s);
+
     for (i = 0; i < hls->nb_varstreams; i++) {
         vs = &hls->var_streams[i];
 
@@ -2726,6 +3047,8 @@ static int hls_write_trailer(struct AVFormatContext *s)
     VariantStream *vs = NULL;
     AVDictionary *options = NULL;
     int range_length, byterange_mode;
+    /* Write out the pending segments before the final playlists */
+    int finalize_ret = hls_stop_finalize_thread(s);
 
     for (i = 0; i < hls->nb_varstreams; i++) {
         char *filename = NULL;
@@ -2848,7 +3171,7 @@ failed:
         av_free(old_filename);
     }
 
-    return 0;
+    return finalize_ret;
 }
 
 
@@ -3100,6 +3423,29 @@ static int hls_init(AVFormatContext *s)
         vs->number++;
     }
 
+    if (hls->async_finalize) {
+        if ((hls->flags & HLS_SINGLE_FILE) || hls->max_seg_size > 0 || hls->http_persistent) {
+            av_log(s, AV_LOG_WARNING, "hls_async_finalize is not supported with byte range "
+                   "segments or persistent HTTP connections, disabling it\n");
+            hls->async_finalize = 0;
+        } else if ((hls->flags & HLS_DELETE_SEGMENTS) && hls->max_nb_segments &&
+                   hls->pl_type == PLAYLIST_TYPE_NONE &&
+                   hls->async_finalize >= hls->max_nb_segments + hls->hls_delete_threshold) {
+            /* A segment must be written before it can be deleted */
+            hls->async_finalize = hls->max_nb_segments + hls->hls_delete_threshold - 1;
+            av_log(s, AV_LOG_WARNING, "hls_async_finalize limited to %d by hls_list_size "
+                   "and hls_delete_threshold\n", hls->async_finalize);
+        }
+    }
+    if (hls->async_finalize) {
+        ret = hls_start_finalize_thread(s);
+        if (ret < 0) {
+            av_log(s, AV_LOG_WARNING, "Could not start the finalization thread, "
+                   "segments will be finalized synchronously: %s\n", av_err2str(ret));
+            ret = 0;
+        }
+    }
+
     return ret;
 }
 
@@ -3166,6 +3512,7 @@ static const AVOption options[] = {
     {"http_persistent", "Use persistent HTTP connections", OFFSET(http_persistent), AV_OPT_TYPE_BOOL, {.i64 = 0 }, 0, 1, E },
     {"timeout", "set timeout for socket I/O operations", OFFSET(timeout), AV_OPT_TYPE_DURATION, { .i64 = -1 }, -1, INT_MAX, .flags = E },
     {"ignore_io_errors", "Ignore IO errors for stable long-duration runs with network output", OFFSET(ignore_io_errors), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
+    {"hls_async_finalize", "set the number of segments which can wait for finalization in a separate thread", OFFSET(async_finalize), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, E},
     {"headers", "set custom HTTP headers, can override built in default headers", OFFSET(headers), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
     { NULL },
 };
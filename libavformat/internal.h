@@ -186,6 +186,12 @@ typedef struct FFFormatContext {
      * Contexts and child contexts do not contain a metadata option
      */
     int metafree;
+
+    /**
+     * Add keyframes to the index while reading, as for demuxers with
+     * AVFMT_GENERIC_INDEX. Set by demuxers that build a seek index file.
+     */
+    int generic_index;
 } FFFormatContext;
 
 static av_always_inline FFFormatContext *ffformatcontext(AVFormatContext *s)
@@ -163,6 +163,29 @@ typedef struct MOVIndexRange {
     int64_t end;
 } MOVIndexRange;
 
+/**
+ * Position of the sample table walk of mov_build_index(), so that the index
+ * of a stream can be built incrementally (lazy_index option).
+ */
+typedef struct MOVIndexBuildState {
+    int pending;                  ///< samples are left to be added to the index
+    unsigned int chunk;           ///< current stco entry
+    unsigned int chunk_sample;    ///< sample within the current chunk
+    unsigned int sample;          ///< current stsz entry
+    unsigned int stts_index;
+    unsigned int stts_sample;
+    unsigned int stsc_index;
+    unsigned int stss_index;
+    unsigned int stps_index;
+    unsigned int rap_group_index;
+    unsigned int rap_group_sample;
+    unsigned int distance;        ///< samples since the last keyframe
+    int key_off;
+    int64_t offset;
+    int64_t dts;
+    uint64_t stream_size;
+} MOVIndexBuildState;
+
 typedef struct MOVStreamContext {
     AVIOContext *pb;
     int pb_is_copied;
@@ -201,6 +224,8 @@ typedef struct MOVStreamContext {
     int64_t current_index;
     MOVIndexRange* index_ranges;
     MOVIndexRange* current_index_range;
+    MOVIndexBuildState index_state;
+    int lazy_index;       ///< index_entries is extended on demand from the sample tables
     unsigned int bytes_per_frame;
     unsigned int samples_per_frame;
     int dv_audio_container;
@@ -286,6 +311,7 @@ typedef struct MOVContext {
     int use_absolute_path;
     int ignore_editlist;
     int advanced_editlist;
+    int lazy_index;
     int ignore_chapters;
     int seek_individually;
     int64_t next_root_atom; ///< offset of the next root atom
@@ -4020,20 +4020,227 @@ static int build_open_gop_key_points(AVStream *st)
     return 0;
 }
 
+#define MOV_INDEX_BATCH_SIZE 4096
+
+static int mov_expand_ctts(MOVStreamContext *sc)
+{
+    MOVCtts *ctts_data_old = sc->ctts_data;
+    unsigned int ctts_count_old = sc->ctts_count;
+    unsigned int i, j;
+
+    // Expand ctts entries such that we have a 1-1 mapping with samples
+    if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
+        return AVERROR(ENOMEM);
+    sc->ctts_count = 0;
+    sc->ctts_allocated_size = 0;
+    sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
+                            sc->sample_count * sizeof(*sc->ctts_data));
+    if (!sc->ctts_data) {
+        av_free(ctts_data_old);
+        return AVERROR(ENOMEM);
+    }
+
+    memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
+
+    for (i = 0; i < ctts_count_old &&
+                sc->ctts_count < sc->sample_count; i++)
+        for (j = 0; j < ctts_data_old[i].count &&
+                    sc->ctts_count < sc->sample_count; j++)
+            add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
+                           &sc->ctts_allocated_size, 1,
+                           ctts_data_old[i].duration);
+    av_free(ctts_data_old);
+    return 0;
+}
+
+/**
+ * Add the samples of the sample tables to the index, continuing from
+ * sc->index_state, until the index has max_entries entries or all samples
+ * were added.
+ */
+static int mov_build_index_samples(MOVContext *mov, AVStream *st, unsigned int max_entries)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+    MOVIndexBuildState *is = &sc->index_state;
+    int rap_group_present = sc->rap_group_count && sc->rap_group;
+
+    if (sc->lazy_index) {
+        /* there are never more entries than samples */
+        size_t size = FFMIN(max_entries, sc->sample_count) * sizeof(*sti->index_entries);
+
+        if (size > sti->index_entries_allocated_size) {
+            AVIndexEntry *entries = av_fast_realloc(sti->index_entries,
+                                                    &sti->index_entries_allocated_size,
+                                                    size);
+            if (!entries) {
+                is->pending = 0;
+                return AVERROR(ENOMEM);
+            }
+            sti->index_entries = entries;
+        }
+    }
+
+    while (is->pending && sti->nb_index_entries < max_entries) {
+        unsigned int sample_size;
+        int keyframe = 0;
+
+        if (is->chunk >= sc->chunk_count) {
+            is->pending = 0;
+            break;
+        }
+        if (!is->chunk_sample) {
+            int64_t next_offset = is->chunk + 1 < sc->chunk_count ? sc->chunk_offsets[is->chunk + 1] : INT64_MAX;
+            is->offset = sc->chunk_offsets[is->chunk];
+            while (mov_stsc_index_valid(is->stsc_index, sc->stsc_count) &&
+                is->chunk + 1 == sc->stsc_data[is->stsc_index + 1].first)
+                is->stsc_index++;
+
+            if (next_offset > is->offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
+                sc->stsc_data[is->stsc_index].count * (int64_t)sc->stsz_sample_size > next_offset - is->offset) {
+                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
+                sc->stsz_sample_size = sc->sample_size;
+            }
+            if (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size) {
+                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
+                sc->stsz_sample_size = sc->sample_size;
+            }
+        }
+        if (is->chunk_sample >= sc->stsc_data[is->stsc_index].count) {
+            is->chunk++;
+            is->chunk_sample = 0;
+            continue;
+        }
+
+        if (is->sample >= sc->sample_count) {
+            av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
+            is->pending = 0;
+            return AVERROR_INVALIDDATA;
+        }
+
+        if (!sc->keyframe_absent && (!sc->keyframe_count || is->sample+is->key_off == sc->keyframes[is->stss_index])) {
+            keyframe = 1;
+            if (is->stss_index + 1 < sc->keyframe_count)
+                is->stss_index++;
+        } else if (sc->stps_count && is->sample+is->key_off == sc->stps_data[is->stps_index]) {
+            keyframe = 1;
+            if (is->stps_index + 1 < sc->stps_count)
+                is->stps_index++;
+        }
+        if (rap_group_present && is->rap_group_index < sc->rap_group_count) {
+            if (sc->rap_group[is->rap_group_index].index > 0)
+                keyframe = 1;
+            if (++is->rap_group_sample == sc->rap_group[is->rap_group_index].count) {
+                is->rap_group_sample = 0;
+                is->rap_group_index++;
+            }
+        }
+        if (sc->keyframe_absent
+            && !sc->stps_count
+            && !rap_group_present
+            && (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || (is->chunk==0 && is->chunk_sample==0)))
+             keyframe = 1;
+        if (keyframe)
+            is->distance = 0;
+        sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[is->sample];
+        if (sc->pseudo_stream_id == -1 ||
+           sc->stsc_data[is->stsc_index].id - 1 == sc->pseudo_stream_id) {
+            AVIndexEntry *e;
+            if (sample_size > 0x3FFFFFFF) {
+                av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sample_size);
+                is->pending = 0;
+                return AVERROR_INVALIDDATA;
+            }
+            e = &sti->index_entries[sti->nb_index_entries++];
+            e->pos = is->offset;
+            e->timestamp = is->dts;
+            e->size = sample_size;
+            e->min_distance = is->distance;
+            e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
+            av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, sample %u, offset %"PRIx64", dts %"PRId64", "
+                    "size %u, distance %u, keyframe %d\n", st->index, is->sample,
+                    is->offset, is->dts, sample_size, is->distance, keyframe);
+            if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries < 100)
+                ff_rfps_add_frame(mov->fc, st, is->dts);
+        }
+
+        is->offset += sample_size;
+        is->stream_size += sample_size;
+
+        is->dts += sc->stts_data[is->stts_index].duration;
+
+        is->distance++;
+        is->stts_sample++;
+        is->sample++;
+        is->chunk_sample++;
+        if (is->stts_index + 1 < sc->stts_count && is->stts_sample == sc->stts_data[is->stts_index].count) {
+            is->stts_sample = 0;
+            is->stts_index++;
+        }
+    }
+
+    if (sc->lazy_index && !is->pending) {
+        /* The sample tables are only kept around for the lazy build. */
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stts_data);
+        av_freep(&sc->stps_data);
+        av_freep(&sc->rap_group);
+    }
+
+    return 0;
+}
+
+/**
+ * Make sure the index of a lazily indexed stream has an entry for the given
+ * sample, if the stream has that many samples.
+ */
+static void mov_extend_index(MOVContext *mov, AVStream *st, unsigned int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (sc->index_state.pending && sample >= ffstream(st)->nb_index_entries)
+        mov_build_index_samples(mov, st, FFMAX(sample + 1, ffstream(st)->nb_index_entries + MOV_INDEX_BATCH_SIZE));
+}
+
+/**
+ * Turn a lazily indexed stream into a regular one, with the full index and
+ * one ctts entry per sample, as needed to merge fragments into the index.
+ */
+static int mov_finish_lazy_index(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int ret;
+
+    if (!sc->lazy_index)
+        return 0;
+
+    ret = mov_build_index_samples(mov, st, UINT_MAX);
+    sc->lazy_index = 0;
+    if (ret < 0)
+        return ret;
+    if (sc->ctts_data)
+        return mov_expand_ctts(sc);
+    return 0;
+}
+
 static void mov_build_index(MOVContext *mov, AVStream *st)
 {
     MOVStreamContext *sc = st->priv_data;
     FFStream *const sti = ffstream(st);
     int64_t current_offset;
     int64_t current_dts = 0;
-    unsigned int stts_index = 0;
     unsigned int stsc_index = 0;
-    unsigned int stss_index = 0;
-    unsigned int stps_index = 0;
-    unsigned int i, j;
-    uint64_t stream_size = 0;
-    MOVCtts *ctts_data_old = sc->ctts_data;
-    unsigned int ctts_count_old = sc->ctts_count;
+    unsigned int i;
+    /* only use old uncompressed audio chunk demuxing when stts specifies it */
+    int chunk_demuxing = st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
+                         sc->stts_count == 1 && sc->stts_data[0].duration == 1;
+    /* the lazy index can not be rewritten for edit lists, so it is only
+     * used with the simple edit list handling */
+    int lazy = mov->lazy_index && !chunk_demuxing &&
+               sc->sample_count > MOV_INDEX_BATCH_SIZE && !sti->nb_index_entries;
+    int advanced_editlist = mov->advanced_editlist && !lazy;
 
     int ret = build_open_gop_key_points(st);
     if (ret < 0)
@@ -4058,7 +4265,7 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
             }
         }
 
-        if (multiple_edits && !mov->advanced_editlist)
+        if (multiple_edits && !advanced_editlist)
             av_log(mov->fc, AV_LOG_WARNING, "multiple edit list entries, "
                    "Use -advanced_editlist to correctly decode otherwise "
                    "a/v desync might occur\n");
@@ -4073,26 +4280,17 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
 
             sc->time_offset = start_time -  (uint64_t)empty_duration;
             sc->min_corrected_pts = start_time;
-            if (!mov->advanced_editlist)
+            if (!advanced_editlist)
                 current_dts = -sc->time_offset;
         }
 
-        if (!multiple_edits && !mov->advanced_editlist &&
+        if (!multiple_edits && !advanced_editlist &&
             st->codecpar->codec_id == AV_CODEC_ID_AAC && start_time > 0)
             sc->start_pad = start_time;
     }
 
-    /* only use old uncompressed audio chunk demuxing when stts specifies it */
-    if (!(st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
-          sc->stts_count == 1 && sc->stts_data[0].duration == 1)) {
-        unsigned int current_sample = 0;
-        unsigned int stts_sample = 0;
-        unsigned int sample_size;
-        unsigned int distance = 0;
-        unsigned int rap_group_index = 0;
-        unsigned int rap_group_sample = 0;
-        int rap_group_present = sc->rap_group_count && sc->rap_group;
-        int key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
+    if (!chunk_demuxing) {
+        MOVIndexBuildState *is = &sc->index_state;
 
         current_dts -= sc->dts_shift;
 
@@ -4100,124 +4298,37 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
             return;
         if (sc->sample_count >= UINT_MAX / sizeof(*sti->index_entries) - sti->nb_index_entries)
             return;
-        if (av_reallocp_array(&sti->index_entries,
-                              sti->nb_index_entries + sc->sample_count,
-                              sizeof(*sti->index_entries)) < 0) {
-            sti->nb_index_entries = 0;
-            return;
-        }
-        sti->index_entries_allocated_size = (sti->nb_index_entries + sc->sample_count) * sizeof(*sti->index_entries);
-
-        if (ctts_data_old) {
-            // Expand ctts entries such that we have a 1-1 mapping with samples
-            if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
-                return;
-            sc->ctts_count = 0;
-            sc->ctts_allocated_size = 0;
-            sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
-                                    sc->sample_count * sizeof(*sc->ctts_data));
-            if (!sc->ctts_data) {
-                av_free(ctts_data_old);
+        if (!lazy) {
+            if (av_reallocp_array(&sti->index_entries,
+                                  sti->nb_index_entries + sc->sample_count,
+                                  sizeof(*sti->index_entries)) < 0) {
+                sti->nb_index_entries = 0;
                 return;
             }
+            sti->index_entries_allocated_size = (sti->nb_index_entries + sc->sample_count) * sizeof(*sti->index_entries);
 
-            memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
-
-            for (i = 0; i < ctts_count_old &&
-                        sc->ctts_count < sc->sample_count; i++)
-                for (j = 0; j < ctts_data_old[i].count &&
-                            sc->ctts_count < sc->sample_count; j++)
-                    add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
-                                   &sc->ctts_allocated_size, 1,
-                                   ctts_data_old[i].duration);
-            av_free(ctts_data_old);
+            /* the lazy index keeps the compact ctts, mov_read_packet() and
+             * mov_seek_stream() work with both */
+            if (sc->ctts_data && mov_expand_ctts(sc) < 0)
+                return;
         }
 
-        for (i = 0; i < sc->chunk_count; i++) {
-            int64_t next_offset = i+1 < sc->chunk_count ? sc->chunk_offsets[i+1] : INT64_MAX;
-            current_offset = sc->chunk_offsets[i];
-            while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
-                i + 1 == sc->stsc_data[stsc_index + 1].first)
-                stsc_index++;
-
-            if (next_offset > current_offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
-                sc->stsc_data[stsc_index].count * (int64_t)sc->stsz_sample_size > next_offset - current_offset) {
-                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
-                sc->stsz_sample_size = sc->sample_size;
-            }
-            if (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size) {
-                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
-                sc->stsz_sample_size = sc->sample_size;
-            }
-
-            for (j = 0; j < sc->stsc_data[stsc_index].count; j++) {
-                int keyframe = 0;
-                if (current_sample >= sc->sample_count) {
-                    av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
-                    return;
-                }
+        memset(is, 0, sizeof(*is));
+        is->pending = 1;
+        is->dts = current_dts;
+        is->key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
+        sc->lazy_index = lazy;
 
-                if (!sc->keyframe_absent && (!sc->keyframe_count || current_sample+key_off == sc->keyframes[stss_index])) {
-                    keyframe = 1;
-                    if (stss_index + 1 < sc->keyframe_count)
-                        stss_index++;
-                } else if (sc->stps_count && current_sample+key_off == sc->stps_data[stps_index]) {
-                    keyframe = 1;
-                    if (stps_index + 1 < sc->stps_count)
-                        stps_index++;
-                }
-                if (rap_group_present && rap_group_index < sc->rap_group_count) {
-                    if (sc->rap_group[rap_group_index].index > 0)
-                        keyframe = 1;
-                    if (++rap_group_sample == sc->rap_group[rap_group_index].count) {
-                        rap_group_sample = 0;
-                        rap_group_index++;
-                    }
-                }
-                if (sc->keyframe_absent
-                    && !sc->stps_count
-                    && !rap_group_present
-                    && (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || (i==0 && j==0)))
-                     keyframe = 1;
-                if (keyframe)
-                    distance = 0;
-                sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[current_sample];
-                if (sc->pseudo_stream_id == -1 ||
-                   sc->stsc_data[stsc_index].id - 1 == sc->pseudo_stream_id) {
-                    AVIndexEntry *e;
-                    if (sample_size > 0x3FFFFFFF) {
-                        av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sample_size);
-                        return;
-                    }
-                    e = &sti->index_entries[sti->nb_index_entries++];
-                    e->pos = current_offset;
-                    e->timestamp = current_dts;
-                    e->size = sample_size;
-                    e->min_distance = distance;
-                    e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
-                    av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, sample %u, offset %"PRIx64", dts %"PRId64", "
-                            "size %u, distance %u, keyframe %d\n", st->index, current_sample,
-                            current_offset, current_dts, sample_size, distance, keyframe);
-                    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries < 100)
-                        ff_rfps_add_frame(mov->fc, st, current_dts);
-                }
-
-                current_offset += sample_size;
-                stream_size += sample_size;
-
-                current_dts += sc->stts_data[stts_index].duration;
+        if (mov_build_index_samples(mov, st, lazy ? MOV_INDEX_BATCH_SIZE : UINT_MAX) < 0)
+            return;
 
-                distance++;
-                stts_sample++;
-                current_sample++;
-                if (stts_index + 1 < sc->stts_count && stts_sample == sc->stts_data[stts_index].count) {
-                    stts_sample = 0;
-                    stts_index++;
-                }
-            }
-        }
-        if (st->duration > 0)
-            st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+        if (lazy) {
+            uint64_t stream_size = sc->stsz_sample_size > 0 ?
+                (uint64_t)sc->stsz_sample_size * sc->sample_count : sc->data_size;
+            if (st->duration > 0)
+                st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+        } else if (st->duration > 0)
+            st->codecpar->bit_rate = is->stream_size*8*sc->time_scale/st->duration;
     } else {
         unsigned chunk_samples, total = 0;
 
@@ -4320,7 +4431,7 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
         }
     }
 
-    if (!mov->ignore_editlist && mov->advanced_editlist) {
+    if (!mov->ignore_editlist && advanced_editlist) {
         // Fix index according to edit lists.
         mov_fix_index(mov, st);
     }
@@ -4564,14 +4675,16 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         && sc->time_scale == st->codecpar->sample_rate) {
             ffstream(st)->need_parsing = AVSTREAM_PARSE_FULL;
     }
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stts_data);
-    av_freep(&sc->stps_data);
+    /* Do not need those anymore, unless the index is still being built. */
+    if (!sc->lazy_index) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stts_data);
+        av_freep(&sc->stps_data);
+        av_freep(&sc->rap_group);
+    }
     av_freep(&sc->elst_data);
-    av_freep(&sc->rap_group);
     av_freep(&sc->sync_group);
     av_freep(&sc->sgpd_sync);
 
@@ -5061,7 +5174,7 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     int64_t dts, pts = AV_NOPTS_VALUE;
     int data_offset = 0;
     unsigned entries, first_sample_flags = frag->flags;
-    int flags, distance, i;
+    int flags, distance, i, ret;
     int64_t prev_dts = AV_NOPTS_VALUE;
     int next_frag_index = -1, index_entry_pos;
     size_t requested_size;
@@ -5089,6 +5202,9 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     if (sc->pseudo_stream_id+1 != frag->stsd_id && sc->pseudo_stream_id != -1)
         return 0;
 
+    if ((ret = mov_finish_lazy_index(c, st)) < 0)
+        return ret;
+
     // Find the next frag_index index that has a valid index_entry for
     // the current track_id.
     //
@@ -8005,6 +8121,9 @@ static void mov_read_chapters(AVFormatContext *s)
         sc = st->priv_data;
         cur_pos = avio_tell(sc->pb);
 
+        if (sc->index_state.pending)
+            mov_build_index_samples(mov, st, UINT_MAX);
+
         if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
             st->disposition |= AV_DISPOSITION_ATTACHED_PIC | AV_DISPOSITION_TIMED_THUMBNAILS;
             if (sti->nb_index_entries) {
@@ -8616,6 +8735,8 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
         AVStream *avst = s->streams[i];
         FFStream *const avsti = ffstream(avst);
         MOVStreamContext *msc = avst->priv_data;
+        /* also add the next sample, mov_read_packet() may need its dts */
+        mov_extend_index(s->priv_data, avst, msc->current_sample + 1);
         if (msc->pb && msc->current_sample < avsti->nb_index_entries) {
             AVIndexEntry *current_sample = &avsti->index_entries[msc->current_sample];
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
@@ -8944,6 +9065,15 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     if (ret < 0)
         return ret;
 
+    // A lazily built index only has to reach the seek target.
+    while (sc->index_state.pending) {
+        if (sti->nb_index_entries &&
+            sti->index_entries[sti->nb_index_entries - 1].timestamp > timestamp &&
+            av_index_search_timestamp(st, timestamp, flags) >= 0)
+            break;
+        mov_build_index_samples(s->priv_data, st, sti->nb_index_entries + MOV_INDEX_BATCH_SIZE);
+    }
+
     for (;;) {
         sample = av_index_search_timestamp(st, timestamp, flags);
         av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
@@ -9083,6 +9213,9 @@ static const AVOption mov_options[] = {
         0, 1, FLAGS},
     {"ignore_chapters", "", OFFSET(ignore_chapters), AV_OPT_TYPE_BOOL, {.i64 = 0},
         0, 1, FLAGS},
+    {"lazy_index", "Build the sample index incrementally while reading",
+        OFFSET(lazy_index), AV_OPT_TYPE_BOOL, {.i64 = 0},
+        0, 1, FLAGS},
     {"use_mfra_for",
         "use mfra for fragment timestamps",
         OFFSET(use_mfra_for), AV_OPT_TYPE_INT, {.i64 = FF_MOV_FLAG_MFRA_AUTO},
@@ -119,6 +119,7 @@ static const AVOption options[] = {
     { "pts", NULL, 0, AV_OPT_TYPE_CONST, {.i64 = MOV_PRFT_SRC_PTS}, 0, 0, AV_OPT_FLAG_ENCODING_PARAM, "prft"},
     { "empty_hdlr_name", "write zero-length name string in hdlr atoms within mdia and minf atoms", offsetof(MOVMuxContext, empty_hdlr_name), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
     { "movie_timescale", "set movie timescale", offsetof(MOVMuxContext, movie_timescale), AV_OPT_TYPE_INT, {.i64 = MOV_TIMESCALE}, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
+    { "faststart_insert", "insert space for the moov into the output file instead of moving the data for faststart, where supported", offsetof(MOVMuxContext, faststart_insert), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
     { NULL },
 };
 
@@ -7480,6 +7481,76 @@ static int shift_data(AVFormatContext *s)
     return ff_format_shift_data(s, mov->reserved_header_pos, moov_size);
 }
 
+/*
+ * Make room for the moov at the beginning of the file without rewriting the
+ * mdat, if the output supports inserting space into it. The space is a whole
+ * number of filesystem blocks inserted at the start of the file, the header
+ * atoms before reserved_header_pos are written again in front of it. The moov
+ * is to be followed by a free atom covering the rest of the space, including
+ * the old copy of the header atoms. Returns the size of the space or a
+ * negative error code, in which case the chunk offsets and the output are
+ * unchanged.
+ */
+static int64_t insert_moov_space(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    AVIOContext *head_pb;
+    uint8_t *head;
+    int64_t space = 0;
+    int align, head_size, moov_size, i, ret;
+
+    if (!mov->faststart_insert)
+        return AVERROR(ENOSYS);
+    align = ff_format_insert_range_align(s);
+    if (align < 0)
+        return align;
+    if (mov->flags & FF_MOV_FLAG_DELAY_MOOV || mov->reserved_header_pos >= align)
+        return AVERROR(ENOSYS);
+
+    if ((ret = avio_open_dyn_buf(&head_pb)) < 0)
+        return ret;
+    if ((ret = mov_write_identification(head_pb, s)) < 0) {
+        ffio_free_dyn_buf(&head_pb);
+        return ret;
+    }
+    head_size = avio_get_dyn_buf(head_pb, &head);
+    if (head_size != mov->reserved_header_pos) {
+        ffio_free_dyn_buf(&head_pb);
+        return AVERROR(ENOSYS);
+    }
+
+    moov_size = get_moov_size(s);
+    /* more than two rounds are only needed if the switch to co64 crosses a
+     * block boundary */
+    for (int n = 0; moov_size >= 0 && n < 3; n++) {
+        int64_t new_space = FFALIGN(moov_size + 8LL, align);
+
+        for (i = 0; i < mov->nb_streams; i++)
+            mov->tracks[i].data_offset += new_space - space;
+        space = new_space;
+
+        moov_size = get_moov_size(s);
+        if (moov_size >= 0 && moov_size + 8LL <= space)
+            break;
+    }
+    if (moov_size < 0 || moov_size + 8LL > space)
+        ret = moov_size < 0 ? moov_size : AVERROR(EINVAL);
+    else
+        ret = ff_format_insert_range(s, 0, space);
+
+    if (ret < 0) {
+        for (i = 0; i < mov->nb_streams; i++)
+            mov->tracks[i].data_offset -= space;
+        ffio_free_dyn_buf(&head_pb);
+        return ret;
+    }
+
+    avio_seek(s->pb, 0, SEEK_SET);
+    avio_write(s->pb, head, head_size);
+    ffio_free_dyn_buf(&head_pb);
+    return space;
+}
+
 static int mov_write_trailer(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -7552,13 +7623,24 @@ static int mov_write_trailer(AVFormatContext *s)
         avio_seek(pb, mov->reserved_moov_size > 0 ? mov->reserved_header_pos : moov_pos, SEEK_SET);
 
         if (mov->flags & FF_MOV_FLAG_FASTSTART) {
-            av_log(s, AV_LOG_INFO, "Starting second pass: moving the moov atom to the beginning of the file\n");
-            res = shift_data(s);
-            if (res < 0)
-                return res;
+            int64_t space = insert_moov_space(s);
+            if (space < 0) {
+                av_log(s, AV_LOG_INFO, "Starting second pass: moving the moov atom to the beginning of the file\n");
+                res = shift_data(s);
+                if (res < 0)
+                    return res;
+            } else {
+                av_log(s, AV_LOG_VERBOSE, "Inserted %"PRId64" bytes for the moov atom at the beginning of the file\n", space);
+            }
             avio_seek(pb, mov->reserved_header_pos, SEEK_SET);
             if ((res = mov_write_moov_tag(pb, mov, s)) < 0)
                 return res;
+            if (space > 0) {
+                int64_t size = space - (avio_tell(pb) - mov->reserved_header_pos);
+                avio_wb32(pb, size);
+                ffio_wfourcc(pb, "free");
+                ffio_fill(pb, 0, size - 8);
+            }
         } else if (mov->reserved_moov_size > 0) {
             int64_t size;
             if ((res = mov_write_moov_tag(pb, mov, s)) < 0)
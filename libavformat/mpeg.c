@@ -22,6 +22,7 @@
 #include "config_components.h"
 
 #include "libavutil/channel_layout.h"
+#include "libavutil/opt.h"
 #include "avformat.h"
 #include "avio_internal.h"
 #include "demux.h"
@@ -119,12 +120,15 @@ static int mpegps_probe(const AVProbeData *p)
 }
 
 typedef struct MpegDemuxContext {
+    const AVClass *class;
     int32_t header_state;
     unsigned char psm_es_type[256];
     int sofdec;
     int dvd;
     int imkh_cctv;
     int raw_ac3;
+    char *index_file;
+    FFSeekIndex seek_index;
 } MpegDemuxContext;
 
 static int mpegps_read_header(AVFormatContext *s)
@@ -144,6 +148,11 @@ static int mpegps_read_header(AVFormatContext *s)
     } else
        avio_seek(s->pb, last_pos, SEEK_SET);
 
+    if (m->index_file && (s->pb->seekable & AVIO_SEEKABLE_NORMAL)) {
+        ff_seek_index_read(s, &m->seek_index, m->index_file);
+        ffformatcontext(s)->generic_index = 1;
+    }
+
     /* no need to do more */
     return 0;
 }
@@ -489,6 +498,9 @@ static int mpegps_read_packet(AVFormatContext *s,
     enum AVMediaType type;
     int64_t pts, dts, dummy_pos; // dummy_pos is needed for the index building to work
 
+    if (m->seek_index.nb_pending)
+        ff_seek_index_apply(s, &m->seek_index);
+
 redo:
     len = mpegps_read_pes_header(s, &dummy_pos, &startcode, &pts, &dts);
     if (len < 0)
@@ -686,6 +698,28 @@ static int64_t mpegps_read_dts(AVFormatContext *s, int stream_index,
     return dts;
 }
 
+static int mpegps_read_close(AVFormatContext *s)
+{
+    MpegDemuxContext *m = s->priv_data;
+
+    if (ffformatcontext(s)->generic_index)
+        ff_seek_index_write(s, &m->seek_index, m->index_file);
+    ff_seek_index_free(&m->seek_index);
+    return 0;
+}
+
+static const AVOption mpegps_options[] = {
+    { "index_file", "load and update a seek index file", offsetof(MpegDemuxContext, index_file), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM },
+    { NULL }
+};
+
+static const AVClass mpegps_demuxer_class = {
+    .class_name = "mpeg",
+    .item_name  = av_default_item_name,
+    .option     = mpegps_options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
 const AVInputFormat ff_mpegps_demuxer = {
     .name           = "mpeg",
     .long_name      = NULL_IF_CONFIG_SMALL("MPEG-PS (MPEG-2 Program Stream)"),
@@ -693,8 +727,10 @@ const AVInputFormat ff_mpegps_demuxer = {
     .read_probe     = mpegps_probe,
     .read_header    = mpegps_read_header,
     .read_packet    = mpegps_read_packet,
+    .read_close     = mpegps_read_close,
     .read_timestamp = mpegps_read_dts,
     .flags          = AVFMT_SHOW_IDS | AVFMT_TS_DISCONT,
+    .priv_class     = &mpegps_demuxer_class,
 };
 
 #if CONFIG_VOBSUB_DEMUXER
@@ -702,7 +738,6 @@ const AVInputFormat ff_mpegps_demuxer = {
 #include "subtitles.h"
 #include "libavutil/avassert.h"
 #include "libavutil/bprint.h"
-#include "libavutil/opt.h"
 
 #define REF_STRING "# VobSub index file,"
 #define MAX_LINE_SIZE 2048
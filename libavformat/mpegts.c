@@ -166,6 +166,9 @@ struct MpegTSContext {
     int merge_pmt_versions;
     int max_packet_size;
 
+    char *index_file;
+    FFSeekIndex seek_index;
+
     /******************************************/
     /* private mpegts data */
     /* scan context */
@@ -203,6 +206,8 @@ static const AVOption options[] = {
      {.i64 = 0}, 0, 1, 0 },
     {"max_packet_size", "maximum size of emitted packet", offsetof(MpegTSContext, max_packet_size), AV_OPT_TYPE_INT,
      {.i64 = 204800}, 1, INT_MAX/2, AV_OPT_FLAG_DECODING_PARAM },
+    {"index_file", "load and update a seek index file", offsetof(MpegTSContext, index_file), AV_OPT_TYPE_STRING,
+     {.str = NULL}, 0, 0, AV_OPT_FLAG_DECODING_PARAM },
     { NULL },
 };
 
@@ -3120,6 +3125,11 @@ static int mpegts_read_header(AVFormatContext *s)
     if (s->iformat == &ff_mpegts_demuxer) {
         /* normal demux */
 
+        if (ts->index_file && (pb->seekable & AVIO_SEEKABLE_NORMAL)) {
+            ff_seek_index_read(s, &ts->seek_index, ts->index_file);
+            ffformatcontext(s)->generic_index = 1;
+        }
+
         /* first do a scan to get all the services */
         seek_back(s, pb, pos);
 
@@ -3251,6 +3261,9 @@ static int mpegts_read_packet(AVFormatContext *s, AVPacket *pkt)
     MpegTSContext *ts = s->priv_data;
     int ret, i;
 
+    if (ts->seek_index.nb_pending)
+        ff_seek_index_apply(s, &ts->seek_index);
+
     pkt->size = -1;
     ts->pkt = pkt;
     ret = handle_packets(ts, 0);
@@ -3293,6 +3306,9 @@ static void mpegts_free(MpegTSContext *ts)
 static int mpegts_read_close(AVFormatContext *s)
 {
     MpegTSContext *ts = s->priv_data;
+    if (ffformatcontext(s)->generic_index)
+        ff_seek_index_write(s, &ts->seek_index, ts->index_file);
+    ff_seek_index_free(&ts->seek_index);
     mpegts_free(ts);
     return 0;
 }
@@ -103,6 +103,27 @@ enum AVWriteUncodedFrameFlags {
  */
 int ff_format_shift_data(AVFormatContext *s, int64_t read_start, int shift_size);
 
+/**
+ * Get the granularity of ff_format_insert_range().
+ *
+ * @return the block size of the output file, or a negative AVERROR if the
+ *         output does not support inserting ranges
+ */
+int ff_format_insert_range_align(AVFormatContext *s);
+
+/**
+ * Make size amount of space at pos by inserting it into the output file,
+ * without rewriting the data after pos. This is only supported for local
+ * files on some filesystems (FALLOC_FL_INSERT_RANGE on Linux). Both pos and
+ * size must be multiples of ff_format_insert_range_align(). The new space
+ * reads as zeros. The caller has to seek afterwards, as the data after pos
+ * moved.
+ *
+ * @return 0 on success, a negative AVERROR if inserting is not supported;
+ *         the output is then left unmodified
+ */
+int ff_format_insert_range(AVFormatContext *s, int64_t pos, int64_t size);
+
 /**
  * Utility function to open IO stream of output format.
  *
@@ -19,6 +19,18 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include "config.h"
+
+#if HAVE_FALLOCATE
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#endif
+
 #include "libavutil/dict.h"
 #include "libavutil/dict_internal.h"
 #include "libavutil/internal.h"
@@ -27,8 +39,10 @@
 #include "libavutil/parseutils.h"
 #include "avformat.h"
 #include "avio.h"
+#include "avio_internal.h"
 #include "internal.h"
 #include "mux.h"
+#include "url.h"
 
 #if FF_API_GET_END_PTS
 int64_t av_stream_get_end_pts(const AVStream *st)
@@ -114,6 +128,54 @@ end:
     return ret;
 }
 
+#if HAVE_FALLOCATE && defined(FALLOC_FL_INSERT_RANGE)
+static int get_local_file_handle(AVFormatContext *s)
+{
+    URLContext *h = ffio_geturlcontext(s->pb);
+
+    if (!h || strcmp(h->prot->name, "file"))
+        return -1;
+    return ffurl_get_file_handle(h);
+}
+#endif
+
+int ff_format_insert_range_align(AVFormatContext *s)
+{
+#if HAVE_FALLOCATE && defined(FALLOC_FL_INSERT_RANGE)
+    int fd = get_local_file_handle(s);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+        st.st_blksize <= 0 || st.st_blksize > 1 << 20)
+        return AVERROR(ENOSYS);
+    return st.st_blksize;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+int ff_format_insert_range(AVFormatContext *s, int64_t pos, int64_t size)
+{
+#if HAVE_FALLOCATE && defined(FALLOC_FL_INSERT_RANGE)
+    int fd = get_local_file_handle(s);
+    int align = ff_format_insert_range_align(s);
+
+    if (align < 0)
+        return align;
+    if (pos < 0 || pos % align || size <= 0 || size % align)
+        return AVERROR(EINVAL);
+
+    avio_flush(s->pb);
+    if (s->pb->error < 0)
+        return s->pb->error;
+    if (fallocate(fd, FALLOC_FL_INSERT_RANGE, pos, size) < 0)
+        return AVERROR(errno);
+    return 0;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
 int ff_format_output_open(AVFormatContext *s, const char *url, AVDictionary **options)
 {
     if (!s->oformat)
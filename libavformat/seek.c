@@ -764,3 +764,172 @@ void ff_rescale_interval(AVRational tb_in, AVRational tb_out,
     *max_ts = av_rescale_q_rnd(*max_ts, tb_in, tb_out,
                                AV_ROUND_DOWN | AV_ROUND_PASS_MINMAX);
 }
+
+#define SEEK_INDEX_MAGIC   MKBETAG('F', 'F', 'S', 'I')
+#define SEEK_INDEX_VERSION 1
+
+static int seek_index_nb_entries(AVFormatContext *s)
+{
+    int nb_entries = 0;
+
+    for (unsigned i = 0; i < s->nb_streams; i++)
+        nb_entries += ffstream(s->streams[i])->nb_index_entries;
+    return nb_entries;
+}
+
+int ff_seek_index_read(AVFormatContext *s, FFSeekIndex *idx, const char *url)
+{
+    AVIOContext *pb;
+    int64_t file_size = avio_size(s->pb), idx_size;
+    int nb_streams, ret;
+
+    if (file_size <= 0)
+        return AVERROR(ENOSYS);
+
+    ret = s->io_open(s, &pb, url, AVIO_FLAG_READ, NULL);
+    if (ret < 0)
+        return ret;
+    idx_size = avio_size(pb);
+
+    if (avio_rb32(pb) != SEEK_INDEX_MAGIC || avio_rb32(pb) != SEEK_INDEX_VERSION) {
+        av_log(s, AV_LOG_WARNING, "%s is not a seek index\n", url);
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+    if (avio_rb64(pb) != file_size) {
+        av_log(s, AV_LOG_VERBOSE, "Seek index %s does not match the input\n", url);
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+    nb_streams = avio_rb32(pb);
+    if (nb_streams < 0 || nb_streams > s->max_streams) {
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+    idx->streams = av_calloc(nb_streams, sizeof(*idx->streams));
+    if (!idx->streams) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    idx->nb_streams = nb_streams;
+
+    for (int i = 0; i < nb_streams; i++) {
+        FFSeekIndexStream *sis = &idx->streams[i];
+        unsigned nb_entries;
+
+        sis->id    = avio_rb32(pb);
+        nb_entries = avio_rb32(pb);
+        if (nb_entries > INT_MAX / sizeof(*sis->entries) ||
+            idx_size >= 0 && nb_entries > (idx_size - avio_tell(pb)) / 16) {
+            ret = AVERROR_INVALIDDATA;
+            goto end;
+        }
+        sis->entries = av_malloc_array(nb_entries, sizeof(*sis->entries));
+        if (!sis->entries && nb_entries) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        for (unsigned j = 0; j < nb_entries; j++) {
+            sis->entries[j].pos          = avio_rb64(pb);
+            sis->entries[j].timestamp    = avio_rb64(pb);
+            sis->entries[j].flags        = AVINDEX_KEYFRAME;
+            sis->entries[j].size         = 0;
+            sis->entries[j].min_distance = 0;
+        }
+        sis->nb_entries = nb_entries;
+        idx->nb_entries += nb_entries;
+    }
+    if (pb->eof_reached || pb->error) {
+        ret = pb->error ? pb->error : AVERROR_INVALIDDATA;
+        goto end;
+    }
+    idx->nb_pending = nb_streams;
+    av_log(s, AV_LOG_VERBOSE, "Loaded %d seek index entries from %s\n",
+           idx->nb_entries, url);
+
+end:
+    if (ret < 0)
+        ff_seek_index_free(idx);
+    ff_format_io_close(s, &pb);
+    return ret;
+}
+
+void ff_seek_index_apply(AVFormatContext *s, FFSeekIndex *idx)
+{
+    for (int i = 0; i < idx->nb_streams && idx->nb_pending; i++) {
+        FFSeekIndexStream *sis = &idx->streams[i];
+
+        if (!sis->entries)
+            continue;
+        for (unsigned j = 0; j < s->nb_streams; j++) {
+            AVStream *st = s->streams[j];
+            FFStream *sti = ffstream(st);
+
+            if (st->id != sis->id)
+                continue;
+            for (int k = 0; k < sis->nb_entries; k++) {
+                const AVIndexEntry *e = &sis->entries[k];
+                if (ff_add_index_entry(&sti->index_entries, &sti->nb_index_entries,
+                                       &sti->index_entries_allocated_size,
+                                       e->pos, e->timestamp, 0, 0, e->flags) < 0)
+                    break;
+            }
+            av_freep(&sis->entries);
+            idx->nb_pending--;
+            break;
+        }
+    }
+}
+
+int ff_seek_index_write(AVFormatContext *s, FFSeekIndex *idx, const char *url)
+{
+    AVIOContext *pb;
+    int64_t file_size = avio_size(s->pb);
+    int nb_streams = 0, ret;
+
+    /* Nothing new was indexed since the index was loaded. Streams that were
+     * never found again keep their entries in the file then. */
+    if (file_size <= 0 || seek_index_nb_entries(s) <= idx->nb_entries)
+        return 0;
+
+    ret = s->io_open(s, &pb, url, AVIO_FLAG_WRITE, NULL);
+    if (ret < 0) {
+        av_log(s, AV_LOG_WARNING, "Could not write seek index %s\n", url);
+        return ret;
+    }
+
+    for (unsigned i = 0; i < s->nb_streams; i++)
+        nb_streams += ffstream(s->streams[i])->nb_index_entries > 0;
+
+    avio_wb32(pb, SEEK_INDEX_MAGIC);
+    avio_wb32(pb, SEEK_INDEX_VERSION);
+    avio_wb64(pb, file_size);
+    avio_wb32(pb, nb_streams);
+    for (unsigned i = 0; i < s->nb_streams; i++) {
+        const FFStream *sti = ffstream(s->streams[i]);
+
+        if (!sti->nb_index_entries)
+            continue;
+        avio_wb32(pb, s->streams[i]->id);
+        avio_wb32(pb, sti->nb_index_entries);
+        for (int j = 0; j < sti->nb_index_entries; j++) {
+            avio_wb64(pb, sti->index_entries[j].pos);
+            avio_wb64(pb, sti->index_entries[j].timestamp);
+        }
+    }
+    avio_flush(pb);
+    ret = pb->error;
+    ff_format_io_close(s, &pb);
+    if (ret >= 0)
+        av_log(s, AV_LOG_VERBOSE, "Wrote %d seek index entries to %s\n",
+               seek_index_nb_entries(s), url);
+    return ret;
+}
+
+void ff_seek_index_free(FFSeekIndex *idx)
+{
+    for (int i = 0; i < idx->nb_streams; i++)
+        av_freep(&idx->streams[i].entries);
+    av_freep(&idx->streams);
+    idx->nb_streams = idx->nb_pending = idx->nb_entries = 0;
+}
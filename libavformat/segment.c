@@ -24,6 +24,7 @@
  * @url{http://tools.ietf.org/id/draft-pantos-http-live-streaming}
  */
 
+#include "config.h"
 #include "config_components.h"
 
 #include <time.h>
@@ -39,6 +40,8 @@
 #include "libavutil/avstring.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/mathematics.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadmessage.h"
 #include "libavutil/time.h"
 #include "libavutil/timecode.h"
 #include "libavutil/time_internal.h"
@@ -67,6 +70,18 @@ typedef enum {
 #define SEGMENT_LIST_FLAG_CACHE 1
 #define SEGMENT_LIST_FLAG_LIVE  2
 
+/**
+ * Work needed to complete a segment after the next one has been started,
+ * done in order by the finalization thread.
+ */
+typedef struct SegmentFinalizeJob {
+    AVFormatContext *avf;   ///< segment muxer to write the trailer of and free, if any
+    AVIOContext *pb;        ///< segment file to close otherwise
+    uint8_t *list_buf;      ///< segment list data, if any
+    int list_size;
+    int list_append;        ///< append list_buf to the list file instead of replacing it
+} SegmentFinalizeJob;
+
 typedef struct SegmentContext {
     const AVClass *class;  /**< Class for private options. */
     int segment_idx;       ///< index of the segment file to write, starting from 0
@@ -121,6 +136,14 @@ typedef struct SegmentContext {
     int use_rename;
     char temp_list_filename[1024];
 
+    int async_finalize;    ///< number of segments which can wait for finalization
+#if HAVE_THREADS
+    AVThreadMessageQueue *finalize_queue;
+    pthread_t finalize_thread;
+#endif
+    int finalize_thread_started;
+    int finalize_ret;
+
     SegmentListEntry cur_entry;
     SegmentListEntry *segment_list_entries;
     SegmentListEntry *segment_list_entries_end;
@@ -278,7 +301,11 @@ static int segment_list_open(AVFormatContext *s)
     int ret;
 
     snprintf(seg->temp_list_filename, sizeof(seg->temp_list_filename), seg->use_rename ? "%s.tmp" : "%s", seg->list);
-    ret = s->io_open(s, &seg->list_pb, seg->temp_list_filename, AVIO_FLAG_WRITE, NULL);
+    /* The finalization thread writes the list out once the segment is complete */
+    if (seg->finalize_thread_started)
+        ret = avio_open_dyn_buf(&seg->list_pb);
+    else
+        ret = s->io_open(s, &seg->list_pb, seg->temp_list_filename, AVIO_FLAG_WRITE, NULL);
     if (ret < 0) {
         av_log(s, AV_LOG_ERROR, "Failed to open segment list '%s'\n", seg->list);
         return ret;
@@ -342,10 +369,174 @@ static void segment_list_print_entry(AVIOContext      *list_ioctx,
     }
 }
 
+static void free_finalize_job(AVFormatContext *s, SegmentFinalizeJob **pjob)
+{
+    SegmentFinalizeJob *job = *pjob;
+
+    if (!job)
+        return;
+    if (job->avf) {
+        ff_format_io_close(job->avf, &job->avf->pb);
+        avformat_free_context(job->avf);
+    }
+    ff_format_io_close(s, &job->pb);
+    av_freep(&job->list_buf);
+    av_freep(pjob);
+}
+
+static int segment_finalize(AVFormatContext *s, SegmentFinalizeJob *job)
+{
+    SegmentContext *seg = s->priv_data;
+    int ret = 0, err;
+
+    if (job->avf) {
+        AVFormatContext *oc = job->avf;
+
+        av_write_frame(oc, NULL); /* Flush any buffered data (fragmented mp4) */
+        ret = av_write_trailer(oc);
+        if (ret < 0)
+            av_log(s, AV_LOG_ERROR, "Failure occurred when ending segment '%s'\n",
+                   oc->url);
+        err = ff_format_io_close(oc, &oc->pb);
+        if (err < 0) {
+            av_log(s, AV_LOG_ERROR, "Failed to close segment '%s'\n", oc->url);
+            if (ret >= 0)
+                ret = err;
+        }
+        avformat_free_context(oc);
+        job->avf = NULL;
+    } else {
+        ret = ff_format_io_close(s, &job->pb);
+        if (ret < 0)
+            av_log(s, AV_LOG_ERROR, "Failed to close segment\n");
+    }
+    if (ret < 0)
+        return ret;
+
+    if (job->list_append) {
+        avio_write(seg->list_pb, job->list_buf, job->list_size);
+        avio_flush(seg->list_pb);
+        if (seg->list_pb->error < 0) {
+            av_log(s, AV_LOG_ERROR, "Failed to write segment list '%s'\n", seg->list);
+            return seg->list_pb->error;
+        }
+    } else if (job->list_buf) {
+        char temp_list_filename[1024];
+        AVIOContext *list_pb = NULL;
+
+        snprintf(temp_list_filename, sizeof(temp_list_filename),
+                 seg->use_rename ? "%s.tmp" : "%s", seg->list);
+        err = s->io_open(s, &list_pb, temp_list_filename, AVIO_FLAG_WRITE, NULL);
+        if (err < 0) {
+            av_log(s, AV_LOG_ERROR, "Failed to open segment list '%s'\n", seg->list);
+            return err;
+        }
+        avio_write(list_pb, job->list_buf, job->list_size);
+        err = ff_format_io_close(s, &list_pb);
+        if (err < 0) {
+            av_log(s, AV_LOG_ERROR, "Failed to write segment list '%s'\n", seg->list);
+            return err;
+        }
+        if (seg->use_rename)
+            ff_rename(temp_list_filename, seg->list, s);
+    }
+
+    return ret;
+}
+
+#if HAVE_THREADS
+static void *finalize_thread(void *arg)
+{
+    AVFormatContext *s = arg;
+    SegmentContext *seg = s->priv_data;
+    SegmentFinalizeJob *job;
+    int ret;
+
+    ff_thread_setname("segment-final");
+
+    while ((ret = av_thread_message_queue_recv(seg->finalize_queue, &job, 0)) >= 0) {
+        ret = segment_finalize(s, job);
+        free_finalize_job(s, &job);
+        if (ret < 0)
+            break;
+    }
+
+    seg->finalize_ret = ret == AVERROR_EOF ? 0 : ret;
+    av_thread_message_queue_set_err_send(seg->finalize_queue, ret);
+    return NULL;
+}
+
+static int start_finalize_thread(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+    int ret;
+
+    ret = av_thread_message_queue_alloc(&seg->finalize_queue, seg->async_finalize,
+                                        sizeof(SegmentFinalizeJob *));
+    if (ret < 0)
+        return ret;
+
+    ret = pthread_create(&seg->finalize_thread, NULL, finalize_thread, s);
+    if (ret) {
+        av_thread_message_queue_free(&seg->finalize_queue);
+        return AVERROR(ret);
+    }
+    seg->finalize_thread_started = 1;
+    return 0;
+}
+
+static int stop_finalize_thread(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+    SegmentFinalizeJob *job;
+
+    if (!seg->finalize_thread_started)
+        return 0;
+
+    /* Let the thread finalize what is still queued */
+    av_thread_message_queue_set_err_recv(seg->finalize_queue, AVERROR_EOF);
+    pthread_join(seg->finalize_thread, NULL);
+    seg->finalize_thread_started = 0;
+    /* Jobs left behind by a failure are only released */
+    while (av_thread_message_queue_recv(seg->finalize_queue, &job,
+                                        AV_THREAD_MESSAGE_NONBLOCK) >= 0)
+        free_finalize_job(s, &job);
+    av_thread_message_queue_free(&seg->finalize_queue);
+    return seg->finalize_ret;
+}
+
+static int queue_finalize_job(AVFormatContext *s, SegmentFinalizeJob *job)
+{
+    SegmentContext *seg = s->priv_data;
+    int ret = av_thread_message_queue_send(seg->finalize_queue, &job, 0);
+
+    if (ret < 0)
+        free_finalize_job(s, &job);
+    return ret;
+}
+#else
+static int start_finalize_thread(AVFormatContext *s)
+{
+    return AVERROR(ENOSYS);
+}
+
+static int stop_finalize_thread(AVFormatContext *s)
+{
+    return 0;
+}
+
+static int queue_finalize_job(AVFormatContext *s, SegmentFinalizeJob *job)
+{
+    free_finalize_job(s, &job);
+    return AVERROR(ENOSYS);
+}
+#endif
+
 static int segment_end(AVFormatContext *s, int write_trailer, int is_last)
 {
     SegmentContext *seg = s->priv_data;
     AVFormatContext *oc = seg->avf;
+    SegmentFinalizeJob *job = NULL;
     int ret = 0;
     AVTimecode tc;
     AVRational rate;
@@ -357,9 +548,20 @@ static int segment_end(AVFormatContext *s, int write_trailer, int is_last)
     if (!oc || !oc->pb)
         return AVERROR(EINVAL);
 
-    av_write_frame(oc, NULL); /* Flush any buffered data (fragmented mp4) */
-    if (write_trailer)
-        ret = av_write_trailer(oc);
+    if (seg->finalize_thread_started) {
+        /* The trailer and the closing of the segment are left to the
+         * finalization thread, oc is handed over to it if a new muxer
+         * is created for the next segment. */
+        job = av_mallocz(sizeof(*job));
+        if (!job)
+            return AVERROR(ENOMEM);
+        if (!write_trailer)
+            av_write_frame(oc, NULL); /* Flush any buffered data (fragmented mp4) */
+    } else {
+        av_write_frame(oc, NULL); /* Flush any buffered data (fragmented mp4) */
+        if (write_trailer)
+            ret = av_write_trailer(oc);
+    }
 
     if (ret < 0)
         av_log(s, AV_LOG_ERROR, "Failure occurred when ending segment '%s'\n",
@@ -396,9 +598,22 @@ static int segment_end(AVFormatContext *s, int write_trailer, int is_last)
                 segment_list_print_entry(seg->list_pb, seg->list_type, entry, s);
             if (seg->list_type == LIST_TYPE_M3U8 && is_last)
                 avio_printf(seg->list_pb, "#EXT-X-ENDLIST\n");
-            ff_format_io_close(s, &seg->list_pb);
-            if (seg->use_rename)
-                ff_rename(seg->temp_list_filename, seg->list, s);
+            if (job) {
+                job->list_size = avio_close_dyn_buf(seg->list_pb, &job->list_buf);
+                seg->list_pb = NULL;
+            } else {
+                ff_format_io_close(s, &seg->list_pb);
+                if (seg->use_rename)
+                    ff_rename(seg->temp_list_filename, seg->list, s);
+            }
+        } else if (job) {
+            AVIOContext *list_pb;
+
+            if ((ret = avio_open_dyn_buf(&list_pb)) < 0)
+                goto end;
+            segment_list_print_entry(list_pb, seg->list_type, &seg->cur_entry, s);
+            job->list_size = avio_close_dyn_buf(list_pb, &job->list_buf);
+            job->list_append = 1;
         } else {
             segment_list_print_entry(seg->list_pb, seg->list_type, &seg->cur_entry, s);
             avio_flush(seg->list_pb);
@@ -449,7 +664,22 @@ static int segment_end(AVFormatContext *s, int write_trailer, int is_last)
     }
 
 end:
-    ff_format_io_close(oc, &oc->pb);
+    if (job) {
+        int err;
+
+        if (write_trailer) {
+            job->avf = oc;
+            seg->avf = NULL;
+        } else {
+            job->pb = oc->pb;
+            oc->pb = NULL;
+        }
+        err = queue_finalize_job(s, job);
+        if (ret >= 0)
+            ret = err;
+    } else {
+        ff_format_io_close(oc, &oc->pb);
+    }
 
     return ret;
 }
@@ -645,6 +875,7 @@ static void seg_free(AVFormatContext *s)
     SegmentContext *seg = s->priv_data;
     SegmentListEntry *cur;
 
+    stop_finalize_thread(s);
     ff_format_io_close(s, &seg->list_pb);
     if (seg->avf) {
         if (seg->is_nullctx)
@@ -732,6 +963,21 @@ static int seg_init(AVFormatContext *s)
     if (seg->list_type == LIST_TYPE_EXT)
         av_log(s, AV_LOG_WARNING, "'ext' list type option is deprecated in favor of 'csv'\n");
 
+    if (seg->async_finalize && seg->segment_idx_wrap &&
+        seg->async_finalize > seg->segment_idx_wrap - 2) {
+        /* Do not reopen a file which may still be finalized */
+        seg->async_finalize = FFMAX(seg->segment_idx_wrap - 2, 0);
+        av_log(s, AV_LOG_WARNING, "segment_async_finalize limited to %d by segment_wrap\n",
+               seg->async_finalize);
+    }
+    if (seg->async_finalize) {
+        if ((ret = start_finalize_thread(s)) < 0) {
+            av_log(s, AV_LOG_WARNING, "Could not start the segment finalization thread: %s, "
+                   "finalizing synchronously\n", av_err2str(ret));
+            seg->async_finalize = 0;
+        }
+    }
+
     if ((ret = select_reference_stream(s)) < 0)
         return ret;
     av_log(s, AV_LOG_VERBOSE, "Selected stream id:%d type:%s\n",
@@ -974,12 +1220,20 @@ static int seg_write_trailer(struct AVFormatContext *s)
     if (!seg->write_header_trailer) {
         if ((ret = segment_end(s, 0, 1)) < 0)
             return ret;
+        if ((ret = stop_finalize_thread(s)) < 0)
+            return ret;
         if ((ret = open_null_ctx(&oc->pb)) < 0)
             return ret;
         seg->is_nullctx = 1;
         ret = av_write_trailer(oc);
     } else {
+        int err;
+
         ret = segment_end(s, 1, 1);
+        err = stop_finalize_thread(s);
+        /* An earlier finalization failure is what made segment_end() fail */
+        if (err < 0)
+            ret = err;
     }
     return ret;
 }
@@ -1046,6 +1300,7 @@ static const AVOption options[] = {
     { "reset_timestamps", "reset timestamps at the beginning of each segment", OFFSET(reset_timestamps), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, E },
     { "initial_offset", "set initial timestamp offset", OFFSET(initial_offset), AV_OPT_TYPE_DURATION, {.i64 = 0}, -INT64_MAX, INT64_MAX, E },
     { "write_empty_segments", "allow writing empty 'filler' segments", OFFSET(write_empty), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, E },
+    { "segment_async_finalize", "set the number of segments which can wait for finalization in a separate thread", OFFSET(async_finalize), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, E },
     { NULL },
 };
 
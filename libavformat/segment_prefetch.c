@@ -0,0 +1,383 @@
+/*
+ * Segment prefetching for the HLS and DASH demuxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+
+#include "avio_internal.h"
+#include "internal.h"
+#include "segment_prefetch.h"
+
+#define PREFETCH_CHUNK_SIZE 65536
+
+void ff_segment_prefetch_free(AVFormatContext *s, SegmentPrefetch **pseg)
+{
+    SegmentPrefetch *seg = *pseg;
+
+    if (!seg)
+        return;
+    ff_format_io_close(s, &seg->in);
+    av_dict_free(&seg->opts);
+    av_freep(&seg->url);
+    av_freep(&seg->buf);
+    av_freep(pseg);
+}
+
+int ff_segment_prefetch_read(SegmentPrefetch *seg, uint8_t *buf, int buf_size)
+{
+    if (seg->buf_pos < seg->buf_len) {
+        int len = FFMIN(buf_size, seg->buf_len - seg->buf_pos);
+        memcpy(buf, seg->buf + seg->buf_pos, len);
+        seg->buf_pos += len;
+        if (seg->buf_pos == seg->buf_len)
+            av_freep(&seg->buf);
+        return len;
+    }
+    if (seg->in)
+        return avio_read(seg->in, buf, buf_size);
+    return seg->ret < 0 ? seg->ret : AVERROR_EOF;
+}
+
+static SegmentPrefetch *remove_segment(SegmentPrefetchPool *p, int i)
+{
+    SegmentPrefetch *seg = p->jobs[i];
+
+    p->nb_jobs--;
+    memmove(&p->jobs[i], &p->jobs[i + 1], (p->nb_jobs - i) * sizeof(*p->jobs));
+    return seg;
+}
+
+static int find_segment(SegmentPrefetchPool *p, const char *url,
+                        int64_t url_offset, int64_t size)
+{
+    for (int i = 0; i < p->nb_jobs; i++) {
+        SegmentPrefetch *seg = p->jobs[i];
+        if (!seg->abort && seg->url_offset == url_offset && seg->size == size &&
+            !strcmp(seg->url, url))
+            return i;
+    }
+    return -1;
+}
+
+SegmentPrefetch *ff_segment_prefetch_find(SegmentPrefetchPool *p, const char *url,
+                                          int64_t url_offset, int64_t size)
+{
+    int i = find_segment(p, url, url_offset, size);
+    return i >= 0 ? p->jobs[i] : NULL;
+}
+
+SegmentPrefetch *ff_segment_prefetch_add(SegmentPrefetchPool *p, void *owner, int64_t seq_no,
+                                         const char *url, int64_t url_offset, int64_t size,
+                                         const AVDictionary *opts)
+{
+    SegmentPrefetch *seg = av_mallocz(sizeof(*seg));
+
+    if (!seg || !(seg->url = av_strdup(url)) ||
+        av_dict_copy(&seg->opts, opts, 0) < 0 ||
+        av_dynarray_add_nofree(&p->jobs, &p->nb_jobs, seg) < 0) {
+        ff_segment_prefetch_free(p->s, &seg);
+        return NULL;
+    }
+    seg->owner      = owner;
+    seg->seq_no     = seq_no;
+    seg->url_offset = url_offset;
+    seg->size       = size;
+    seg->max_size   = p->max_size;
+    seg->state      = SEGMENT_PREFETCH_QUEUED;
+    if (size >= 0) {
+        /* try to restrict the HTTP request to the part we want */
+        av_dict_set_int(&seg->opts, "offset", url_offset, 0);
+        av_dict_set_int(&seg->opts, "end_offset", url_offset + size, 0);
+    }
+
+    return seg;
+}
+
+/* A segment being fetched is only flagged, its thread frees it once done. */
+static void cancel_segment(SegmentPrefetchPool *p, int i)
+{
+    SegmentPrefetch *seg = p->jobs[i];
+
+    if (seg->state == SEGMENT_PREFETCH_RUNNING) {
+        seg->abort = 1;
+        return;
+    }
+    seg = remove_segment(p, i);
+    ff_segment_prefetch_free(p->s, &seg);
+}
+
+void ff_segment_prefetch_cancel(SegmentPrefetchPool *p, void *owner, int64_t max_seq_no)
+{
+    for (int i = p->nb_jobs - 1; i >= 0; i--)
+        if (p->jobs[i]->owner == owner && p->jobs[i]->seq_no <= max_seq_no)
+            cancel_segment(p, i);
+}
+
+#if HAVE_THREADS
+void ff_segment_prefetch_lock(SegmentPrefetchPool *p)
+{
+    pthread_mutex_lock(&p->mutex);
+}
+
+void ff_segment_prefetch_unlock(SegmentPrefetchPool *p)
+{
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+}
+
+static int fetch_aborted(SegmentPrefetchPool *p, SegmentPrefetch *seg)
+{
+    int abort;
+
+    pthread_mutex_lock(&p->mutex);
+    abort = seg->abort || p->quit;
+    pthread_mutex_unlock(&p->mutex);
+
+    return abort || ff_check_interrupt(&p->s->interrupt_callback);
+}
+
+static int fetch_segment(SegmentPrefetchPool *p, SegmentPrefetch *seg)
+{
+    AVFormatContext *s = p->s;
+    int64_t max_size = seg->max_size;
+    int ret;
+
+    av_log(s, AV_LOG_VERBOSE, "Prefetching url '%s', offset %"PRId64", segment %"PRId64"\n",
+           seg->url, seg->url_offset, seg->seq_no);
+
+    ret = s->io_open(s, &seg->in, seg->url, AVIO_FLAG_READ, &seg->opts);
+    if (ret < 0)
+        return ret;
+
+    if (seg->seek && seg->url_offset) {
+        int64_t seekret = avio_seek(seg->in, seg->url_offset, SEEK_SET);
+        if (seekret < 0)
+            return seekret;
+    }
+
+    if (seg->size >= 0)
+        max_size = FFMIN(max_size, seg->size);
+
+    while (seg->buf_len < max_size) {
+        int len = FFMIN(max_size - seg->buf_len, PREFETCH_CHUNK_SIZE);
+
+        if (fetch_aborted(p, seg))
+            return AVERROR_EXIT;
+
+        if (seg->buf_len + len > seg->buf_size) {
+            unsigned int size = FFMIN(FFMAX(2LL * seg->buf_size, seg->buf_len + len), max_size);
+            uint8_t *buf = av_realloc(seg->buf, size);
+            if (!buf)
+                return AVERROR(ENOMEM);
+            seg->buf      = buf;
+            seg->buf_size = size;
+        }
+
+        ret = avio_read(seg->in, seg->buf + seg->buf_len, len);
+        if (ret <= 0) {
+            ff_format_io_close(s, &seg->in);
+            return ret == AVERROR_EOF ? 0 : ret;
+        }
+        seg->buf_len += ret;
+    }
+
+    if (seg->buf_len == seg->size || seg->truncate)
+        ff_format_io_close(s, &seg->in);
+
+    return 0;
+}
+
+static void *prefetch_thread(void *arg)
+{
+    SegmentPrefetchPool *p = arg;
+
+    pthread_mutex_lock(&p->mutex);
+    while (!p->quit) {
+        SegmentPrefetch *seg = NULL;
+        int i, ret;
+
+        for (i = 0; i < p->nb_jobs; i++) {
+            if (p->jobs[i]->state == SEGMENT_PREFETCH_QUEUED) {
+                seg = p->jobs[i];
+                break;
+            }
+        }
+        if (!seg) {
+            pthread_cond_wait(&p->cond, &p->mutex);
+            continue;
+        }
+
+        seg->state = SEGMENT_PREFETCH_RUNNING;
+        pthread_mutex_unlock(&p->mutex);
+        ret = fetch_segment(p, seg);
+        pthread_mutex_lock(&p->mutex);
+
+        seg->ret   = ret;
+        seg->state = SEGMENT_PREFETCH_DONE;
+        if (seg->abort) {
+            for (i = 0; p->jobs[i] != seg; i++)
+                ;
+            remove_segment(p, i);
+            ff_segment_prefetch_free(p->s, &seg);
+        }
+        pthread_cond_broadcast(&p->done_cond);
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    return NULL;
+}
+
+int ff_segment_prefetch_init(SegmentPrefetchPool *p, AVFormatContext *s,
+                             int nb_threads, int64_t max_size)
+{
+    int ret;
+
+    p->s        = s;
+    p->max_size = max_size;
+
+    p->threads = av_calloc(nb_threads, sizeof(*p->threads));
+    if (!p->threads)
+        return AVERROR(ENOMEM);
+
+    ret = pthread_mutex_init(&p->mutex, NULL);
+    if (ret)
+        goto mutex_fail;
+    ret = pthread_cond_init(&p->cond, NULL);
+    if (ret)
+        goto cond_fail;
+    ret = pthread_cond_init(&p->done_cond, NULL);
+    if (ret)
+        goto done_cond_fail;
+
+    for (; p->nb_threads < nb_threads; p->nb_threads++) {
+        ret = pthread_create(&p->threads[p->nb_threads], NULL, prefetch_thread, p);
+        if (ret) {
+            /* make do with the threads we have */
+            if (p->nb_threads)
+                break;
+            goto thread_fail;
+        }
+    }
+
+    return 0;
+
+thread_fail:
+    pthread_cond_destroy(&p->done_cond);
+done_cond_fail:
+    pthread_cond_destroy(&p->cond);
+cond_fail:
+    pthread_mutex_destroy(&p->mutex);
+mutex_fail:
+    av_freep(&p->threads);
+    ret = AVERROR(ret);
+    av_log(s, AV_LOG_ERROR, "Failed to start prefetch threads: %s\n", av_err2str(ret));
+    return ret;
+}
+
+void ff_segment_prefetch_uninit(SegmentPrefetchPool *p)
+{
+    if (!p->nb_threads)
+        return;
+
+    pthread_mutex_lock(&p->mutex);
+    p->quit = 1;
+    for (int i = 0; i < p->nb_jobs; i++)
+        p->jobs[i]->abort = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+
+    for (int i = 0; i < p->nb_threads; i++)
+        pthread_join(p->threads[i], NULL);
+    p->nb_threads = 0;
+    av_freep(&p->threads);
+
+    for (int i = 0; i < p->nb_jobs; i++)
+        ff_segment_prefetch_free(p->s, &p->jobs[i]);
+    av_freep(&p->jobs);
+    p->nb_jobs = 0;
+
+    pthread_cond_destroy(&p->done_cond);
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->mutex);
+}
+
+SegmentPrefetch *ff_segment_prefetch_take(SegmentPrefetchPool *p, const char *url,
+                                          int64_t url_offset, int64_t size)
+{
+    SegmentPrefetch *seg = NULL;
+    int i;
+
+    if (!p->nb_threads)
+        return NULL;
+
+    pthread_mutex_lock(&p->mutex);
+    while ((i = find_segment(p, url, url_offset, size)) >= 0) {
+        seg = p->jobs[i];
+        if (seg->state == SEGMENT_PREFETCH_QUEUED) {
+            /* no thread got to it yet, opening it directly is faster */
+            seg = remove_segment(p, i);
+            ff_segment_prefetch_free(p->s, &seg);
+            break;
+        }
+        if (seg->state == SEGMENT_PREFETCH_DONE) {
+            remove_segment(p, i);
+            break;
+        }
+        seg = NULL;
+        pthread_cond_wait(&p->done_cond, &p->mutex);
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    return seg;
+}
+#else
+void ff_segment_prefetch_lock(SegmentPrefetchPool *p)
+{
+}
+
+void ff_segment_prefetch_unlock(SegmentPrefetchPool *p)
+{
+}
+
+int ff_segment_prefetch_init(SegmentPrefetchPool *p, AVFormatContext *s,
+                             int nb_threads, int64_t max_size)
+{
+    p->s        = s;
+    p->max_size = max_size;
+    return AVERROR(ENOSYS);
+}
+
+void ff_segment_prefetch_uninit(SegmentPrefetchPool *p)
+{
+    for (int i = 0; i < p->nb_jobs; i++)
+        ff_segment_prefetch_free(p->s, &p->jobs[i]);
+    av_freep(&p->jobs);
+    p->nb_jobs = 0;
+}
+
+SegmentPrefetch *ff_segment_prefetch_take(SegmentPrefetchPool *p, const char *url,
+                                          int64_t url_offset, int64_t size)
+{
+    return NULL;
+}
+#endif
@@ -0,0 +1,149 @@
+/*
+ * Segment prefetching for the HLS and DASH demuxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_SEGMENT_PREFETCH_H
+#define AVFORMAT_SEGMENT_PREFETCH_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+#include "libavutil/dict.h"
+#include "libavutil/thread.h"
+
+#include "avformat.h"
+#include "avio.h"
+
+enum SegmentPrefetchState {
+    SEGMENT_PREFETCH_QUEUED,
+    SEGMENT_PREFETCH_RUNNING,
+    SEGMENT_PREFETCH_DONE,
+};
+
+/**
+ * A segment fetched ahead of time by one of the threads of a
+ * SegmentPrefetchPool. Up to max_size bytes of it are read into memory,
+ * the rest is read from the still open input once the demuxer gets to it.
+ */
+typedef struct SegmentPrefetch {
+    void *owner;                 ///< playlist the segment belongs to, NULL if shared
+    int64_t seq_no;
+    char *url;
+    int64_t url_offset;
+    int64_t size;                ///< size of the segment, -1 for the whole url
+    int64_t max_size;            ///< number of bytes to read into memory
+    int seek;                    ///< seek to url_offset after opening the url
+    int truncate;                ///< the data past max_size is not needed
+    AVDictionary *opts;
+    enum SegmentPrefetchState state;
+    int abort;
+    int ret;
+    AVIOContext *in;
+    uint8_t *buf;
+    unsigned int buf_size;
+    int buf_len;
+    int buf_pos;
+} SegmentPrefetch;
+
+typedef struct SegmentPrefetchPool {
+    AVFormatContext *s;
+    int64_t max_size;
+    SegmentPrefetch **jobs;
+    int nb_jobs;
+#if HAVE_THREADS
+    pthread_t *threads;
+    int nb_threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_cond_t done_cond;
+    int quit;
+#endif
+} SegmentPrefetchPool;
+
+/**
+ * Start nb_threads threads fetching the segments added to the pool.
+ *
+ * @param max_size default number of bytes of each segment to read into memory
+ * @return 0 on success, AVERROR(ENOSYS) if threads are not available, or
+ *         another negative error code
+ */
+int ff_segment_prefetch_init(SegmentPrefetchPool *p, AVFormatContext *s,
+                             int nb_threads, int64_t max_size);
+
+/**
+ * Stop the threads and free all segments still in the pool.
+ */
+void ff_segment_prefetch_uninit(SegmentPrefetchPool *p);
+
+/**
+ * Lock the pool, as needed by ff_segment_prefetch_add(),
+ * ff_segment_prefetch_find() and ff_segment_prefetch_cancel().
+ */
+void ff_segment_prefetch_lock(SegmentPrefetchPool *p);
+
+/**
+ * Unlock the pool and wake the threads up for the segments added meanwhile.
+ */
+void ff_segment_prefetch_unlock(SegmentPrefetchPool *p);
+
+/**
+ * Queue a segment. The segment is only picked up by the threads once the
+ * pool is unlocked, so the caller can still adjust it, e.g. mark it as
+ * failed by setting ret and state.
+ *
+ * @param opts options used to open the url, offset and end_offset are
+ *             added for partial segments
+ * @return the queued segment, NULL on allocation failure
+ */
+SegmentPrefetch *ff_segment_prefetch_add(SegmentPrefetchPool *p, void *owner, int64_t seq_no,
+                                         const char *url, int64_t url_offset, int64_t size,
+                                         const AVDictionary *opts);
+
+/**
+ * @return the queued or fetched segment for the given part of url, NULL if
+ *         there is none
+ */
+SegmentPrefetch *ff_segment_prefetch_find(SegmentPrefetchPool *p, const char *url,
+                                          int64_t url_offset, int64_t size);
+
+/**
+ * Drop the segments of owner with a sequence number up to max_seq_no.
+ * Segments being fetched are freed by their thread once it is done.
+ */
+void ff_segment_prefetch_cancel(SegmentPrefetchPool *p, void *owner, int64_t max_seq_no);
+
+/**
+ * Remove a segment from the pool, waiting for it to be fetched if needed.
+ *
+ * @return the fetched segment, to be freed with ff_segment_prefetch_free(),
+ *         or NULL if it is not in the pool or no thread got to it yet, in
+ *         which case the caller is better off opening it directly
+ */
+SegmentPrefetch *ff_segment_prefetch_take(SegmentPrefetchPool *p, const char *url,
+                                          int64_t url_offset, int64_t size);
+
+/**
+ * Read from a fetched segment, first from memory then from its input.
+ */
+int ff_segment_prefetch_read(SegmentPrefetch *seg, uint8_t *buf, int buf_size);
+
+void ff_segment_prefetch_free(AVFormatContext *s, SegmentPrefetch **pseg);
+
+#endif /* AVFORMAT_SEGMENT_PREFETCH_H */
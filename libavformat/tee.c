@@ -20,9 +20,13 @@
  */
 
 
+#include "config.h"
 #include "libavutil/avutil.h"
 #include "libavutil/avstring.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadmessage.h"
+#include "libavutil/time.h"
 #include "libavcodec/bsf.h"
 #include "internal.h"
 #include "avformat.h"
@@ -36,6 +40,16 @@ typedef enum {
 
 #define DEFAULT_SLAVE_FAILURE_POLICY ON_SLAVE_FAILURE_ABORT
 
+typedef enum {
+    ON_QUEUE_OVERFLOW_BLOCK = 1,
+    ON_QUEUE_OVERFLOW_DROP  = 2
+} SlaveOverflowPolicy;
+
+typedef struct {
+    AVPacket *pkt;              ///< NULL requests a flush of the slave
+    int64_t queued;             ///< av_gettime_relative() at queueing
+} TeeMessage;
+
 typedef struct {
     AVFormatContext *avf;
     AVBSFContext **bsfs; ///< bitstream filters per stream
@@ -48,6 +62,27 @@ typedef struct {
      * disabled output streams are set to -1 */
     int *stream_map;
     int header_written;
+
+    /** number of packets queued for the slave thread,
+     * 0 if the slave is written synchronously */
+    int queue_size;
+    SlaveOverflowPolicy on_overflow;
+    uint8_t *drop_until_keyframe; ///< per output stream
+#if HAVE_THREADS
+    AVThreadMessageQueue *queue;
+    pthread_t thread;
+    int thread_started;
+#endif
+    int thread_ret;
+
+    /* statistics, the first group is only accessed by the slave thread
+     * (or after it was joined), the second one by the muxing thread */
+    int64_t nb_written;
+    int64_t lag_total;
+    int64_t lag_max;
+    int64_t nb_dropped;
+    int64_t wait_time;
+    int max_queued;
 } TeeSlave;
 
 typedef struct TeeContext {
@@ -57,6 +92,8 @@ typedef struct TeeContext {
     TeeSlave *slaves;
     int use_fifo;
     AVDictionary *fifo_options;
+    int queue_size;
+    int on_overflow;
 } TeeContext;
 
 static const char *const slave_delim     = "|";
@@ -69,6 +106,15 @@ static const AVOption options[] = {
          OFFSET(use_fifo), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
         {"fifo_options", "fifo pseudo-muxer options", OFFSET(fifo_options),
          AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, AV_OPT_FLAG_ENCODING_PARAM},
+        {"queue_size", "Number of packets queued for each slave output thread, 0 to write synchronously",
+         OFFSET(queue_size), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
+        {"overflow", "Action to take when a slave queue is full", OFFSET(on_overflow),
+         AV_OPT_TYPE_INT, {.i64 = ON_QUEUE_OVERFLOW_BLOCK}, ON_QUEUE_OVERFLOW_BLOCK, ON_QUEUE_OVERFLOW_DROP,
+         AV_OPT_FLAG_ENCODING_PARAM, "overflow"},
+            {"block", "Wait for the slave to catch up", 0, AV_OPT_TYPE_CONST,
+             {.i64 = ON_QUEUE_OVERFLOW_BLOCK}, 0, 0, AV_OPT_FLAG_ENCODING_PARAM, "overflow"},
+            {"drop", "Drop packets until the next keyframe", 0, AV_OPT_TYPE_CONST,
+             {.i64 = ON_QUEUE_OVERFLOW_DROP}, 0, 0, AV_OPT_FLAG_ENCODING_PARAM, "overflow"},
         {NULL}
 };
 
@@ -115,6 +161,214 @@ static int parse_slave_fifo_options(const char *fifo_options, TeeSlave *tee_slav
     return av_dict_parse_string(&tee_slave->fifo_options, fifo_options, "=", ":", 0);
 }
 
+static int parse_slave_queue_size(const char *queue_size, TeeSlave *tee_slave)
+{
+    char *end;
+    long size = strtol(queue_size, &end, 10);
+
+    if (!*queue_size || *end || size < 0 || size > INT_MAX)
+        return AVERROR(EINVAL);
+    tee_slave->queue_size = size;
+    return 0;
+}
+
+static int parse_slave_overflow_policy(const char *opt, TeeSlave *tee_slave)
+{
+    if (!av_strcasecmp("block", opt)) {
+        tee_slave->on_overflow = ON_QUEUE_OVERFLOW_BLOCK;
+        return 0;
+    } else if (!av_strcasecmp("drop", opt)) {
+        tee_slave->on_overflow = ON_QUEUE_OVERFLOW_DROP;
+        return 0;
+    }
+    return AVERROR(EINVAL);
+}
+
+static int write_slave_packet(TeeSlave *tee_slave, AVPacket *pkt, void *log_ctx)
+{
+    AVFormatContext *avf2 = tee_slave->avf;
+    AVBSFContext *bsfs;
+    int s2, ret;
+
+    /* Flush slave if pkt is NULL*/
+    if (!pkt)
+        return av_interleaved_write_frame(avf2, NULL);
+
+    s2 = pkt->stream_index;
+    bsfs = tee_slave->bsfs[s2];
+
+    ret = av_bsf_send_packet(bsfs, pkt);
+    if (ret < 0) {
+        av_packet_unref(pkt);
+        av_log(log_ctx, AV_LOG_ERROR, "Error while sending packet to bitstream filter: %s\n",
+               av_err2str(ret));
+        return ret;
+    }
+
+    while(1) {
+        ret = av_bsf_receive_packet(bsfs, pkt);
+        if (ret == AVERROR(EAGAIN)) {
+            ret = 0;
+            break;
+        } else if (ret < 0) {
+            break;
+        }
+
+        av_packet_rescale_ts(pkt, bsfs->time_base_out,
+                             avf2->streams[s2]->time_base);
+        ret = av_interleaved_write_frame(avf2, pkt);
+        if (ret < 0)
+            break;
+    };
+
+    return ret;
+}
+
+#if HAVE_THREADS
+static void free_message(void *msg)
+{
+    TeeMessage *tee_msg = msg;
+    av_packet_free(&tee_msg->pkt);
+}
+
+static void *slave_thread(void *arg)
+{
+    TeeSlave *tee_slave = arg;
+    TeeMessage msg;
+    int ret;
+
+    ff_thread_setname("tee-slave");
+
+    while ((ret = av_thread_message_queue_recv(tee_slave->queue, &msg, 0)) >= 0) {
+        int64_t lag;
+
+        ret = write_slave_packet(tee_slave, msg.pkt, tee_slave->avf);
+        av_packet_free(&msg.pkt);
+        if (ret < 0)
+            break;
+
+        lag = av_gettime_relative() - msg.queued;
+        tee_slave->lag_total += lag;
+        tee_slave->lag_max    = FFMAX(tee_slave->lag_max, lag);
+        tee_slave->nb_written++;
+    }
+
+    if (ret == AVERROR_EOF)
+        ret = 0;
+    tee_slave->thread_ret = ret;
+    /* Wake up the muxing thread if it is waiting for room in the queue */
+    av_thread_message_queue_set_err_send(tee_slave->queue, ret < 0 ? ret : AVERROR_EOF);
+    return NULL;
+}
+
+static int start_slave_thread(TeeSlave *tee_slave)
+{
+    int ret;
+
+    tee_slave->drop_until_keyframe = av_calloc(tee_slave->avf->nb_streams,
+                                               sizeof(*tee_slave->drop_until_keyframe));
+    if (!tee_slave->drop_until_keyframe)
+        return AVERROR(ENOMEM);
+
+    ret = av_thread_message_queue_alloc(&tee_slave->queue, tee_slave->queue_size,
+                                        sizeof(TeeMessage));
+    if (ret < 0)
+        return ret;
+    av_thread_message_queue_set_free_func(tee_slave->queue, free_message);
+
+    ret = pthread_create(&tee_slave->thread, NULL, slave_thread, tee_slave);
+    if (ret) {
+        av_thread_message_queue_free(&tee_slave->queue);
+        return AVERROR(ret);
+    }
+    tee_slave->thread_started = 1;
+    return 0;
+}
+
+static int stop_slave_thread(TeeSlave *tee_slave)
+{
+    AVFormatContext *avf2 = tee_slave->avf;
+
+    if (!tee_slave->thread_started)
+        return 0;
+
+    /* Let the thread write out what is still queued */
+    av_thread_message_queue_set_err_recv(tee_slave->queue, AVERROR_EOF);
+    pthread_join(tee_slave->thread, NULL);
+    tee_slave->thread_started = 0;
+    av_thread_message_queue_free(&tee_slave->queue);
+
+    av_log(avf2, AV_LOG_VERBOSE, "Slave '%s': %"PRId64" packets written, "
+           "%"PRId64" dropped, max queue %d/%d, lag avg %.3fs max %.3fs, "
+           "blocked %.3fs\n", avf2->url, tee_slave->nb_written,
+           tee_slave->nb_dropped, tee_slave->max_queued, tee_slave->queue_size,
+           tee_slave->nb_written ? tee_slave->lag_total / (tee_slave->nb_written * 1000000.0) : 0.0,
+           tee_slave->lag_max / 1000000.0, tee_slave->wait_time / 1000000.0);
+
+    return tee_slave->thread_ret;
+}
+
+static int queue_slave_packet(TeeSlave *tee_slave, AVPacket *pkt, int s2, void *log_ctx)
+{
+    TeeMessage msg = { .queued = av_gettime_relative() };
+    int ret;
+
+    if (pkt) {
+        if (tee_slave->drop_until_keyframe[s2]) {
+            if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+                tee_slave->nb_dropped++;
+                return 0;
+            }
+            tee_slave->drop_until_keyframe[s2] = 0;
+        }
+
+        /* The packet data is shared with the other slaves, not copied */
+        msg.pkt = av_packet_clone(pkt);
+        if (!msg.pkt)
+            return AVERROR(ENOMEM);
+        msg.pkt->stream_index = s2;
+    }
+
+    ret = av_thread_message_queue_send(tee_slave->queue, &msg, AV_THREAD_MESSAGE_NONBLOCK);
+    if (ret == AVERROR(EAGAIN)) {
+        if (pkt && tee_slave->on_overflow == ON_QUEUE_OVERFLOW_DROP) {
+            av_log(log_ctx, AV_LOG_WARNING, "Queue of slave '%s' full, dropping "
+                   "packets of stream %d until the next keyframe\n",
+                   tee_slave->avf->url, s2);
+            tee_slave->drop_until_keyframe[s2] = 1;
+            tee_slave->nb_dropped++;
+            av_packet_free(&msg.pkt);
+            return 0;
+        }
+        ret = av_thread_message_queue_send(tee_slave->queue, &msg, 0);
+        tee_slave->wait_time += av_gettime_relative() - msg.queued;
+    }
+    if (ret < 0) {
+        av_packet_free(&msg.pkt);
+        return ret;
+    }
+
+    tee_slave->max_queued = FFMAX(tee_slave->max_queued,
+                                  av_thread_message_queue_nb_elems(tee_slave->queue));
+    return 0;
+}
+#else
+static int start_slave_thread(TeeSlave *tee_slave)
+{
+    return AVERROR(ENOSYS);
+}
+
+static int stop_slave_thread(TeeSlave *tee_slave)
+{
+    return 0;
+}
+
+static int queue_slave_packet(TeeSlave *tee_slave, AVPacket *pkt, int s2, void *log_ctx)
+{
+    return AVERROR(ENOSYS);
+}
+#endif
+
 static int close_slave(TeeSlave *tee_slave)
 {
     AVFormatContext *avf;
@@ -126,6 +380,9 @@ static int close_slave(TeeSlave *tee_slave)
     if (!avf)
         return 0;
 
+    stop_slave_thread(tee_slave);
+    av_freep(&tee_slave->drop_until_keyframe);
+
     if (tee_slave->header_written)
         ret = av_write_trailer(avf);
 
@@ -161,6 +418,7 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
     char *filename;
     char *format = NULL, *select = NULL, *on_fail = NULL;
     char *use_fifo = NULL, *fifo_options_str = NULL;
+    char *queue_size = NULL, *overflow = NULL;
     AVFormatContext *avf2 = NULL;
     AVStream *st, *st2;
     int stream_count;
@@ -195,6 +453,14 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
                           av_err2str(ret)););
     PROCESS_OPTION("fifo_options", fifo_options_str,
                    parse_slave_fifo_options(fifo_options_str, tee_slave), ;);
+    PROCESS_OPTION("queue_size", queue_size,
+                   parse_slave_queue_size(queue_size, tee_slave),
+                   av_log(avf, AV_LOG_ERROR, "Invalid queue_size option value '%s'\n",
+                          queue_size););
+    PROCESS_OPTION("overflow", overflow,
+                   parse_slave_overflow_policy(overflow, tee_slave),
+                   av_log(avf, AV_LOG_ERROR, "Invalid overflow option value, "
+                          "valid options are 'block' and 'drop'\n"););
     entry = NULL;
     while ((entry = av_dict_get(options, "bsfs", entry, AV_DICT_IGNORE_SUFFIX))) {
         /* trim out strlen("bsfs") characters from key */
@@ -478,6 +744,8 @@ static int tee_write_header(AVFormatContext *avf)
     for (i = 0; i < nb_slaves; i++) {
 
         tee->slaves[i].use_fifo = tee->use_fifo;
+        tee->slaves[i].queue_size = tee->queue_size;
+        tee->slaves[i].on_overflow = tee->on_overflow;
         ret = av_dict_copy(&tee->slaves[i].fifo_options, tee->fifo_options, 0);
         if (ret < 0)
             goto fail;
@@ -488,6 +756,18 @@ static int tee_write_header(AVFormatContext *avf)
                 goto fail;
         } else {
             log_slave(&tee->slaves[i], avf, AV_LOG_VERBOSE);
+            if (tee->slaves[i].queue_size && !HAVE_THREADS) {
+                av_log(avf, AV_LOG_WARNING, "Slave muxer #%u: queue_size requires "
+                       "threading support, writing synchronously\n", i);
+                tee->slaves[i].queue_size = 0;
+            } else if (tee->slaves[i].queue_size &&
+                       (ret = start_slave_thread(&tee->slaves[i])) < 0) {
+                av_log(avf, AV_LOG_ERROR, "Slave muxer #%u: failed to start thread: %s\n",
+                       i, av_err2str(ret));
+                ret = tee_process_slave_failure(avf, i, ret);
+                if (ret < 0)
+                    goto fail;
+            }
         }
         av_freep(&slaves[i]);
     }
@@ -519,7 +799,8 @@ static int tee_write_trailer(AVFormatContext *avf)
     unsigned i;
 
     for (i = 0; i < tee->nb_slaves; i++) {
-        if ((ret = close_slave(&tee->slaves[i])) < 0) {
+        if ((ret = stop_slave_thread(&tee->slaves[i])) < 0 ||
+            (ret = close_slave(&tee->slaves[i])) < 0) {
             ret = tee_process_slave_failure(avf, i, ret);
             if (!ret_all && ret < 0)
                 ret_all = ret;
@@ -532,66 +813,39 @@ static int tee_write_trailer(AVFormatContext *avf)
 static int tee_write_packet(AVFormatContext *avf, AVPacket *pkt)
 {
     TeeContext *tee = avf->priv_data;
-    AVFormatContext *avf2;
-    AVBSFContext *bsfs;
     AVPacket *const pkt2 = ffformatcontext(avf)->pkt;
     int ret_all = 0, ret;
     unsigned i, s;
     int s2;
 
     for (i = 0; i < tee->nb_slaves; i++) {
-        if (!(avf2 = tee->slaves[i].avf))
-            continue;
-
-        /* Flush slave if pkt is NULL*/
-        if (!pkt) {
-            ret = av_interleaved_write_frame(avf2, NULL);
-            if (ret < 0) {
-                ret = tee_process_slave_failure(avf, i, ret);
-                if (!ret_all && ret < 0)
-                    ret_all = ret;
-            }
-            continue;
-        }
+        TeeSlave *tee_slave = &tee->slaves[i];
 
-        s = pkt->stream_index;
-        s2 = tee->slaves[i].stream_map[s];
-        if (s2 < 0)
+        if (!tee_slave->avf)
             continue;
 
-        if ((ret = av_packet_ref(pkt2, pkt)) < 0) {
-            if (!ret_all)
-                ret_all = ret;
-            continue;
-        }
-        bsfs = tee->slaves[i].bsfs[s2];
-        pkt2->stream_index = s2;
-
-        ret = av_bsf_send_packet(bsfs, pkt2);
-        if (ret < 0) {
-            av_packet_unref(pkt2);
-            av_log(avf, AV_LOG_ERROR, "Error while sending packet to bitstream filter: %s\n",
-                   av_err2str(ret));
-            ret = tee_process_slave_failure(avf, i, ret);
-            if (!ret_all && ret < 0)
-                ret_all = ret;
+        if (!pkt) {
+            s2 = -1;
+        } else {
+            s = pkt->stream_index;
+            s2 = tee_slave->stream_map[s];
+            if (s2 < 0)
+                continue;
         }
 
-        while(1) {
-            ret = av_bsf_receive_packet(bsfs, pkt2);
-            if (ret == AVERROR(EAGAIN)) {
-                ret = 0;
-                break;
-            } else if (ret < 0) {
-                break;
+        if (tee_slave->queue_size) {
+            ret = queue_slave_packet(tee_slave, pkt, s2, avf);
+        } else if (!pkt) {
+            ret = write_slave_packet(tee_slave, NULL, avf);
+        } else {
+            if ((ret = av_packet_ref(pkt2, pkt)) < 0) {
+                if (!ret_all)
+                    ret_all = ret;
+                continue;
             }
-
-            av_packet_rescale_ts(pkt2, bsfs->time_base_out,
-                                 avf2->streams[s2]->time_base);
-            ret = av_interleaved_write_frame(avf2, pkt2);
-            if (ret < 0)
-                break;
-        };
+            pkt2->stream_index = s2;
+            ret = write_slave_packet(tee_slave, pkt2, avf);
+        }
 
         if (ret < 0) {
             ret = tee_process_slave_failure(avf, i, ret);
@@ -0,0 +1,72 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "libavutil/mem_internal.h"
+
+#include "libavcodec/ac3defs.h"
+#include "libavcodec/ac3dsp.h"
+#include "libavcodec/ac3tab.h"
+
+#include "checkasm.h"
+
+static const int floors[] = { 0x2f0, 0x2b0, 0x270, 0x230, 0x1f0, 0x170, 0x0f0, -2048 };
+
+static void check_bit_alloc_calc_bap(const AC3DSPContext *c)
+{
+    LOCAL_ALIGNED_16(int16_t, mask, [AC3_CRITICAL_BANDS]);
+    LOCAL_ALIGNED_16(int16_t, psd,  [AC3_MAX_COEFS]);
+    LOCAL_ALIGNED_16(uint8_t, bap0, [AC3_MAX_COEFS]);
+    LOCAL_ALIGNED_16(uint8_t, bap1, [AC3_MAX_COEFS]);
+
+    declare_func(void, int16_t *mask, int16_t *psd, int start, int end,
+                 int snr_offset, int floor, const uint8_t *bap_tab, uint8_t *bap);
+
+    if (check_func(c->bit_alloc_calc_bap, "ac3_bit_alloc_calc_bap")) {
+        for (int i = 0; i < 32; i++) {
+            int start = i & 1 ? 0 : rnd() % 253;
+            int end   = start + 1 + rnd() % (253 - start);
+            int snr_offset = i == 31 ? -960 : ((int)(rnd() % 1024) - 240) * 4;
+            int floor = floors[rnd() % FF_ARRAY_ELEMS(floors)];
+
+            for (int j = 0; j < AC3_CRITICAL_BANDS; j++)
+                mask[j] = (int)(rnd() % 8000) - 2000;
+            for (int j = 0; j < AC3_MAX_COEFS; j++)
+                psd[j] = rnd() % 3200;
+            memset(bap0, 0xAA, AC3_MAX_COEFS);
+            memset(bap1, 0xAA, AC3_MAX_COEFS);
+
+            call_ref(mask, psd, start, end, snr_offset, floor, ff_ac3_bap_tab, bap0);
+            call_new(mask, psd, start, end, snr_offset, floor, ff_ac3_bap_tab, bap1);
+            if (memcmp(bap0, bap1, AC3_MAX_COEFS))
+                fail();
+        }
+        bench_new(mask, psd, 0, 253, 0, 0x270, ff_ac3_bap_tab, bap1);
+    }
+}
+
+void checkasm_check_ac3dsp(void)
+{
+    AC3DSPContext c;
+
+    ff_ac3dsp_init(&c);
+
+    check_bit_alloc_calc_bap(&c);
+    report("bit_alloc_calc_bap");
+}
@@ -0,0 +1,90 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "checkasm.h"
+#include "libavcodec/ffv1dsp.h"
+#include "libavutil/common.h"
+#include "libavutil/mem_internal.h"
+
+#define WIDTH 1923
+
+static void init_quant_table(int16_t quant_table[5][256])
+{
+    /* Odd and monotonic like the tables of the encoder */
+    for (int i = 0; i < 5; i++) {
+        int scale = 1 + i * 11;
+        for (int j = 0; j < 128; j++) {
+            quant_table[i][j] = FFMIN(av_log2(j + 1), 5) * scale;
+            if (j)
+                quant_table[i][256 - j] = -quant_table[i][j];
+        }
+        quant_table[i][128] = -quant_table[i][127];
+    }
+}
+
+#define CHECK_TOP_CONTEXT(type, name, mask)                                     \
+static void check_##name(const FFV1DSPContext *c,                               \
+                         const int16_t (*quant_table)[256])                     \
+{                                                                               \
+    LOCAL_ALIGNED_32(type, top,  [WIDTH + 6]);                                  \
+    LOCAL_ALIGNED_32(type, top2, [WIDTH + 6]);                                  \
+    LOCAL_ALIGNED_32(int16_t, dst_ref, [WIDTH]);                                \
+    LOCAL_ALIGNED_32(int16_t, dst_new, [WIDTH]);                                \
+                                                                                \
+    declare_func(void, int16_t *dst, const type *t, const type *tt,             \
+                 const int16_t (*quant_table)[256], int w);                     \
+                                                                                \
+    for (int i = 0; i < WIDTH + 6; i++) {                                       \
+        /* Runs of equal samples for the zero context */                        \
+        top[i]  = i && !(rnd() & 3) ? top[i - 1] : (type)(rnd() & mask);        \
+        top2[i] = rnd() & 1 ? top[i] : (type)(rnd() & mask);                    \
+    }                                                                           \
+                                                                                \
+    for (int large = 0; large < 2; large++) {                                   \
+        if (check_func(c->name, #name "%s", large ? "_large" : "")) {           \
+            const type *top2p = large ? top2 + 3 : NULL;                        \
+            memset(dst_ref, 0, WIDTH * sizeof(*dst_ref));                       \
+            memset(dst_new, 0, WIDTH * sizeof(*dst_new));                       \
+            call_ref(dst_ref, top + 3, top2p, quant_table, WIDTH);              \
+            call_new(dst_new, top + 3, top2p, quant_table, WIDTH);              \
+            if (memcmp(dst_ref, dst_new, WIDTH * sizeof(*dst_ref)))             \
+                fail();                                                         \
+            bench_new(dst_new, top + 3, top2p, quant_table, WIDTH);             \
+        }                                                                       \
+    }                                                                           \
+}
+
+CHECK_TOP_CONTEXT(int16_t, top_context,   0xFFFF)
+CHECK_TOP_CONTEXT(int32_t, top_context32, 0x1FFFF)
+
+void checkasm_check_ffv1dsp(void)
+{
+    FFV1DSPContext c;
+    int16_t quant_table[5][256];
+
+    ff_ffv1dsp_init(&c);
+    init_quant_table(quant_table);
+
+    check_top_context(&c, (const int16_t (*)[256])quant_table);
+    report("top_context");
+
+    check_top_context32(&c, (const int16_t (*)[256])quant_table);
+    report("top_context32");
+}
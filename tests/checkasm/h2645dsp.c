@@ -0,0 +1,99 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "libavutil/macros.h"
+#include "libavutil/mem_internal.h"
+
+#include "libavcodec/h2645dsp.h"
+
+#include "checkasm.h"
+
+#define BUF_SIZE 4096
+/* zero bytes around the tested region, which would complete a sequence
+ * with any trailing or leading zero bytes if they were read */
+#define GUARD    64
+
+/* Random non-zero bytes with a few zero bytes and 0x0000XX sequences, both
+ * with XX <= 3 and XX > 3, sprinkled in. */
+static void randomize_buffer(uint8_t *buf, int size, int nb_seqs)
+{
+    for (int i = 0; i < size; i++)
+        buf[i] = rnd() % 255 + 1;
+    for (int i = 0; i < nb_seqs; i++) {
+        int pos = rnd() % (size - 2);
+        buf[pos]     = 0;
+        buf[pos + 1] = rnd() & 1 ? 0 : buf[pos + 1];
+        buf[pos + 2] = rnd() & 7;
+    }
+}
+
+/* Long runs of zero bytes, separated by small values. */
+static void randomize_buffer_dense(uint8_t *buf, int size)
+{
+    for (int i = 0; i < size; i++)
+        buf[i] = rnd() & 3 ? 0 : rnd() % 5;
+}
+
+static void check_find_escape(const H2645DSPContext *c)
+{
+    LOCAL_ALIGNED_32(uint8_t, buf, [GUARD + BUF_SIZE + GUARD]);
+    uint8_t *const data = buf + GUARD;
+
+    declare_func(int, const uint8_t *buf, int size);
+
+    if (check_func(c->find_escape, "h2645_find_escape")) {
+        for (int i = 0; i < 96; i++) {
+            int offset = rnd() % 32;
+            int size   = i & 1 ? rnd() % 48 : rnd() % (BUF_SIZE - offset + 1);
+            int ref, new;
+
+            memset(buf, 0, GUARD + BUF_SIZE + GUARD);
+            if (i < 64)
+                randomize_buffer(data + offset, FFMAX(size, 3), i % 8);
+            else
+                randomize_buffer_dense(data + offset, size);
+            /* end on zero bytes, the guard completes the sequence */
+            if (size >= 2 && i % 4 == 3)
+                data[offset + size - 1] = data[offset + size - 2] = 0;
+            memset(data + offset + size, 0, BUF_SIZE - offset - size + GUARD);
+
+            ref = call_ref(data + offset, size);
+            new = call_new(data + offset, size);
+            if (ref != new) {
+                fprintf(stderr, "find_escape: offset %d size %d: %d != %d\n",
+                        offset, size, ref, new);
+                fail();
+                break;
+            }
+        }
+        randomize_buffer(data, BUF_SIZE, 0);
+        bench_new(data, BUF_SIZE);
+    }
+}
+
+void checkasm_check_h2645dsp(void)
+{
+    H2645DSPContext c;
+
+    ff_h2645dsp_init(&c);
+
+    check_find_escape(&c);
+    report("find_escape");
+}
@@ -0,0 +1,170 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/mem_internal.h"
+
+#include "libavcodec/pngdsp.h"
+
+#include "checkasm.h"
+
+#define MAX_BPP   8
+#define MAX_WIDTH 1024
+#define BUF_SIZE  (MAX_WIDTH * MAX_BPP + 64)
+
+/* Every width up to two vectors is tested, to cover rows shorter than one
+ * vector and all tail lengths, followed by one random width. */
+#define NB_SMALL_WIDTHS 32
+
+#define randomize_buffers(buf, size)     \
+    do {                                 \
+        int j;                           \
+        for (j = 0; j < size; j++)       \
+            buf[j] = rnd();              \
+    } while (0)
+
+static const int bpps[] = { 1, 2, 3, 4, 6, 8 };
+
+static void check_add_bytes_l2(const PNGDSPContext *c)
+{
+    LOCAL_ALIGNED_16(uint8_t, src1, [BUF_SIZE]);
+    LOCAL_ALIGNED_16(uint8_t, src2, [BUF_SIZE]);
+    LOCAL_ALIGNED_16(uint8_t, dst0, [BUF_SIZE]);
+    LOCAL_ALIGNED_16(uint8_t, dst1, [BUF_SIZE]);
+
+    declare_func(void, uint8_t *dst, uint8_t *src1, uint8_t *src2, int w);
+
+    if (check_func(c->add_bytes_l2, "add_bytes_l2")) {
+        for (int n = 1; n <= NB_SMALL_WIDTHS + 1; n++) {
+            int w = n <= NB_SMALL_WIDTHS ? n : 1 + rnd() % (MAX_WIDTH * MAX_BPP);
+            randomize_buffers(src1, BUF_SIZE);
+            randomize_buffers(src2, BUF_SIZE);
+            randomize_buffers(dst0, BUF_SIZE);
+            memcpy(dst1, dst0, BUF_SIZE);
+            call_ref(dst0, src1, src2, w);
+            call_new(dst1, src1, src2, w);
+            if (memcmp(dst0, dst1, BUF_SIZE))
+                fail();
+        }
+        bench_new(dst1, src1, src2, MAX_WIDTH * 4);
+    }
+    report("add_bytes_l2");
+}
+
+static void check_add_sub_prediction(const PNGDSPContext *c)
+{
+    LOCAL_ALIGNED_16(uint8_t, src,  [BUF_SIZE]);
+    LOCAL_ALIGNED_16(uint8_t, dst0, [BUF_SIZE]);
+    LOCAL_ALIGNED_16(uint8_t, dst1, [BUF_SIZE]);
+
+    declare_func(void, uint8_t *dst, const uint8_t *src, int w, int bpp);
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(bpps); i++) {
+        int bpp = bpps[i];
+        if (check_func(c->add_sub_prediction, "add_sub_prediction_%d", bpp)) {
+            for (int n = 0; n <= NB_SMALL_WIDTHS / bpp + 1; n++) {
+                int w = bpp * (n <= NB_SMALL_WIDTHS / bpp ? n : rnd() % MAX_WIDTH);
+                randomize_buffers(src,  BUF_SIZE);
+                randomize_buffers(dst0, BUF_SIZE);
+                memcpy(dst1, dst0, BUF_SIZE);
+                call_ref(dst0 + bpp, src, w, bpp);
+                call_new(dst1 + bpp, src, w, bpp);
+                if (memcmp(dst0, dst1, BUF_SIZE))
+                    fail();
+            }
+            bench_new(dst1 + bpp, src, MAX_WIDTH * bpp, bpp);
+        }
+    }
+    report("add_sub_prediction");
+}
+
+static void check_add_avg_prediction(const PNGDSPContext *c)
+{
+    LOCAL_ALIGNED_16(uint8_t, src,  [BUF_SIZE]);
+    LOCAL_ALIGNED_16(uint8_t, top,  [BUF_SIZE]);
+    LOCAL_ALIGNED_16(uint8_t, dst0, [BUF_SIZE]);
+    LOCAL_ALIGNED_16(uint8_t, dst1, [BUF_SIZE]);
+
+    declare_func(void, uint8_t *dst, const uint8_t *src,
+                 const uint8_t *top, int w, int bpp);
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(bpps); i++) {
+        int bpp = bpps[i];
+        if (check_func(c->add_avg_prediction, "add_avg_prediction_%d", bpp)) {
+            for (int n = 0; n <= NB_SMALL_WIDTHS / bpp + 1; n++) {
+                int w = bpp * (n <= NB_SMALL_WIDTHS / bpp ? n : rnd() % MAX_WIDTH);
+                randomize_buffers(src,  BUF_SIZE);
+                randomize_buffers(top,  BUF_SIZE);
+                randomize_buffers(dst0, BUF_SIZE);
+                memcpy(dst1, dst0, BUF_SIZE);
+                call_ref(dst0 + bpp, src, top, w, bpp);
+                call_new(dst1 + bpp, src, top, w, bpp);
+                if (memcmp(dst0, dst1, BUF_SIZE))
+                    fail();
+            }
+            bench_new(dst1 + bpp, src, top, MAX_WIDTH * bpp, bpp);
+        }
+    }
+    report("add_avg_prediction");
+}
+
+static void check_add_paeth_prediction(const PNGDSPContext *c)
+{
+    LOCAL_ALIGNED_16(uint8_t, src,  [BUF_SIZE]);
+    LOCAL_ALIGNED_16(uint8_t, top,  [BUF_SIZE]);
+    LOCAL_ALIGNED_16(uint8_t, dst0, [BUF_SIZE]);
+    LOCAL_ALIGNED_16(uint8_t, dst1, [BUF_SIZE]);
+
+    declare_func(void, uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
+
+    /* The decoder uses the SIMD version only for bpp > 2, and not for the
+     * last 3 bytes of a row if bpp is not a multiple of 4. */
+    for (int i = 2; i < FF_ARRAY_ELEMS(bpps); i++) {
+        int bpp = bpps[i];
+        if (check_func(c->add_paeth_prediction, "add_paeth_prediction_%d", bpp)) {
+            for (int n = 1; n <= NB_SMALL_WIDTHS / bpp + 1; n++) {
+                int w = bpp * (n <= NB_SMALL_WIDTHS / bpp ? n : 1 + rnd() % MAX_WIDTH);
+                int cmp_size = bpp + ((bpp & 3) ? w - 3 : w);
+                randomize_buffers(src,  BUF_SIZE);
+                randomize_buffers(top,  BUF_SIZE);
+                randomize_buffers(dst0, BUF_SIZE);
+                memcpy(dst1, dst0, BUF_SIZE);
+                call_ref(dst0 + bpp, src + bpp, top + bpp, w, bpp);
+                call_new(dst1 + bpp, src + bpp, top + bpp, w, bpp);
+                if (memcmp(dst0, dst1, cmp_size))
+                    fail();
+            }
+            bench_new(dst1 + bpp, src + bpp, top + bpp, MAX_WIDTH * bpp, bpp);
+        }
+    }
+    report("add_paeth_prediction");
+}
+
+void checkasm_check_pngdsp(void)
+{
+    PNGDSPContext c;
+
+    ff_pngdsp_init(&c);
+
+    check_add_bytes_l2(&c);
+    check_add_sub_prediction(&c);
+    check_add_avg_prediction(&c);
+    check_add_paeth_prediction(&c);
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "libavutil/mem_internal.h"
+
+#include "libavcodec/avcodec.h"
+#include "libavcodec/proresdsp.h"
+
+#include "checkasm.h"
+
+/* 8 rows of 16 pixels, the right half catches writes past the block */
+#define STRIDE 16
+
+static void check_idct_put(int bits)
+{
+    LOCAL_ALIGNED_16(int16_t, block,  [64]);
+    LOCAL_ALIGNED_16(int16_t, block0, [64]);
+    LOCAL_ALIGNED_16(int16_t, block1, [64]);
+    LOCAL_ALIGNED_16(int16_t, qmat,   [64]);
+    LOCAL_ALIGNED_16(int16_t, qmat0,  [64]);
+    LOCAL_ALIGNED_16(int16_t, qmat1,  [64]);
+    LOCAL_ALIGNED_16(uint16_t, dst0, [8 * STRIDE]);
+    LOCAL_ALIGNED_16(uint16_t, dst1, [8 * STRIDE]);
+    AVCodecContext avctx = { .bits_per_raw_sample = bits };
+    ProresDSPContext dsp;
+
+    declare_func(void, uint16_t *out, ptrdiff_t linesize, int16_t *block,
+                 const int16_t *qmat);
+
+    if (ff_proresdsp_init(&dsp, &avctx) < 0)
+        return;
+
+    if (check_func(dsp.idct_put, "prores_idct_put_%d", bits)) {
+        for (int n = 0; n < 16; n++) {
+            /* Coefficients are sparse and small, as after entropy decoding;
+             * the reference always takes them in natural order. */
+            block[0] = (int)(rnd() % 4096) - 2048;
+            for (int i = 1; i < 64; i++)
+                block[i] = rnd() % 3 ? 0 : (int)(rnd() % 512) - 256;
+            for (int i = 0; i < 64; i++)
+                qmat[i] = 1 + rnd() % 4;
+
+            for (int i = 0; i < 64; i++) {
+                block1[dsp.idct_permutation[i]] = block[i];
+                qmat1[dsp.idct_permutation[i]]  = qmat[i];
+            }
+            memcpy(block0, block, sizeof(*block) * 64);
+            memcpy(qmat0,  qmat,  sizeof(*qmat)  * 64);
+            memset(dst0, 0xAA, sizeof(*dst0) * 8 * STRIDE);
+            memset(dst1, 0xAA, sizeof(*dst1) * 8 * STRIDE);
+
+            call_ref(dst0, STRIDE * sizeof(*dst0), block0, qmat0);
+            call_new(dst1, STRIDE * sizeof(*dst1), block1, qmat1);
+            if (memcmp(dst0, dst1, sizeof(*dst0) * 8 * STRIDE))
+                fail();
+        }
+        bench_new(dst1, STRIDE * sizeof(*dst1), block1, qmat1);
+    }
+}
+
+void checkasm_check_proresdsp(void)
+{
+    check_idct_put(10);
+    check_idct_put(12);
+    report("idct_put");
+}
@@ -67,6 +67,19 @@ $(foreach N,$(FATE_CBS_H264_SAMPLES),$(eval $(call FATE_CBS_TEST,h264,$(basename
 
 FATE_CBS_H264-$(call FATE_CBS_DEPS, H264, H264, H264, H264, H264) = $(FATE_CBS_h264)
 
+# Lazy decomposition: only parameter sets are decomposed and everything
+# else is passed through, so the output must match the read/write test.
+FATE_CBS_H264-$(call FATE_CBS_DEPS, H264, H264, H264, H264, H264) += fate-cbs-h264-SVA_Base_B-lazy
+fate-cbs-h264-SVA_Base_B-lazy: CMD = md5 -c:v h264 -i $(TARGET_SAMPLES)/h264-conformance/SVA_Base_B.264 -c:v copy -y -bsf:v h264_metadata=lazy=1 -f h264
+fate-cbs-h264-SVA_Base_B-lazy: REF = $(SRC_PATH)/tests/ref/fate/cbs-h264-SVA_Base_B
+
+# Slices are decomposed on demand to build the inserted AUDs. The stream
+# has no AUDs of its own, so removing them again must give the same result
+# as the plain read/write test.
+FATE_CBS_H264-$(call ALLYES, H264_DEMUXER H264_PARSER H264_METADATA_BSF FILTER_UNITS_BSF H264_DECODER H264_MUXER) += fate-cbs-h264-SVA_Base_B-lazy-aud
+fate-cbs-h264-SVA_Base_B-lazy-aud: CMD = md5 -c:v h264 -i $(TARGET_SAMPLES)/h264-conformance/SVA_Base_B.264 -c:v copy -y -bsf:v h264_metadata=aud=insert:lazy=1,filter_units=remove_types=9 -f h264
+fate-cbs-h264-SVA_Base_B-lazy-aud: REF = $(SRC_PATH)/tests/ref/fate/cbs-h264-SVA_Base_B
+
 
 FATE_H264_REDUNDANT_PPS-$(call REMUX, H264, MOV_DEMUXER H264_REDUNDANT_PPS_BSF   \
                                       H264_DECODER H264_PARSER RAWVIDEO_ENCODER) \
@@ -133,6 +146,11 @@ FATE_CBS_HEVC_SAMPLES =       \
 $(foreach N,$(FATE_CBS_HEVC_SAMPLES),$(eval $(call FATE_CBS_TEST,hevc,$(basename $(N)),hevc,hevc-conformance/$(N),hevc)))
 
 FATE_CBS_HEVC-$(call FATE_CBS_DEPS, HEVC, HEVC, HEVC, HEVC, HEVC) = $(FATE_CBS_hevc)
+
+# Lazy decomposition, must match the read/write test.
+FATE_CBS_HEVC-$(call FATE_CBS_DEPS, HEVC, HEVC, HEVC, HEVC, HEVC) += fate-cbs-hevc-WPP_A_ericsson_MAIN_2-lazy
+fate-cbs-hevc-WPP_A_ericsson_MAIN_2-lazy: CMD = md5 -c:v hevc -i $(TARGET_SAMPLES)/hevc-conformance/WPP_A_ericsson_MAIN_2.bit -c:v copy -y -bsf:v hevc_metadata=lazy=1 -f hevc
+fate-cbs-hevc-WPP_A_ericsson_MAIN_2-lazy: REF = $(SRC_PATH)/tests/ref/fate/cbs-hevc-WPP_A_ericsson_MAIN_2
 FATE_SAMPLES_AVCONV += $(FATE_CBS_HEVC-yes)
 fate-cbs-hevc: $(FATE_CBS_HEVC-yes)
 
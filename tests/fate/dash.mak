@@ -0,0 +1,25 @@
+# Representations 0 and 1 of the manifest share their fragments and their
+# initialization section, representation 2 has its own.
+tests/data/dash-prefetch/dash-prefetch.mpd: TAG = GEN
+tests/data/dash-prefetch/dash-prefetch.mpd: ffmpeg$(PROGSSUF)$(EXESUF) $(SRC_PATH)/tests/dash-prefetch.mpd | tests/data
+	$(Q)mkdir -p tests/data/dash-prefetch
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i testsrc2=size=64x64:rate=25:duration=4 \
+        -f lavfi -i testsrc2=size=32x32:rate=25:duration=4 \
+        -map 0 -map 1 -c:v mpeg4 -g 25 -threads 1 -flags +bitexact -fflags +bitexact \
+        -f dash -seg_duration 1 -use_timeline 0 -y $(TARGET_PATH)/tests/data/dash-prefetch/out.mpd 2>/dev/null
+	$(Q)cp $(SRC_PATH)/tests/dash-prefetch.mpd $@
+
+FATE_DASH-$(call ALLYES, DASH_DEMUXER DASH_MUXER MOV_DEMUXER LAVFI_INDEV TESTSRC2_FILTER \
+                         MPEG4_ENCODER MPEG4_DECODER FRAMECRC_MUXER FILE_PROTOCOL) += fate-dash-shared-init \
+                                                                                     fate-dash-prefetch
+fate-dash-shared-init: CMD = framecrc -i $(TARGET_PATH)/tests/data/dash-prefetch/dash-prefetch.mpd -map 0 -c copy
+
+# a small prefetch_size makes most fragments spill over to their input
+fate-dash-prefetch: CMD = framecrc -prefetch_segments 2 -prefetch_size 16384 -i $(TARGET_PATH)/tests/data/dash-prefetch/dash-prefetch.mpd -map 0 -c copy
+fate-dash-prefetch: REF = $(SRC_PATH)/tests/ref/fate/dash-shared-init
+
+$(FATE_DASH-yes): tests/data/dash-prefetch/dash-prefetch.mpd
+
+FATE_FFMPEG += $(FATE_DASH-yes)
+fate-dash: $(FATE_DASH-yes)
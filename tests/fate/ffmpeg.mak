@@ -41,6 +41,16 @@ fate-ffmpeg-filter_colorkey: CMD = framecrc -auto_conversion_filters -idct simpl
 FATE_FFMPEG-$(call FILTERFRAMECRC, COLOR) += fate-ffmpeg-lavfi
 fate-ffmpeg-lavfi: CMD = framecrc -lavfi color=d=1:r=5 -fflags +bitexact
 
+# Writing through tee slave queues in block mode must give the same output.
+FATE_FFMPEG-$(call FILTERFRAMECRC, COLOR, TEE_MUXER NULL_MUXER) += fate-ffmpeg-tee-queue
+fate-ffmpeg-tee-queue: CMD = ffmpeg -lavfi color=d=1:r=5 -fflags +bitexact -c:v rawvideo -bitexact -f tee -queue_size 2 "[f=framecrc:overflow=block]pipe:1|[f=null]-"
+fate-ffmpeg-tee-queue: REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-lavfi
+
+# Two filters undoing each other, each in its own thread in async mode.
+FATE_FFMPEG-$(call FILTERFRAMECRC, COLOR, SETTS_BSF) += fate-ffmpeg-bsf-async
+fate-ffmpeg-bsf-async: CMD = framecrc -lavfi color=d=1:r=5 -fflags +bitexact -bsf:v setts=ts=TS*2,setts=ts=TS/2 -bsf_async:v
+fate-ffmpeg-bsf-async: REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-lavfi
+
 FATE_SAMPLES_FFMPEG-$(call ENCDEC2, MPEG4, RAWVIDEO, AVI, RAWVIDEO_DEMUXER FRAMECRC_MUXER) += fate-force_key_frames
 fate-force_key_frames: tests/data/vsynth_lena.yuv
 fate-force_key_frames: CMD = enc_dec \
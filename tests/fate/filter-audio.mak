@@ -214,6 +214,11 @@ FATE_AFILTER-$(call ALLYES, HLS_DEMUXER MPEGTS_MUXER MPEGTS_DEMUXER AEVALSRC_FIL
 fate-filter-hls: tests/data/hls-list.m3u8
 fate-filter-hls: CMD = framecrc -flags +bitexact -i $(TARGET_PATH)/tests/data/hls-list.m3u8 -af aresample
 
+FATE_AFILTER-$(call ALLYES, HLS_DEMUXER MPEGTS_MUXER MPEGTS_DEMUXER AEVALSRC_FILTER LAVFI_INDEV MP2FIXED_ENCODER) += fate-filter-hls-prefetch
+fate-filter-hls-prefetch: tests/data/hls-list.m3u8
+fate-filter-hls-prefetch: CMD = framecrc -flags +bitexact -prefetch_segments 2 -prefetch_size 65536 -i $(TARGET_PATH)/tests/data/hls-list.m3u8 -af aresample
+fate-filter-hls-prefetch: REF = $(SRC_PATH)/tests/ref/fate/filter-hls
+
 tests/data/hls-list-append.m3u8: TAG = GEN
 tests/data/hls-list-append.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
 	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
@@ -205,6 +205,39 @@ $(FATE_SEEK) $(FATE_SAMPLES_SEEK): fate-seek-%: fate-%
 $(subst fate-seek-,fate-,$(FATE_SAMPLES_SEEK) $(FATE_SEEK)): KEEP_FILES ?= 1
 fate-seek-%: REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%=%)
 
-FATE_AVCONV += $(FATE_SEEK)
-FATE_SAMPLES_AVCONV += $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
-fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
+# growing the reads must not change the result
+FATE_SEEK_READAHEAD := $(if $(filter fate-seek-lavf-mov, $(FATE_SEEK)), fate-seek-lavf-mov-readahead)
+fate-seek-lavf-mov-readahead: fate-lavf-mov libavformat/tests/seek$(EXESUF)
+fate-seek-lavf-mov-readahead: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.mov -readahead_max 262144
+fate-seek-lavf-mov-readahead: REF = $(SRC_PATH)/tests/ref/seek/lavf-mov
+
+# raw MPEG-2 needs more than one buffer of probe data, so the buffer is shrunk
+# back after probing before the first seek
+FATE_SAMPLES_SEEK_READAHEAD := $(if $(filter fate-seek-vsynth_lena-mpeg2-422, $(FATE_SAMPLES_SEEK)), fate-seek-vsynth_lena-mpeg2-422-readahead)
+fate-seek-vsynth_lena-mpeg2-422-readahead: fate-vsynth_lena-mpeg2-422 libavformat/tests/seek$(EXESUF)
+fate-seek-vsynth_lena-mpeg2-422-readahead: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/fate/vsynth_lena-mpeg2-422.mpeg2video -readahead_max 65536
+fate-seek-vsynth_lena-mpeg2-422-readahead: REF = $(SRC_PATH)/tests/ref/seek/vsynth_lena-mpeg2-422
+
+# a lazily built mov index (more samples than are indexed when opening)
+# must seek exactly like the full one
+FATE_SEEK_LAZY-$(call ALLYES, LAVFI_INDEV TESTSRC2_FILTER MPEG4_ENCODER MPEG4_DECODER \
+                              MOV_MUXER MOV_DEMUXER FILE_PROTOCOL) += fate-seek-mov-many-samples \
+                                                                      fate-seek-mov-many-samples-lazy
+$(FATE_SEEK_LAZY-yes): MOV_MANY_SAMPLES = $(TARGET_PATH)/tests/data/fate/$(@:fate-%=%).mov
+$(FATE_SEEK_LAZY-yes): CMD = ffmpeg -f lavfi -i testsrc2=size=32x32:rate=100:duration=50 -c:v mpeg4 -g 50 -threads 1 -bitexact -y $(MOV_MANY_SAMPLES) && \
+                                   run libavformat/tests/seek$(EXESUF) $(MOV_MANY_SAMPLES) -duration 60 $(SEEK_OPTS)
+fate-seek-mov-many-samples-lazy: SEEK_OPTS = -lazy_index 1
+fate-seek-mov-many-samples-lazy: REF = $(SRC_PATH)/tests/ref/seek/mov-many-samples
+$(FATE_SEEK_LAZY-yes): libavformat/tests/seek$(EXESUF)
+
+# building a seek index file and then seeking with it must not change the
+# result either
+SEEK_INDEX_FILE = $(TARGET_PATH)/tests/data/fate/seek-lavf-ts-index.idx
+FATE_SEEK_INDEX := $(if $(filter fate-seek-lavf-ts, $(FATE_SEEK)), fate-seek-lavf-ts-index)
+fate-seek-lavf-ts-index: fate-lavf-ts libavformat/tests/seek$(EXESUF)
+fate-seek-lavf-ts-index: CMD = rm -f $(SEEK_INDEX_FILE); run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.ts -index_file $(SEEK_INDEX_FILE) > /dev/null; run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.ts -index_file $(SEEK_INDEX_FILE)
+fate-seek-lavf-ts-index: REF = $(SRC_PATH)/tests/ref/seek/lavf-ts
+
+FATE_AVCONV += $(FATE_SEEK) $(FATE_SEEK_READAHEAD) $(FATE_SEEK_INDEX) $(FATE_SEEK_LAZY-yes)
+FATE_SAMPLES_AVCONV += $(FATE_SAMPLES_SEEK) $(FATE_SAMPLES_SEEK_READAHEAD) $(FATE_SEEK_EXTRA)
+fate-seek:     $(FATE_SEEK) $(FATE_SEEK_READAHEAD) $(FATE_SEEK_INDEX) $(FATE_SAMPLES_SEEK) $(FATE_SAMPLES_SEEK_READAHEAD) $(FATE_SEEK_EXTRA)
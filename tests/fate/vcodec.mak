@@ -223,6 +223,11 @@ FATE_VCODEC_SCALE-$(call ENCDEC, JPEG2000, AVI) += jpeg2000 jpeg2000-97
 fate-vsynth%-jpeg2000:                ENCOPTS = -qscale 7 -strict experimental -pred 1 -pix_fmt rgb24
 fate-vsynth%-jpeg2000-97:             ENCOPTS = -qscale 7 -strict experimental -pix_fmt rgb24
 
+# single tile, so that the code-blocks are decoded in parallel
+FATE_JPEG2000-$(call TRANSCODE, JPEG2000, AVI, RAWVIDEO_DEMUXER SCALE_FILTER) += fate-jpeg2000-slice-threads
+fate-jpeg2000-slice-threads: tests/data/vsynth1.yuv
+fate-jpeg2000-slice-threads: CMD = transcode "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv avi "-c:v jpeg2000 -qscale 7 -strict experimental -pix_fmt rgb24 -tile_width 352 -tile_height 288 -frames:v 5" "" "" "" "-threads 4 -thread_type slice" "-auto_conversion_filters"
+
 FATE_VCODEC-$(call ENCDEC, LJPEG MJPEG, AVI) += ljpeg
 fate-vsynth%-ljpeg:              ENCOPTS = -strict -1
 
@@ -234,6 +239,11 @@ fate-vsynth%-mjpeg-trell:             ENCOPTS = -qscale 9 -pix_fmt yuvj420p -tre
 fate-vsynth%-mjpeg-huffman:           ENCOPTS = -qscale 9 -pix_fmt yuvj420p -huffman optimal
 fate-vsynth%-mjpeg-trell-huffman:     ENCOPTS = -qscale 9 -pix_fmt yuvj420p -trellis 1 -huffman optimal
 
+# Restart intervals decoded with slice threads
+FATE_MJPEG-$(call TRANSCODE, MJPEG, MJPEG, RAWVIDEO_DEMUXER SCALE_FILTER) += fate-mjpeg-rst-threads
+fate-mjpeg-rst-threads: tests/data/vsynth1.yuv
+fate-mjpeg-rst-threads: CMD = transcode "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv mjpeg "-c:v mjpeg -q:v 9 -pix_fmt yuvj420p -threads 2 -slices 2 -frames:v 5" "" "" "" "-threads 4 -thread_type slice" "-auto_conversion_filters"
+
 FATE_VCODEC-$(call ENCDEC, MPEG1VIDEO, MPEG1VIDEO MPEGVIDEO) += mpeg1 mpeg1b
 fate-vsynth%-mpeg1:              FMT     = mpeg1video
 fate-vsynth%-mpeg1:              CODEC   = mpeg1video
@@ -339,6 +349,10 @@ fate-vsynth%-msmpeg4v2:          ENCOPTS = -qscale 10
 FATE_VCODEC_SCALE-$(call ENCDEC, PNG, AVI) += mpng
 fate-vsynth%-mpng:               CODEC   = png
 
+FATE_MPNG-$(call TRANSCODE, PNG, AVI, RAWVIDEO_DEMUXER SCALE_FILTER) += fate-mpng-slices
+fate-mpng-slices: tests/data/vsynth1.yuv
+fate-mpng-slices: CMD = transcode "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv avi "-c:v png -pix_fmt rgb24 -threads 2 -thread_type slice -slices 4 -frames:v 5" "" "" "" "" "-auto_conversion_filters"
+
 FATE_VCODEC_SCALE-$(call ENCDEC, MSVIDEO1, AVI) += msvideo1
 
 FATE_VCODEC_SCALE-$(call ENCDEC, PRORES, MOV) += prores prores_int prores_444 prores_444_int prores_ks
@@ -484,11 +498,15 @@ $(FATE_VSYNTH2): tests/data/vsynth2.yuv
 $(FATE_VSYNTH_LENA): tests/data/vsynth_lena.yuv
 $(FATE_VSYNTH3): tests/data/vsynth3.yuv
 
-FATE_AVCONV += $(FATE_VSYNTH1) $(FATE_VSYNTH2) $(FATE_VSYNTH3)
+FATE_MJPEG = $(FATE_MJPEG-yes)
+FATE_MPNG = $(FATE_MPNG-yes)
+FATE_JPEG2000 = $(FATE_JPEG2000-yes)
+
+FATE_AVCONV += $(FATE_VSYNTH1) $(FATE_VSYNTH2) $(FATE_VSYNTH3) $(FATE_MJPEG) $(FATE_MPNG) $(FATE_JPEG2000)
 FATE_SAMPLES_AVCONV += $(FATE_VSYNTH_LENA)
 
 fate-vsynth1: $(FATE_VSYNTH1)
 fate-vsynth2: $(FATE_VSYNTH2)
 fate-vsynth_lena: $(FATE_VSYNTH_LENA)
 fate-vsynth3: $(FATE_VSYNTH3)
-fate-vcodec:  fate-vsynth1 fate-vsynth_lena fate-vsynth2 fate-vsynth3
+fate-vcodec:  fate-vsynth1 fate-vsynth_lena fate-vsynth2 fate-vsynth3 $(FATE_MJPEG) $(FATE_MPNG) $(FATE_JPEG2000)